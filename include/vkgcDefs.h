@@ -47,7 +47,7 @@
 #define LLPC_INTERFACE_MAJOR_VERSION 46
 
 /// LLPC minor interface version.
-#define LLPC_INTERFACE_MINOR_VERSION 1
+#define LLPC_INTERFACE_MINOR_VERSION 7
 
 #ifndef LLPC_CLIENT_INTERFACE_MAJOR_VERSION
 #if VFX_INSIDE_SPVGEN
@@ -71,6 +71,12 @@
 //  %Version History
 //  | %Version | Change Description                                                                                    |
 //  | -------- | ----------------------------------------------------------------------------------------------------- |
+//  |     46.7 | Added lockContentionCount to CacheStatistics                                                          |
+//  |     46.6 | Added BuildPipelineAsync to ICompiler, IPipelineBuildTask, and Result::Aborted                        |
+//  |     46.5 | Added retainedBytes and recycleCount to ContextPoolStatistics                                         |
+//  |     46.4 | Added contextPool to CompilerCacheStatistics                                                          |
+//  |     46.3 | Added BuildPipelines to ICompiler                                                                     |
+//  |     46.2 | Added GetCacheStatistics to ICompiler                                                                 |
 //  |     46.1 | Added dynamicVertexStride to GraphicsPipelineBuildInfo                                                |
 //  |     46.0 | Removed the member 'depthBiasEnable' of rsState                                                       |
 //  |     45.4 | Added disableLicmThreshold, unrollHintThreshold, and dontUnrollHintThreshold to PipelineShaderOptions |
@@ -142,6 +148,8 @@ enum class Result : int {
   NotReady = 0x00000003,
   // A required resource (e.g. cache entry) was not found.
   NotFound = 0x00000004,
+  // The requested operation was cancelled before it completed.
+  Aborted = 0x00000005,
   /// The requested operation is unavailable at this time
   ErrorUnavailable = -(0x00000001),
   /// The operation could not complete due to insufficient system memory
@@ -31,6 +31,8 @@
 #pragma once
 
 #include "lgc/PassManager.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/raw_ostream.h"
 
 namespace lgc {
@@ -75,7 +77,10 @@ private:
 };
 
 // =====================================================================================================================
-// Pass manager creator and cache
+// Pass manager creator and cache. The pass managers cached are those whose passes do not depend on the pipeline: glue
+// shader compilation, the front-end's per-shader passes and code generation. The patch and optimization passes are
+// bound to the PipelineState of a pipeline, and which of them are added depends on it, so PipelineState::generate
+// sets them up for each pipeline.
 class PassManagerCache {
 public:
   PassManagerCache(LgcContext *lgcContext) : m_lgcContext(lgcContext) {}
@@ -83,10 +88,23 @@ public:
   // Get pass manager for glue shader compilation
   PassManager &getGlueShaderPassManager(llvm::raw_pwrite_stream &outStream);
 
+  // Get pass manager for the front-end's per-shader passes, which the callback adds when it is first created
+  PassManager &getFrontEndPassManager(llvm::function_ref<void(PassManager &)> addPasses);
+
+  // Get pass manager for code generation of a module that has already been patched and optimized
+  PassManager &getCodeGenPassManager(llvm::raw_pwrite_stream &outStream);
+
+  // Get pass manager for code generation of the module of a hardware shader split out of a patched pipeline module
+  PassManager &getSplitCodeGenPassManager(llvm::raw_pwrite_stream &outStream);
+
   void resetStream();
 
+  // Delete the cached pass managers that refer to the target machine, which the LgcContext is replacing
+  void clearTargetPassManagers();
+
 private:
   PassManager &getPassManager(const PassManagerInfo &info, llvm::raw_pwrite_stream &outStream);
+  std::unique_ptr<PassManager> &getCacheEntry(const PassManagerInfo &info);
 
   LgcContext *m_lgcContext;
   llvm::StringMap<std::unique_ptr<PassManager>> m_cache;
@@ -179,6 +179,11 @@ public:
   // for its link option.
   void setStateFromModule(llvm::Module *module) override final { readState(module); }
 
+  // Set the shader modes of one shader from metadata in its IR module, recorded there by a shader compile.
+  void setShaderModesFromModule(llvm::Module *module, ShaderStage stage) override final {
+    getShaderModes()->setModesFromShader(module, stage);
+  }
+
   // -----------------------------------------------------------------------------------------------------------------
   // Other methods
 
@@ -379,6 +384,9 @@ public:
   }
 
 private:
+  // Generate the pipeline ELF from the patched pipeline module with code generation split per hardware shader
+  bool generateSplit(llvm::Module &pipelineModule, llvm::raw_pwrite_stream &outStream, llvm::Timer *codeGenTimer);
+
   // Read shaderStageMask from IR
   void readShaderStageMask(llvm::Module *module);
 
@@ -85,6 +85,11 @@ public:
   // shader compile, and it had its ShaderModes recorded into IR then.
   void readModesFromShader(llvm::Module *module, ShaderStage stage);
 
+  // Set shader modes (common and specific) of one shader stage from a shader IR module that had its ShaderModes
+  // recorded into IR by a shader compile, as if the front-end had set them. Unlike readModesFromShader, this can be
+  // called for each shader of a pipeline compile.
+  void setModesFromShader(llvm::Module *module, ShaderStage stage);
+
   // Read shader modes from IR metadata in a pipeline
   void readModesFromPipeline(llvm::Module *module);
 
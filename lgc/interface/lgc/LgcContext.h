@@ -30,7 +30,9 @@
  */
 #pragma once
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringRef.h"
+#include <string>
 
 namespace llvm {
 
@@ -86,8 +88,16 @@ public:
   // Get LLVM context
   llvm::LLVMContext &getContext() const { return m_context; }
 
-  // Get the target machine.
-  llvm::TargetMachine *getTargetMachine() const { return m_targetMachine; }
+  // Get the target machine, taking one from the shared target machine cache if releaseTargetMachine() was called.
+  llvm::TargetMachine *getTargetMachine() {
+    if (!m_targetMachine)
+      acquireTargetMachine();
+    return m_targetMachine;
+  }
+
+  // Return the target machine to the shared target machine cache while this LgcContext is idle, so that other
+  // LgcContexts for the same GPU can use it. It must not be called while a compile is using this LgcContext.
+  void releaseTargetMachine();
 
   // Get targetinfo
   const TargetInfo &getTargetInfo() const { return *m_targetInfo; }
@@ -114,6 +124,15 @@ public:
   // Adds target passes to pass manager, depending on "-filetype" and "-emit-llvm" options
   void addTargetPasses(lgc::PassManager &passMgr, llvm::Timer *codeGenTimer, llvm::raw_pwrite_stream &outStream);
 
+  // Get whether addTargetPasses generates an ELF object, rather than assembly or IR
+  static bool isElfOutput();
+
+  // Get the pass manager for the front-end's per-shader passes that is cached in this LgcContext, calling addPasses
+  // to add the passes when it is first created. The passes must not depend on the shader or the pipeline, and must
+  // not keep state from one run to the next. Returns nullptr if pass managers cannot be reused with the current
+  // options, in which case the front-end creates its own pass manager.
+  PassManager *getFrontEndPassManager(llvm::function_ref<void(PassManager &)> addPasses);
+
   // Utility method to create a start/stop timer pass
   static llvm::ModulePass *createStartStopTimer(llvm::Timer *timer, bool starting);
 
@@ -135,12 +154,18 @@ private:
 
   LgcContext(llvm::LLVMContext &context, unsigned palAbiVersion);
 
-  static llvm::raw_ostream *m_llpcOuts;           // nullptr or stream for LLPC_OUTS
-  llvm::LLVMContext &m_context;                   // LLVM context
-  llvm::TargetMachine *m_targetMachine = nullptr; // Target machine
-  TargetInfo *m_targetInfo = nullptr;             // Target info
-  unsigned m_palAbiVersion = 0xFFFFFFFF;          // PAL pipeline ABI version to compile for
-  PassManagerCache *m_passManagerCache = nullptr; // Pass manager cache and creator
+  void acquireTargetMachine();
+
+  static llvm::raw_ostream *m_llpcOuts;               // nullptr or stream for LLPC_OUTS
+  llvm::LLVMContext &m_context;                       // LLVM context
+  std::string m_gpuName;                              // LLVM GPU name
+  llvm::TargetMachine *m_targetMachine = nullptr;     // Target machine, nullptr while released
+  llvm::TargetMachine *m_lastTargetMachine = nullptr; // Target machine last acquired, kept to reacquire the same
+                                                      // one where possible
+  std::string m_targetMachineKey;                     // Key of the target machine in the shared cache
+  TargetInfo *m_targetInfo = nullptr;                 // Target info
+  unsigned m_palAbiVersion = 0xFFFFFFFF;              // PAL pipeline ABI version to compile for
+  PassManagerCache *m_passManagerCache = nullptr;     // Pass manager cache and creator
 };
 
 } // namespace lgc
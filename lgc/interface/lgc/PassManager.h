@@ -32,16 +32,49 @@
 
 #include "llvm/IR/LegacyPassManager.h"
 
+namespace llvm {
+
+class LLVMContext;
+class Module;
+
+} // namespace llvm
+
 namespace lgc {
 
+// =====================================================================================================================
+// Interface called between the passes of the compiles in an LLVMContext, so a client can pause or cancel a compile
+// running on a background thread.
+class PassCheckpoint {
+public:
+  virtual ~PassCheckpoint() {}
+
+  // Called on the compiling thread when a pass manager starts running, and between its module passes up to code
+  // generation. It may block to let more urgent work run. Returns false if the compile has been cancelled, in which
+  // case the run is stopped and the output of the compile is to be discarded.
+  virtual bool check() = 0;
+};
+
 // =====================================================================================================================
 // Public interface of LLPC middle-end's legacy::PassManager override
 class PassManager : public llvm::legacy::PassManager {
 public:
   static PassManager *Create();
+
+  // Set the checkpoint called between the passes of the compiles in an LLVMContext, or remove it with nullptr. The
+  // checkpoint applies to every pass manager run on modules of the context, including cached ones.
+  static void setCheckpoint(llvm::LLVMContext &context, PassCheckpoint *checkpoint);
+
+  // Check whether pass managers may be cached and run again on other modules. This is not the case when an option
+  // refers to passes by the index they were given when added.
+  static bool isReusable();
+
   virtual ~PassManager() {}
   virtual void stop() = 0;
   virtual void setPassIndex(unsigned *passIndex) = 0;
+
+  // Run the passes on a module. Returns false if the checkpoint of its LLVMContext reported that the compile has been
+  // cancelled, in which case the run was stopped and the module is not usable.
+  virtual bool run(llvm::Module &module) = 0;
 };
 
 } // namespace lgc
@@ -596,6 +596,11 @@ public:
   // for its link option.
   virtual void setStateFromModule(llvm::Module *module) = 0;
 
+  // Set the shader modes of one shader from metadata in its IR module. This is for a front-end that translated
+  // the shader with a Builder created without a pipeline (as for a shader compile), for example in a different
+  // LLVMContext on another thread, and then brought the module into the pipeline's LLVMContext for irLink.
+  virtual void setShaderModesFromModule(llvm::Module *module, ShaderStage stage) = 0;
+
   // -----------------------------------------------------------------------------------------------------------------
   // IR link and generate pipeline/library methods
 
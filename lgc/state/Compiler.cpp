@@ -28,22 +28,39 @@
  * @brief LLPC source file: PipelineState methods that do IR linking and compilation
  ***********************************************************************************************************************
  */
+#include "lgc/ElfLinker.h"
 #include "lgc/LgcContext.h"
 #include "lgc/PassManager.h"
 #include "lgc/patch/Patch.h"
+#include "lgc/state/PassManagerCache.h"
 #include "lgc/state/PipelineState.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/IRPrintingPasses.h"
 #include "llvm/Linker/Linker.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/Timer.h"
 #include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include <mutex>
 
 #define DEBUG_TYPE "lgc-compiler"
 
 using namespace lgc;
 using namespace llvm;
 
+// -parallel-codegen: generate the code of each hardware shader of a pipeline on its own thread
+static cl::opt<bool> ParallelCodeGen("parallel-codegen",
+                                     cl::desc("Run code generation for each hardware shader of a pipeline on its own "
+                                              "thread, then link the results into the pipeline ELF"),
+                                     cl::init(false));
+
 namespace lgc {
 // Create BuilderReplayer pass
 ModulePass *createBuilderReplayer(Pipeline *pipeline);
@@ -51,6 +68,68 @@ ElfLinker *createElfLinkerImpl(PipelineState *pipelineState, llvm::ArrayRef<llvm
 
 } // namespace lgc
 
+namespace {
+
+// =====================================================================================================================
+// LLVMContext and LgcContext that code generation of a hardware shader split out of a pipeline runs in. They are kept
+// in a pool when not in use, so that each split compile does not set up a new context and target for every part.
+struct CodeGenContext {
+  std::string gpuName;                    // LLVM GPU name
+  unsigned palAbiVersion;                 // PAL pipeline ABI version
+  LLVMContext context;                    // LLVM context
+  std::unique_ptr<LgcContext> lgcContext; // LGC context using the LLVM context
+};
+
+// Pool of the code generation contexts that no split compile is using
+struct CodeGenContextPool {
+  std::mutex lock;                                           // Lock for the free contexts
+  std::vector<std::unique_ptr<CodeGenContext>> freeContexts; // Contexts not in use
+};
+
+} // anonymous namespace
+
+static ManagedStatic<CodeGenContextPool> CodeGenContexts;
+
+// Threads that split code generation runs on, kept for the next split compile
+static ManagedStatic<ThreadPool> CodeGenThreads;
+
+// =====================================================================================================================
+// Take a code generation context for the GPU from the pool, or create one if there is none free.
+//
+// @param gpuName : LLVM GPU name
+// @param palAbiVersion : PAL pipeline ABI version
+static std::unique_ptr<CodeGenContext> takeCodeGenContext(StringRef gpuName, unsigned palAbiVersion) {
+  {
+    std::lock_guard<std::mutex> lock(CodeGenContexts->lock);
+    std::vector<std::unique_ptr<CodeGenContext>> &freeContexts = CodeGenContexts->freeContexts;
+    for (auto it = freeContexts.begin(), end = freeContexts.end(); it != end; ++it) {
+      if ((*it)->gpuName == gpuName && (*it)->palAbiVersion == palAbiVersion) {
+        std::unique_ptr<CodeGenContext> codeGenContext = std::move(*it);
+        freeContexts.erase(it);
+        return codeGenContext;
+      }
+    }
+  }
+
+  auto codeGenContext = std::make_unique<CodeGenContext>();
+  codeGenContext->gpuName = gpuName.str();
+  codeGenContext->palAbiVersion = palAbiVersion;
+  codeGenContext->lgcContext.reset(LgcContext::Create(codeGenContext->context, gpuName, palAbiVersion));
+  return codeGenContext;
+}
+
+// =====================================================================================================================
+// Return a code generation context to the pool. Its target machine goes back to the shared target machine cache while
+// it is idle.
+//
+// @param codeGenContext : Context to return
+static void returnCodeGenContext(std::unique_ptr<CodeGenContext> codeGenContext) {
+  codeGenContext->context.setDiagnosticHandlerCallBack(nullptr);
+  codeGenContext->lgcContext->releaseTargetMachine();
+  std::lock_guard<std::mutex> lock(CodeGenContexts->lock);
+  CodeGenContexts->freeContexts.push_back(std::move(codeGenContext));
+}
+
 // =====================================================================================================================
 // Mark a function as a shader entry-point. This must be done before linking shader modules into a pipeline
 // with irLink(). This is a static method in Pipeline, as it does not need a Pipeline object, and can be used
@@ -228,16 +307,210 @@ bool PipelineState::generate(std::unique_ptr<Module> pipelineModule, raw_pwrite_
   // Add pass to clear pipeline state from IR
   passMgr->add(createPipelineStateClearer());
 
-  // Code generation.
-  getLgcContext()->addTargetPasses(*passMgr, codeGenTimer, outStream);
+  // With -parallel-codegen, code generation is done separately for each hardware shader after the "whole pipeline"
+  // passes. That needs this PipelineState to still be intact for the ELF link, so it is not done without
+  // BuilderRecorder, and it is not done when dumping or emitting something other than an ELF.
+  bool splitCodeGen = ParallelCodeGen && !m_noReplayer && !m_emitLgc && !m_unlinked && LgcContext::isElfOutput() &&
+                      !LgcContext::getLgcOuts();
+
+  // Code generation is normally run after the "whole pipeline" passes, with the codegen pass manager cached in the
+  // LgcContext, so that its passes are not set up again for each pipeline. (The "whole pipeline" passes themselves
+  // are bound to this PipelineState, and the structure of them depends on the pipeline.) When it is split, it is run
+  // on each hardware shader instead. Either way, the immutable passes from addTargetPasses are still added here,
+  // after stopping adding other passes, as they can affect the middle-end optimizations. That keeps the optimized IR
+  // the same as when code generation is added to this pass manager, which is still done when it is being timed or
+  // when pass managers cannot be reused.
+  bool cachedCodeGen = !m_emitLgc && !codeGenTimer && PassManager::isReusable();
+  raw_null_ostream nullStream;
+  if (splitCodeGen || cachedCodeGen) {
+    passMgr->stop();
+    getLgcContext()->addTargetPasses(*passMgr, nullptr, nullStream);
+  } else
+    getLgcContext()->addTargetPasses(*passMgr, codeGenTimer, outStream);
 
-  // Run the "whole pipeline" passes.
-  passMgr->run(*pipelineModule);
+  // Run the "whole pipeline" passes. If the compile is cancelled, code generation is not run.
+  if (!passMgr->run(*pipelineModule)) {
+    setError("Compile cancelled");
+    return false;
+  }
 
   // See if there was a recoverable error.
   if (getLastError() != "")
     return false;
 
+  // Run code generation if it was not run above. If it is split but the pipeline module cannot be split, it is done
+  // on the module as a whole after all. If the split code generation failed, it is not tried again.
+  bool splitDone = splitCodeGen && generateSplit(*pipelineModule, outStream, codeGenTimer);
+  if (getLastError() != "")
+    return false;
+  if ((splitCodeGen || cachedCodeGen) && !splitDone) {
+    if (cachedCodeGen) {
+      PassManagerCache *passManagerCache = getLgcContext()->getPassManagerCache();
+      bool completed = passManagerCache->getCodeGenPassManager(outStream).run(*pipelineModule);
+      passManagerCache->resetStream();
+      if (!completed) {
+        setError("Compile cancelled");
+        return false;
+      }
+    } else {
+      std::unique_ptr<PassManager> codeGenPassMgr(PassManager::Create());
+      codeGenPassMgr->setPassIndex(&passIndex);
+      codeGenPassMgr->add(
+          createTargetTransformInfoWrapperPass(getLgcContext()->getTargetMachine()->getTargetIRAnalysis()));
+      getLgcContext()->preparePassManager(&*codeGenPassMgr);
+      getLgcContext()->addTargetPasses(*codeGenPassMgr, codeGenTimer, outStream);
+      if (!codeGenPassMgr->run(*pipelineModule)) {
+        setError("Compile cancelled");
+        return false;
+      }
+    }
+  }
+
+  // See if there was a recoverable error.
+  if (getLastError() != "")
+    return false;
+
+  return true;
+}
+
+// =====================================================================================================================
+// Check whether a calling convention is that of a hardware shader entry-point.
+//
+// @param callingConv : Calling convention
+static bool isHardwareShaderCallingConv(unsigned callingConv) {
+  switch (callingConv) {
+  case CallingConv::AMDGPU_LS:
+  case CallingConv::AMDGPU_HS:
+  case CallingConv::AMDGPU_ES:
+  case CallingConv::AMDGPU_GS:
+  case CallingConv::AMDGPU_VS:
+  case CallingConv::AMDGPU_PS:
+  case CallingConv::AMDGPU_CS:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// =====================================================================================================================
+// Generate the pipeline ELF from the patched pipeline module, splitting code generation per hardware shader. The
+// module is split into a module for each hardware shader entry-point, code generation is run on each of those on
+// its own thread (in its own LLVMContext, as a context and its TargetMachine cannot be used by several threads), and
+// the resulting ELFs are linked into the pipeline ELF with the ELF linker, which merges their PAL metadata. The
+// threads and the contexts are kept for later split compiles.
+//
+// @param pipelineModule : Patched pipeline module
+// @param [out] outStream : Stream to write the ELF to
+// @param codeGenTimer : Timer for code generation, or nullptr
+// @returns : False if the module is not worth splitting or cannot be split, in which case nothing has been written, or
+//            if code generation of a hardware shader or the link failed, in which case the error has been set
+bool PipelineState::generateSplit(Module &pipelineModule, raw_pwrite_stream &outStream, Timer *codeGenTimer) {
+  SmallVector<Function *, 4> entryPoints;
+  for (Function &func : pipelineModule) {
+    if (!func.isDeclaration() && isHardwareShaderCallingConv(func.getCallingConv()))
+      entryPoints.push_back(&func);
+  }
+  if (entryPoints.size() < 2)
+    return false;
+
+  // The ELF linker does not handle relocations between the ELFs, so global data (other than LDS, of which each
+  // hardware shader has its own) stops the split.
+  for (const GlobalVariable &global : pipelineModule.globals()) {
+    if (!global.isDeclaration() && global.getAddressSpace() != ADDR_SPACE_LOCAL)
+      return false;
+  }
+
+  if (codeGenTimer)
+    codeGenTimer->startTimer();
+
+  // Split the module, writing the module of each hardware shader as bitcode to be read into its own LLVMContext.
+  // The module of a hardware shader keeps the other functions, which are removed if unused before code generation.
+  std::vector<SmallVector<char, 0>> partBitcodes(entryPoints.size());
+  for (unsigned partIdx = 0; partIdx != entryPoints.size(); ++partIdx) {
+    Function *entryPoint = entryPoints[partIdx];
+    ValueToValueMapTy valueMap;
+    std::unique_ptr<Module> partModule =
+        CloneModule(pipelineModule, valueMap, [entryPoint](const GlobalValue *global) {
+          auto func = dyn_cast<Function>(global);
+          return !func || func == entryPoint || !isHardwareShaderCallingConv(func->getCallingConv());
+        });
+    for (Function &func : make_early_inc_range(*partModule)) {
+      if (func.isDeclaration() && func.use_empty() && isHardwareShaderCallingConv(func.getCallingConv()))
+        func.eraseFromParent();
+    }
+    raw_svector_ostream bitcodeStream(partBitcodes[partIdx]);
+    WriteBitcodeToFile(*partModule, bitcodeStream);
+  }
+
+  // Diagnostics from code generation are passed on to the pipeline's LLVMContext, one at a time.
+  struct DiagnosticForwarder {
+    LLVMContext *context; // Pipeline's LLVMContext
+    std::mutex lock;      // Lock to pass on one diagnostic at a time
+  } diagnosticForwarder = {&getContext()};
+
+  // Run code generation for each hardware shader on its own thread, in a code generation context from the pool. A
+  // module cannot be cloned into another LLVMContext, so the part is read from its bitcode.
+  std::string gpuName = getLgcContext()->getTargetMachine()->getTargetCPU().str();
+  unsigned palAbiVersion = getLgcContext()->getPalAbiVersion();
+  std::vector<SmallVector<char, 0>> partElfs(entryPoints.size());
+  std::vector<char> partCompleted(entryPoints.size(), false);
+  auto generatePart = [&](unsigned partIdx) {
+    std::unique_ptr<CodeGenContext> codeGenContext = takeCodeGenContext(gpuName, palAbiVersion);
+    LLVMContext &context = codeGenContext->context;
+    LgcContext *lgcContext = codeGenContext->lgcContext.get();
+    context.setDiagnosticHandlerCallBack(
+        [](const DiagnosticInfo &diagInfo, void *forwarder) {
+          auto diagnosticForwarder = static_cast<DiagnosticForwarder *>(forwarder);
+          std::lock_guard<std::mutex> lock(diagnosticForwarder->lock);
+          diagnosticForwarder->context->diagnose(diagInfo);
+        },
+        &diagnosticForwarder);
+
+    {
+      StringRef bitcode(partBitcodes[partIdx].data(), partBitcodes[partIdx].size());
+      std::unique_ptr<Module> partModule = cantFail(parseBitcodeFile(MemoryBufferRef(bitcode, ""), context));
+      raw_svector_ostream elfStream(partElfs[partIdx]);
+      if (PassManager::isReusable()) {
+        PassManagerCache *passManagerCache = lgcContext->getPassManagerCache();
+        partCompleted[partIdx] = passManagerCache->getSplitCodeGenPassManager(elfStream).run(*partModule);
+        passManagerCache->resetStream();
+      } else {
+        std::unique_ptr<PassManager> partPassMgr(PassManager::Create());
+        partPassMgr->add(createTargetTransformInfoWrapperPass(lgcContext->getTargetMachine()->getTargetIRAnalysis()));
+        lgcContext->preparePassManager(&*partPassMgr);
+        partPassMgr->add(createGlobalDCEPass());
+        lgcContext->addTargetPasses(*partPassMgr, nullptr, elfStream);
+        partCompleted[partIdx] = partPassMgr->run(*partModule);
+      }
+    }
+    returnCodeGenContext(std::move(codeGenContext));
+  };
+
+  std::vector<std::shared_future<void>> partsDone;
+  for (unsigned partIdx = 1; partIdx != entryPoints.size(); ++partIdx)
+    partsDone.push_back(CodeGenThreads->async(generatePart, partIdx));
+  generatePart(0);
+  for (std::shared_future<void> &partDone : partsDone)
+    partDone.wait();
+
+  if (codeGenTimer)
+    codeGenTimer->stopTimer();
+
+  if (is_contained(partCompleted, false)) {
+    setError("Compile cancelled");
+    return false;
+  }
+
+  // Link the ELFs of the hardware shaders into the pipeline ELF.
+  SmallVector<MemoryBufferRef, 4> elfs;
+  for (const auto &partElf : partElfs)
+    elfs.push_back(MemoryBufferRef(StringRef(partElf.data(), partElf.size()), ""));
+  std::unique_ptr<ElfLinker> elfLinker(createElfLinker(elfs));
+  if (!elfLinker->link(outStream)) {
+    if (getLastError() == "")
+      setError("Failed to link the ELFs of the hardware shaders");
+    return false;
+  }
   return true;
 }
 
@@ -44,10 +44,14 @@
 #include "llvm/InitializePasses.h"
 #include "llvm/Support/CodeGen.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
+#include <algorithm>
+#include <mutex>
+#include <vector>
 
 #define DEBUG_TYPE "lgc-context"
 
@@ -89,6 +93,29 @@ static cl::opt<bool> EmitLgc("emit-lgc", cl::desc("Emit LLVM assembly suitable f
 // -show-encoding: show the instruction encoding when emitting assembler. This mirrors llvm-mc behaviour
 static cl::opt<bool> ShowEncoding("show-encoding", cl::desc("Show instruction encodings"), cl::init(false));
 
+namespace {
+
+// =====================================================================================================================
+// Process-wide cache of the target machines that are not in use, keyed by GPU name and the options they were created
+// with. Creating an AMDGPU TargetMachine and its subtargets is costly, and they are the same for every LgcContext of a
+// GPU. But a TargetMachine cannot be used by concurrent compiles (codegen updates its options and its subtarget map),
+// so an LgcContext holds one exclusively while it compiles, and returns it here when it is idle or destroyed.
+struct TargetMachineCache {
+  ~TargetMachineCache() {
+    for (auto &entry : idleTargetMachines) {
+      for (TargetMachine *targetMachine : entry.second)
+        delete targetMachine;
+    }
+  }
+
+  std::mutex lock;                                            // Lock for the idle target machine lists
+  StringMap<std::vector<TargetMachine *>> idleTargetMachines; // Idle target machines for each key
+};
+
+} // anonymous namespace
+
+static ManagedStatic<TargetMachineCache> SharedTargetMachines;
+
 // =====================================================================================================================
 // Set default for a command-line option, but only if command-line processing has not happened yet, or did not see
 // an occurrence of this option.
@@ -187,7 +214,30 @@ LgcContext *LgcContext::Create(LLVMContext &context, StringRef gpuName, unsigned
     return nullptr;
   }
 
-  // Get the LLVM target and create the target machine. This should not fail, as we determined above
+  LLPC_OUTS("TargetMachine optimization level = " << cl::OptLevel << "\n");
+
+  builderContext->m_gpuName = gpuName.str();
+  builderContext->acquireTargetMachine();
+  return builderContext;
+}
+
+// =====================================================================================================================
+// Get the key of the target machine for a GPU in the shared target machine cache. This covers the options that
+// createTargetMachine uses, so a target machine is not reused after they have changed.
+//
+// @param gpuName : LLVM GPU name (e.g. "gfx900")
+static std::string getTargetMachineKey(StringRef gpuName) {
+  return (Twine(gpuName) + "," + Twine(static_cast<unsigned>(cl::OptLevel.getValue())) + "," +
+          Twine(static_cast<unsigned>(ShowEncoding)))
+      .str();
+}
+
+// =====================================================================================================================
+// Create a target machine.
+//
+// @param gpuName : LLVM GPU name (e.g. "gfx900")
+static TargetMachine *createTargetMachine(StringRef gpuName) {
+  // Get the LLVM target and create the target machine. This should not fail, as LgcContext::Create determined
   // that we support the requested target.
   const std::string triple = "amdgcn--amdpal";
   std::string errMsg;
@@ -203,12 +253,51 @@ LgcContext *LgcContext::Create(LLVMContext &context, StringRef gpuName, unsigned
     targetOpts.MCOptions.AsmVerbose = true;
   }
 
-  LLPC_OUTS("TargetMachine optimization level = " << cl::OptLevel << "\n");
-
-  builderContext->m_targetMachine =
+  TargetMachine *targetMachine =
       target->createTargetMachine(triple, gpuName, "", targetOpts, Optional<Reloc::Model>(), None, cl::OptLevel);
-  assert(builderContext->m_targetMachine);
-  return builderContext;
+  assert(targetMachine);
+  return targetMachine;
+}
+
+// =====================================================================================================================
+// Acquire a target machine for this LgcContext from the shared target machine cache, creating one if none is idle.
+// The one this LgcContext had before is preferred, as the pass managers it cached refer to it; they are dropped if
+// a different one is acquired.
+void LgcContext::acquireTargetMachine() {
+  assert(!m_targetMachine);
+  std::string key = getTargetMachineKey(m_gpuName);
+  TargetMachine *targetMachine = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(SharedTargetMachines->lock);
+    std::vector<TargetMachine *> &idleTargetMachines = SharedTargetMachines->idleTargetMachines[key];
+    auto it = std::find(idleTargetMachines.begin(), idleTargetMachines.end(), m_lastTargetMachine);
+    if (it == idleTargetMachines.end() && !idleTargetMachines.empty())
+      it = idleTargetMachines.end() - 1;
+    if (it != idleTargetMachines.end()) {
+      targetMachine = *it;
+      idleTargetMachines.erase(it);
+    }
+  }
+
+  if (!targetMachine)
+    targetMachine = createTargetMachine(m_gpuName);
+  if (targetMachine != m_lastTargetMachine && m_passManagerCache)
+    m_passManagerCache->clearTargetPassManagers();
+
+  m_targetMachine = targetMachine;
+  m_lastTargetMachine = targetMachine;
+  m_targetMachineKey = key;
+}
+
+// =====================================================================================================================
+// Return the target machine to the shared target machine cache while this LgcContext is idle. The next call of
+// getTargetMachine() acquires one again.
+void LgcContext::releaseTargetMachine() {
+  if (!m_targetMachine)
+    return;
+  std::lock_guard<std::mutex> lock(SharedTargetMachines->lock);
+  SharedTargetMachines->idleTargetMachines[m_targetMachineKey].push_back(m_targetMachine);
+  m_targetMachine = nullptr;
 }
 
 // =====================================================================================================================
@@ -220,9 +309,10 @@ LgcContext::LgcContext(LLVMContext &context, unsigned palAbiVersion) : m_context
 
 // =====================================================================================================================
 LgcContext::~LgcContext() {
-  delete m_targetMachine;
-  delete m_targetInfo;
+  // The cached pass managers hold passes that refer to the TargetMachine, so delete them first.
   delete m_passManagerCache;
+  releaseTargetMachine();
+  delete m_targetInfo;
 }
 
 // =====================================================================================================================
@@ -315,6 +405,24 @@ void LgcContext::addTargetPasses(lgc::PassManager &passMgr, Timer *codeGenTimer,
     passMgr.add(createStartStopTimer(codeGenTimer, false));
 }
 
+// =====================================================================================================================
+// Get whether addTargetPasses generates an ELF object, rather than assembly (-filetype=asm) or IR (-emit-llvm,
+// -emit-llvm-bc)
+bool LgcContext::isElfOutput() {
+  return !EmitLlvm && !EmitLlvmBc && codegen::getFileType() == CGFT_ObjectFile;
+}
+
+// =====================================================================================================================
+// Get the pass manager for the front-end's per-shader passes that is cached in this LgcContext. Returns nullptr if
+// pass managers cannot be reused with the current options.
+//
+// @param addPasses : Callback to add the passes when the pass manager is first created
+lgc::PassManager *LgcContext::getFrontEndPassManager(function_ref<void(lgc::PassManager &)> addPasses) {
+  if (!lgc::PassManager::isReusable())
+    return nullptr;
+  return &getPassManagerCache()->getFrontEndPassManager(addPasses);
+}
+
 // =====================================================================================================================
 // Get pass manager cache
 PassManagerCache *LgcContext::getPassManagerCache() {
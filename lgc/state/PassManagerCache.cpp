@@ -33,19 +33,29 @@
 #include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/IR/IRPrintingPasses.h"
 #include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/InstCombine/InstCombine.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Scalar/InstSimplifyPass.h"
+#include <cstring>
 
 using namespace lgc;
 using namespace llvm;
 
 namespace lgc {
 
+// Kinds of pass manager held in the pass manager cache.
+enum class PassManagerKind : unsigned {
+  GlueShader,   // Glue shader compilation
+  FrontEnd,     // Front-end per-shader passes, added by the client
+  CodeGen,      // Code generation only
+  SplitCodeGen, // Removal of unused functions then code generation, for a hardware shader split out of a pipeline
+};
+
 // =====================================================================================================================
 // Information on how to create a pass manager. This is used as the key in the pass manager cache.
 struct PassManagerInfo {
-  bool isGlue;
+  PassManagerKind kind;
 };
 
 } // namespace lgc
@@ -56,10 +66,61 @@ struct PassManagerInfo {
 // @param outStream : Stream to output ELF info
 lgc::PassManager &PassManagerCache::getGlueShaderPassManager(raw_pwrite_stream &outStream) {
   PassManagerInfo info = {};
-  info.isGlue = true;
+  info.kind = PassManagerKind::GlueShader;
+  return getPassManager(info, outStream);
+}
+
+// =====================================================================================================================
+// Get pass manager for the front-end's per-shader passes. The passes are added by the callback the first time the pass
+// manager is requested, and the pass manager is then run on the module of each shader compiled in this LgcContext, so
+// the passes must not keep any state from one run to the next. The caller must not use this when the passes it adds
+// depend on the shader or the pipeline, or when PassManager::isReusable() returns false.
+//
+// @param addPasses : Callback to add the passes to a newly created pass manager
+lgc::PassManager &PassManagerCache::getFrontEndPassManager(function_ref<void(lgc::PassManager &)> addPasses) {
+  PassManagerInfo info = {};
+  info.kind = PassManagerKind::FrontEnd;
+  std::unique_ptr<lgc::PassManager> &passManager = getCacheEntry(info);
+  if (!passManager) {
+    passManager.reset(PassManager::Create());
+    addPasses(*passManager);
+  }
+  return *passManager;
+}
+
+// =====================================================================================================================
+// Get pass manager for code generation of a module that has already been run through the patch and optimization
+// passes, which is how PipelineState::generate normally runs code generation. The caller must call resetStream() after
+// running it. This is not used when the codegen passes are to be timed, or when PassManager::isReusable() returns
+// false.
+//
+// @param outStream : Stream to output ELF
+lgc::PassManager &PassManagerCache::getCodeGenPassManager(raw_pwrite_stream &outStream) {
+  PassManagerInfo info = {};
+  info.kind = PassManagerKind::CodeGen;
   return getPassManager(info, outStream);
 }
 
+// =====================================================================================================================
+// Get pass manager for code generation of the module of a hardware shader split out of a patched pipeline module,
+// which first removes the functions that the hardware shader does not use. The caller must call resetStream() after
+// running it. This is not used when PassManager::isReusable() returns false.
+//
+// @param outStream : Stream to output ELF
+lgc::PassManager &PassManagerCache::getSplitCodeGenPassManager(raw_pwrite_stream &outStream) {
+  PassManagerInfo info = {};
+  info.kind = PassManagerKind::SplitCodeGen;
+  return getPassManager(info, outStream);
+}
+
+// =====================================================================================================================
+// Get the cache entry for a PassManagerInfo. The entry holds nullptr if the pass manager has not been created yet.
+//
+// @param info : PassManagerInfo to look up
+std::unique_ptr<lgc::PassManager> &PassManagerCache::getCacheEntry(const PassManagerInfo &info) {
+  return m_cache[StringRef(reinterpret_cast<const char *>(&info), sizeof(info))];
+}
+
 // =====================================================================================================================
 // Get pass manager given a PassManagerInfo
 //
@@ -70,14 +131,12 @@ lgc::PassManager &PassManagerCache::getPassManager(const PassManagerInfo &info,
   m_proxyStream.setUnderlyingStream(&outStream);
 
   // Check the cache.
-  std::unique_ptr<lgc::PassManager> &passManager =
-      m_cache[StringRef(reinterpret_cast<const char *>(&info), sizeof(info))];
+  std::unique_ptr<lgc::PassManager> &passManager = getCacheEntry(info);
   if (passManager)
     return *passManager;
 
   // Need to create the pass manager.
-  // TODO: Creation of a normal compilation pass manager, not just one for a glue shader.
-  assert(info.isGlue && "Non-glue shader compilation not implemented yet");
+  assert(info.kind != PassManagerKind::FrontEnd && "Front-end pass manager is created by getFrontEndPassManager");
 
   passManager.reset(PassManager::Create());
   passManager->add(createTargetTransformInfoWrapperPass(m_lgcContext->getTargetMachine()->getTargetIRAnalysis()));
@@ -85,18 +144,24 @@ lgc::PassManager &PassManagerCache::getPassManager(const PassManagerInfo &info,
   // Manually add a target-aware TLI pass, so optimizations do not think that we have library functions.
   m_lgcContext->preparePassManager(&*passManager);
 
-  // Add a few optimizations.
-  passManager->add(createInstructionCombiningPass(5));
-  passManager->add(createInstSimplifyLegacyPass());
-  passManager->add(createEarlyCSEPass(true));
+  if (info.kind == PassManagerKind::GlueShader) {
+    // Add a few optimizations.
+    passManager->add(createInstructionCombiningPass(5));
+    passManager->add(createInstSimplifyLegacyPass());
+    passManager->add(createEarlyCSEPass(true));
 
-  // Dump the result
-  if (raw_ostream *outs = LgcContext::getLgcOuts()) {
-    passManager->add(
-        createPrintModulePass(*outs, "===============================================================================\n"
-                                     "// LGC glue shader results\n"));
+    // Dump the result
+    if (raw_ostream *outs = LgcContext::getLgcOuts()) {
+      passManager->add(createPrintModulePass(
+          *outs, "===============================================================================\n"
+                 "// LGC glue shader results\n"));
+    }
   }
 
+  // Remove the functions that a hardware shader split out of a pipeline does not use.
+  if (info.kind == PassManagerKind::SplitCodeGen)
+    passManager->add(createGlobalDCEPass());
+
   // Code generation.
   m_lgcContext->addTargetPasses(*passManager, nullptr, m_proxyStream);
 
@@ -109,3 +174,16 @@ lgc::PassManager &PassManagerCache::getPassManager(const PassManagerInfo &info,
 void PassManagerCache::resetStream() {
   m_proxyStream.setUnderlyingStream(nullptr);
 }
+
+// =====================================================================================================================
+// Deletes the cached pass managers that refer to the target machine of the LgcContext, which is being replaced by a
+// different one. The front-end pass manager does not use the target machine, so it is kept.
+void PassManagerCache::clearTargetPassManagers() {
+  for (auto it = m_cache.begin(), end = m_cache.end(); it != end;) {
+    auto current = it++;
+    PassManagerInfo info = {};
+    memcpy(&info, current->first().data(), sizeof(info));
+    if (info.kind != PassManagerKind::FrontEnd)
+      m_cache.erase(current);
+  }
+}
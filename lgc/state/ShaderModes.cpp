@@ -215,6 +215,53 @@ void ShaderModes::readModesFromShader(Module *module, ShaderStage stage) {
   }
 }
 
+// =====================================================================================================================
+// Set shader modes (common and specific) of one shader stage from a shader IR module that had its ShaderModes
+// recorded into IR by a shader compile. The modes are passed through the Set*Mode methods, so the tessellation mode
+// is merged with that of the other tessellation shader.
+//
+// @param module : LLVM module
+// @param stage : Shader stage
+void ShaderModes::setModesFromShader(Module *module, ShaderStage stage) {
+  // First the common state.
+  std::string metadataName =
+      std::string(CommonShaderModeMetadataPrefix) + getShaderStageAbbreviation(static_cast<ShaderStage>(stage));
+  CommonShaderMode commonShaderMode = {};
+  PipelineState::readNamedMetadataArrayOfInt32(module, metadataName, commonShaderMode);
+  setCommonShaderMode(stage, commonShaderMode);
+
+  // Then the specific shader modes.
+  switch (stage) {
+  case ShaderStageTessControl:
+  case ShaderStageTessEval: {
+    TessellationMode tessellationMode = {};
+    if (PipelineState::readNamedMetadataArrayOfInt32(module, TessellationModeMetadataName, tessellationMode))
+      setTessellationMode(tessellationMode);
+    break;
+  }
+  case ShaderStageGeometry: {
+    GeometryShaderMode geometryShaderMode = {};
+    if (PipelineState::readNamedMetadataArrayOfInt32(module, GeometryShaderModeMetadataName, geometryShaderMode))
+      setGeometryShaderMode(geometryShaderMode);
+    break;
+  }
+  case ShaderStageFragment: {
+    FragmentShaderMode fragmentShaderMode = {};
+    if (PipelineState::readNamedMetadataArrayOfInt32(module, FragmentShaderModeMetadataName, fragmentShaderMode))
+      setFragmentShaderMode(fragmentShaderMode);
+    break;
+  }
+  case ShaderStageCompute: {
+    ComputeShaderMode computeShaderMode = {};
+    if (PipelineState::readNamedMetadataArrayOfInt32(module, ComputeShaderModeMetadataName, computeShaderMode))
+      setComputeShaderMode(computeShaderMode);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
 // =====================================================================================================================
 // Read shader modes (common and specific) from the pipeline IR module.
 //
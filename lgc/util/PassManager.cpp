@@ -30,9 +30,17 @@
  */
 #include "lgc/PassManager.h"
 #include "lgc/util/Debug.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/Analysis/CFGPrinter.h"
+#include "llvm/CodeGen/TargetPassConfig.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+#include <memory>
+#include <mutex>
 
 namespace llvm {
 namespace cl {
@@ -71,17 +79,54 @@ public:
   void setPassIndex(unsigned *passIndex) override { m_passIndex = passIndex; }
   void add(Pass *pass) override;
   void stop() override;
+  bool run(Module &module) override;
+
+  bool runCheckpoint(Module &module);
+
+private:
+  bool m_stopped = false;                 // Whether we have already stopped adding new passes.
+  bool m_codeGenAdded = false;            // Whether the code generation passes have started to be added
+  AnalysisID m_dumpCfgAfter = nullptr;    // -dump-cfg-after pass id
+  AnalysisID m_printModule = nullptr;     // Pass id of dump pass "Print Module IR"
+  AnalysisID m_jumpThreading = nullptr;   // Pass id of opt pass "Jump Threading"
+  unsigned *m_passIndex = nullptr;        // Pass Index
+  PassCheckpoint *m_checkpoint = nullptr; // Checkpoint of the LLVMContext of the module being run on, if any
+  bool m_cancelled = false;               // Whether the checkpoint reported that the compile has been cancelled
+};
+
+// =====================================================================================================================
+// Pass added before each module pass (other than the code generation ones) to call the checkpoint of the run. It is not
+// registered, so options such as -print-after-all do not apply to it. It preserves all analyses: it changes nothing
+// unless the compile is cancelled, and then it keeps all the functions, so the module analyses still refer to valid
+// functions for the passes that only have to get through the rest of the run.
+class CheckpointPass final : public ModulePass {
+public:
+  CheckpointPass(PassManagerImpl *passManager) : ModulePass(ID), m_passManager(passManager) {}
+
+  void getAnalysisUsage(AnalysisUsage &analysisUsage) const override { analysisUsage.setPreservesAll(); }
+
+  bool runOnModule(Module &module) override { return m_passManager->runCheckpoint(module); }
+
+  StringRef getPassName() const override { return "LLPC pass checkpoint"; }
+
+  static char ID; // ID of this pass
 
 private:
-  bool m_stopped = false;               // Whether we have already stopped adding new passes.
-  AnalysisID m_dumpCfgAfter = nullptr;  // -dump-cfg-after pass id
-  AnalysisID m_printModule = nullptr;   // Pass id of dump pass "Print Module IR"
-  AnalysisID m_jumpThreading = nullptr; // Pass id of opt pass "Jump Threading"
-  unsigned *m_passIndex = nullptr;      // Pass Index
+  PassManagerImpl *m_passManager; // Pass manager whose run this is a checkpoint of
+};
+
+char CheckpointPass::ID = 0;
+
+// Checkpoints set in LLVMContexts
+struct ContextCheckpoints {
+  std::mutex lock;                                       // Lock for the map
+  DenseMap<LLVMContext *, PassCheckpoint *> checkpoints; // Checkpoint set in each LLVMContext
 };
 
 } // namespace
 
+static ManagedStatic<ContextCheckpoints> InstalledCheckpoints;
+
 // =====================================================================================================================
 // Get the PassInfo for a registered pass given short name
 //
@@ -113,6 +158,28 @@ lgc::PassManager *lgc::PassManager::Create() {
   return new PassManagerImpl;
 }
 
+// =====================================================================================================================
+// Set the checkpoint called between the passes of the compiles in an LLVMContext, or remove it with nullptr. It is
+// looked up when a pass manager starts running on a module of the context, so it applies to all pass managers, cached
+// ones included.
+//
+// @param [in/out] context : LLVM context to set the checkpoint in
+// @param checkpoint : Checkpoint, or nullptr to remove the current one
+void lgc::PassManager::setCheckpoint(LLVMContext &context, PassCheckpoint *checkpoint) {
+  std::lock_guard<std::mutex> lock(InstalledCheckpoints->lock);
+  if (checkpoint)
+    InstalledCheckpoints->checkpoints[&context] = checkpoint;
+  else
+    InstalledCheckpoints->checkpoints.erase(&context);
+}
+
+// =====================================================================================================================
+// Check whether pass managers may be cached and run again on other modules. Pass indices are assigned as passes are
+// added, so a cached pass manager would not dump or disable passes by index again.
+bool lgc::PassManager::isReusable() {
+  return cl::DisablePassIndices.empty() && !cl::DumpPassName;
+}
+
 // =====================================================================================================================
 PassManagerImpl::PassManagerImpl() : PassManager() {
   if (!cl::DumpCfgAfter.empty())
@@ -133,6 +200,10 @@ void PassManagerImpl::add(Pass *pass) {
 
   AnalysisID passId = pass->getPassID();
 
+  // The first pass that TargetMachine::addPassesToEmitFile adds is TargetPassConfig.
+  if (passId == &TargetPassConfig::ID)
+    m_codeGenAdded = true;
+
   // Skip the jump threading pass as it interacts really badly with the structurizer.
   if (passId == m_jumpThreading)
     return;
@@ -151,6 +222,12 @@ void PassManagerImpl::add(Pass *pass) {
       LLPC_OUTS("Pass[" << passIndex << "] = " << pass->getPassName() << "\n");
   }
 
+  // Add a checkpoint before each module pass, except in code generation, where the IR must not change under the machine
+  // functions. Adding a module pass there does not change how the other passes are grouped, as the module pass ends the
+  // group of function passes before it anyway.
+  if (pass->getPassKind() == PT_Module && !pass->getAsImmutablePass() && !m_codeGenAdded)
+    legacy::PassManager::add(new CheckpointPass(this));
+
   // Add the pass to the superclass pass manager.
   legacy::PassManager::add(pass);
 
@@ -170,3 +247,50 @@ void PassManagerImpl::add(Pass *pass) {
 void PassManagerImpl::stop() {
   m_stopped = true;
 }
+
+// =====================================================================================================================
+// Run the passes on a module. If a checkpoint is set in the LLVMContext of the module, it is called before the first
+// pass and between the module passes that are not code generation ones. Once it reports that the compile has been
+// cancelled, the run is stopped.
+//
+// @param [in/out] module : Module to run the passes on
+// @returns : False if the compile has been cancelled, in which case the module is not usable
+bool PassManagerImpl::run(Module &module) {
+  {
+    std::lock_guard<std::mutex> lock(InstalledCheckpoints->lock);
+    auto it = InstalledCheckpoints->checkpoints.find(&module.getContext());
+    m_checkpoint = it != InstalledCheckpoints->checkpoints.end() ? it->second : nullptr;
+  }
+  m_cancelled = m_checkpoint && !m_checkpoint->check();
+  if (!m_cancelled)
+    legacy::PassManager::run(module);
+  m_checkpoint = nullptr;
+  return !m_cancelled;
+}
+
+// =====================================================================================================================
+// Call the checkpoint of the current run between two passes. The legacy pass manager cannot be stopped in the middle of
+// a run, so once the checkpoint reports that the compile has been cancelled, the body of each function is replaced
+// with a return, which leaves nothing for the rest of the passes to do. Function attributes and metadata are kept, so
+// the rest of the passes still see the shaders they expect.
+//
+// @param [in/out] module : Module being run on
+// @returns : True if the module was modified
+bool PassManagerImpl::runCheckpoint(Module &module) {
+  if (!m_checkpoint || m_cancelled || m_checkpoint->check())
+    return false;
+  m_cancelled = true;
+
+  for (Function &func : module) {
+    if (func.isDeclaration())
+      continue;
+    for (BasicBlock &block : func)
+      block.dropAllReferences();
+    while (!func.empty())
+      func.begin()->eraseFromParent();
+    BasicBlock *block = BasicBlock::Create(module.getContext(), "", &func);
+    Type *returnTy = func.getReturnType();
+    ReturnInst::Create(module.getContext(), returnTy->isVoidTy() ? nullptr : UndefValue::get(returnTy), block);
+  }
+  return true;
+}
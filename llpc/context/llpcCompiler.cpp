@@ -31,12 +31,15 @@
 #include "llpcCompiler.h"
 #include "LLVMSPIRVLib.h"
 #include "SPIRVInternal.h"
+#include "llpcCompression.h"
 #include "llpcComputeContext.h"
 #include "llpcContext.h"
+#include "llpcContextPool.h"
 #include "llpcDebug.h"
 #include "llpcElfWriter.h"
 #include "llpcFile.h"
 #include "llpcGraphicsContext.h"
+#include "llpcPipelineBuildTask.h"
 #include "llpcShaderModuleHelper.h"
 #include "llpcSpirvLower.h"
 #include "llpcSpirvLowerResourceCollect.h"
@@ -51,6 +54,7 @@
 #include "lgc/PassManager.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/BinaryFormat/MsgPackDocument.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/Bitcode/BitcodeWriterPass.h"
 #include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/DiagnosticPrinter.h"
@@ -60,11 +64,14 @@
 #include "llvm/Support/Format.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/Mutex.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/IPO/AlwaysInliner.h"
 #include <mutex>
 #include <set>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 
 #ifdef LLPC_ENABLE_SPIRV_OPT
@@ -149,12 +156,49 @@ opt<bool> EnableShaderModuleOpt("enable-shader-module-opt",
 // -trim-debug-info: Trim debug information in SPIR-V binary
 opt<bool> TrimDebugInfo("trim-debug-info", cl::desc("Trim debug information in SPIR-V binary"), init(true));
 
+// -keep-unused-functions: Translate the SPIR-V functions that the entry-point does not use
+opt<bool> KeepUnusedFunctions("keep-unused-functions",
+                              cl::desc("Translate and keep the SPIR-V functions that are not reachable from the "
+                                       "entry-point of the shader"),
+                              init(false));
+
 // -enable-per-stage-cache: Enable shader cache per shader stage
 opt<bool> EnablePerStageCache("enable-per-stage-cache", cl::desc("Enable shader cache per shader stage"), init(true));
 
 // -context-reuse-limit: The maximum number of times a compiler context can be reused.
 opt<int> ContextReuseLimit("context-reuse-limit",
-                           cl::desc("The maximum number of times a compiler context can be reused"), init(100));
+                           cl::desc("The maximum number of times a compiler context can be reused (0 for no limit)"),
+                           init(100));
+
+// -context-memory-limit: Recycle a compiler context once it retains more than this size of memory.
+opt<unsigned> ContextMemoryLimit("context-memory-limit",
+                                 cl::desc("Recycle a compiler context once it retains more than this size of memory "
+                                          "between pipeline compilations, in MB (0 for no limit)"),
+                                 init(256));
+
+// -context-pool-memory-budget: Recycle free compiler contexts while the contexts of the pool retain more memory.
+opt<unsigned> ContextPoolMemoryBudget("context-pool-memory-budget",
+                                      cl::desc("Recycle free compiler contexts while the contexts of the pool retain "
+                                               "more than this size of memory in total, in MB (0 for no budget)"),
+                                      init(0));
+
+// -enable-parallel-front-end: Run SPIR-V translation and lowering of the shaders of a pipeline concurrently
+opt<bool> EnableParallelFrontEnd("enable-parallel-front-end",
+                                 cl::desc("Run SPIR-V translation and lowering of each shader of a pipeline on its "
+                                          "own thread"),
+                                 init(false));
+
+// -enable-parallel-relocatable-shader-elf: Build the relocatable shader ELFs of a pipeline concurrently
+opt<bool> EnableParallelRelocatableElf("enable-parallel-relocatable-shader-elf",
+                                       cl::desc("Build the relocatable shader ELF of each stage of a pipeline that "
+                                                "misses the caches on its own thread"),
+                                       init(false));
+
+// -async-build-threads: Count of threads building the pipelines started by BuildPipelineAsync
+opt<unsigned> AsyncBuildThreads("async-build-threads",
+                                cl::desc("Count of threads building the pipelines started by BuildPipelineAsync, 0 for "
+                                         "the count of hardware threads"),
+                                init(0));
 
 // -fatal-llvm-errors: Make all LLVM errors fatal
 opt<bool> FatalLlvmErrors("fatal-llvm-errors", cl::desc("Make all LLVM errors fatal"), init(false));
@@ -162,8 +206,12 @@ opt<bool> FatalLlvmErrors("fatal-llvm-errors", cl::desc("Make all LLVM errors fa
 // -add-hash-to-elf
 opt<bool> AddHashToELF("add-hash-to-elf", cl::desc("Add notes to ELF for hash and llpc version"), cl::init(false));
 
+extern opt<bool> ShaderCacheCompression;
+
 extern opt<bool> EnableOuts;
 
+extern opt<bool> EnableTimerProfile;
+
 extern opt<bool> EnableErrs;
 
 extern opt<std::string> LogFileDbgs;
@@ -182,7 +230,7 @@ static cl::opt<bool> UseBuilderRecorder("use-builder-recorder",
 namespace Llpc {
 
 sys::Mutex Compiler::m_contextPoolMutex;
-std::vector<Context *> *Compiler::m_contextPool = nullptr;
+ContextPool *Compiler::m_contextPool = nullptr;
 
 // Enumerates modes used in shader replacement
 enum ShaderReplaceMode {
@@ -359,7 +407,8 @@ bool VKAPI_CALL ICompiler::IsVertexFormatSupported(VkFormat format) {
 // @param cache : Pointer to ICache implemented in client
 Compiler::Compiler(GfxIpVersion gfxIp, unsigned optionCount, const char *const *options, MetroHash::Hash optionHash,
                    ICache *cache)
-    : m_optionHash(optionHash), m_gfxIp(gfxIp), m_cache(cache), m_relocatablePipelineCompilations(0)
+    : m_optionHash(optionHash), m_gfxIp(gfxIp), m_cache(cache), m_relocatablePipelineCompilations(0),
+      m_buildScheduler(nullptr), m_batchBuildThreads(nullptr)
 {
   for (unsigned i = 0; i < optionCount; ++i)
     m_options.push_back(options[i]);
@@ -375,7 +424,7 @@ Compiler::Compiler(GfxIpVersion gfxIp, unsigned optionCount, const char *const *
     {
       std::lock_guard<sys::Mutex> lock(m_contextPoolMutex);
 
-      m_contextPool = new std::vector<Context *>();
+      m_contextPool = new ContextPool();
     }
   }
 
@@ -413,29 +462,27 @@ Compiler::Compiler(GfxIpVersion gfxIp, unsigned optionCount, const char *const *
 // =====================================================================================================================
 Compiler::~Compiler() {
   bool shutdown = false;
+
+  // Stop the threads of asynchronous builds. The client must have destroyed all the build tasks already.
+  delete m_buildScheduler;
+  delete m_batchBuildThreads;
+
   {
     // Free context pool
     std::lock_guard<sys::Mutex> lock(m_contextPoolMutex);
 
     // Keep the max allowed count of contexts that reside in the pool so that we can speed up the creatoin of
     // compiler next time.
-    for (auto it = m_contextPool->begin(); it != m_contextPool->end();) {
-      auto context = *it;
-      size_t maxResidentContexts = 0;
+    size_t maxResidentContexts = 0;
 
-      // This is just a W/A for Teamcity. Setting AMD_RESIDENT_CONTEXTS could reduce more than 40 minutes of
-      // CTS running time.
-      char *maxResidentContextsEnv = getenv("AMD_RESIDENT_CONTEXTS");
+    // This is just a W/A for Teamcity. Setting AMD_RESIDENT_CONTEXTS could reduce more than 40 minutes of
+    // CTS running time.
+    char *maxResidentContextsEnv = getenv("AMD_RESIDENT_CONTEXTS");
 
-      if (maxResidentContextsEnv)
-        maxResidentContexts = strtoul(maxResidentContextsEnv, nullptr, 0);
+    if (maxResidentContextsEnv)
+      maxResidentContexts = strtoul(maxResidentContextsEnv, nullptr, 0);
 
-      if (!context->isInUse() && m_contextPool->size() > maxResidentContexts) {
-        it = m_contextPool->erase(it);
-        delete context;
-      } else
-        ++it;
-    }
+    m_contextPool->trim(maxResidentContexts);
   }
 
   // Restore default output
@@ -470,6 +517,26 @@ void Compiler::Destroy() {
   delete this;
 }
 
+// =====================================================================================================================
+// Gets the key of a value in a Vkgc::ICache. When compression is enabled, the values are stored under a key that also
+// depends on the version of the compressed blob layout, so that readers which do not know that layout never find them.
+//
+// @param hash : Hash code of the value
+static HashId getCacheValueKey(const HashId &hash) {
+  if (!cl::ShaderCacheCompression)
+    return hash;
+
+  MetroHash64 hasher;
+  hasher.Update(hash);
+  hasher.Update(CacheBlobVersion);
+  MetroHash::Hash keyHash = {};
+  hasher.Finalize(keyHash.bytes);
+  HashId key = {};
+  static_assert(sizeof(HashId) == sizeof(keyHash), "Hash size is different!");
+  memcpy(key.bytes, keyHash.bytes, sizeof(keyHash));
+  return key;
+}
+
 // =====================================================================================================================
 // Builds shader module from the specified info.
 //
@@ -480,6 +547,7 @@ Result Compiler::BuildShaderModule(const ShaderModuleBuildInfo *shaderInfo, Shad
   void *allocBuf = nullptr;
   const void *cacheData = nullptr;
   uint8_t *allocData = nullptr;
+  std::vector<uint8_t> cacheBlobData;
   size_t allocSize = 0;
   ShaderModuleDataEx moduleDataEx = {};
   // For trimming debug info
@@ -499,40 +567,39 @@ Result Compiler::BuildShaderModule(const ShaderModuleBuildInfo *shaderInfo, Shad
   EntryHandle cacheEntry;
   bool allocateOnMiss = true;
 
-  // Calculate the hash code of input data
-  MetroHash::Hash hash = {};
-  MetroHash64::Hash(reinterpret_cast<const uint8_t *>(shaderInfo->shaderBin.pCode), shaderInfo->shaderBin.codeSize,
-                    hash.bytes);
-
-  memcpy(moduleDataEx.common.hash, &hash, sizeof(hash));
-
-  TimerProfiler timerProfiler(MetroHash::compact64(&hash), "LLPC ShaderModule",
-                              TimerProfiler::ShaderModuleTimerEnableMask);
-
   bool trimDebugInfo = cl::TrimDebugInfo
       ;
 
-  // Check the type of input shader binary
+  // Calculate the hash code of input data. For SPIR-V, it is calculated along with the cache hash in the same scan
+  // that verifies the binary, collects its info and trims its debug info.
+  MetroHash::Hash hash = {};
+  MetroHash::Hash cacheHash = {};
   if (Vkgc::isSpirvBinary(&shaderInfo->shaderBin)) {
-    unsigned debugInfoSize = 0;
-
     moduleDataEx.common.binType = BinaryType::Spirv;
-    if (ShaderModuleHelper::verifySpirvBinary(&shaderInfo->shaderBin) != Result::Success) {
+    if (trimDebugInfo)
+      trimmedCode = new uint8_t[shaderInfo->shaderBin.codeSize];
+    if (ShaderModuleHelper::scanSpirvBinary(&shaderInfo->shaderBin, &moduleDataEx.common.usage, entryNames,
+                                            trimmedCode, &moduleDataEx.common.binCode.codeSize, &hash,
+                                            &cacheHash) != Result::Success) {
       LLPC_ERRS("Unsupported SPIR-V instructions are found!\n");
       result = Result::Unsupported;
     }
-    if (result == Result::Success) {
-      ShaderModuleHelper::collectInfoFromSpirvBinary(&shaderInfo->shaderBin, &moduleDataEx.common.usage, entryNames,
-                                                     &debugInfoSize);
-    }
-    moduleDataEx.common.binCode.codeSize = shaderInfo->shaderBin.codeSize;
-    if (trimDebugInfo)
-      moduleDataEx.common.binCode.codeSize -= debugInfoSize;
-  } else if (ShaderModuleHelper::isLlvmBitcode(&shaderInfo->shaderBin)) {
-    moduleDataEx.common.binType = BinaryType::LlvmBc;
-    moduleDataEx.common.binCode = shaderInfo->shaderBin;
-  } else
-    result = Result::ErrorInvalidShader;
+    moduleDataEx.common.binCode.pCode = trimmedCode ? trimmedCode : shaderInfo->shaderBin.pCode;
+    moduleDataEx.common.usage.keepUnusedFunctions = cl::KeepUnusedFunctions;
+  } else {
+    MetroHash64::Hash(reinterpret_cast<const uint8_t *>(shaderInfo->shaderBin.pCode), shaderInfo->shaderBin.codeSize,
+                      hash.bytes);
+    if (ShaderModuleHelper::isLlvmBitcode(&shaderInfo->shaderBin)) {
+      moduleDataEx.common.binType = BinaryType::LlvmBc;
+      moduleDataEx.common.binCode = shaderInfo->shaderBin;
+    } else
+      result = Result::ErrorInvalidShader;
+  }
+
+  memcpy(moduleDataEx.common.hash, &hash, sizeof(hash));
+
+  TimerProfiler timerProfiler(MetroHash::compact64(&hash), "LLPC ShaderModule",
+                              TimerProfiler::ShaderModuleTimerEnableMask);
 
   if (moduleDataEx.common.binType == BinaryType::Spirv) {
     // Dump SPIRV binary
@@ -540,23 +607,13 @@ Result Compiler::BuildShaderModule(const ShaderModuleBuildInfo *shaderInfo, Shad
       PipelineDumper::DumpSpirvBinary(cl::PipelineDumpDir.c_str(), &shaderInfo->shaderBin, &hash);
     }
 
-    // Trim debug info
-    if (trimDebugInfo) {
-      trimmedCode = new uint8_t[moduleDataEx.common.binCode.codeSize];
-      ShaderModuleHelper::trimSpirvDebugInfo(&shaderInfo->shaderBin, moduleDataEx.common.binCode.codeSize, trimmedCode);
-      moduleDataEx.common.binCode.pCode = trimmedCode;
-    } else
-      moduleDataEx.common.binCode.pCode = shaderInfo->shaderBin.pCode;
-
-    // Calculate SPIR-V cache hash
-    MetroHash::Hash cacheHash = {};
-    MetroHash64::Hash(reinterpret_cast<const uint8_t *>(moduleDataEx.common.binCode.pCode),
-                      moduleDataEx.common.binCode.codeSize, cacheHash.bytes);
+    // Set SPIR-V cache hash
     static_assert(sizeof(moduleDataEx.common.cacheHash) == sizeof(cacheHash), "Unexpected value!");
     memcpy(moduleDataEx.common.cacheHash, cacheHash.dwords, sizeof(cacheHash));
     HashId cacheHashId = {};
     static_assert(sizeof(HashId) == sizeof(cacheHash), "Hash size is different!");
     memcpy(cacheHashId.dwords, cacheHash.dwords, sizeof(cacheHash));
+    cacheHashId = getCacheValueKey(cacheHashId);
 
     // Do SPIR-V translate & lower if possible
     bool enableOpt = cl::EnableShaderModuleOpt;
@@ -581,6 +638,16 @@ Result Compiler::BuildShaderModule(const ShaderModuleBuildInfo *shaderInfo, Shad
             }
           }
         }
+        // The shader module data may be stored compressed. A blob with another layout is not used, and the shader
+        // module is built again then.
+        if (cacheResult == Result::Success) {
+          Result blobResult = decompressCacheBlob(cacheData, allocSize, &cacheBlobData);
+          if (blobResult == Result::Success) {
+            cacheData = cacheBlobData.data();
+            allocSize = cacheBlobData.size();
+          } else if (blobResult != Result::NotFound)
+            cacheResult = blobResult;
+        }
       } else {
         cacheEntryState = m_shaderCache->findShader(cacheHash, allocateOnMiss, &hEntry);
         if (cacheEntryState == ShaderEntryState::Ready)
@@ -784,8 +851,12 @@ Result Compiler::BuildShaderModule(const ShaderModuleBuildInfo *shaderInfo, Shad
       moduleDataExCopy->extra.fsOutInfoCount = fsOutInfos.size();
       if (fsOutInfos.size() > 0)
         memcpy(fsOutInfo, &fsOutInfos[0], fsOutInfos.size() * sizeof(FsOutInfo));
-      if (m_cache && allocateOnMiss && cacheResult == Result::NotFound)
-        cacheEntry.SetValue(true, moduleDataExCopy, allocSize);
+      if (m_cache && allocateOnMiss && cacheResult == Result::NotFound) {
+        if (cl::ShaderCacheCompression && compressCacheBlob(moduleDataExCopy, allocSize, &cacheBlobData))
+          cacheEntry.SetValue(true, cacheBlobData.data(), cacheBlobData.size());
+        else
+          cacheEntry.SetValue(true, moduleDataExCopy, allocSize);
+      }
       if (cacheEntryState == ShaderEntryState::Compiling) {
         if (hEntry)
           m_shaderCache->insertShader(hEntry, moduleDataExCopy, allocSize);
@@ -802,10 +873,13 @@ Result Compiler::BuildShaderModule(const ShaderModuleBuildInfo *shaderInfo, Shad
     moduleDataExCopy->extra.pFsOutInfos = fsOutInfo;
     shaderOut->pModuleData = &moduleDataExCopy->common;
   } else {
-    if (hEntry)
+    if (hEntry && cacheEntryState == ShaderEntryState::Compiling)
       m_shaderCache->resetShader(hEntry);
   }
+  if (hEntry && cacheEntryState == ShaderEntryState::Ready)
+    m_shaderCache->releaseShader(hEntry);
   delete[] allocData;
+  delete[] trimmedCode;
 
   return result;
 }
@@ -851,14 +925,20 @@ Result Compiler::buildPipelineWithRelocatableElf(Context *context, ArrayRef<cons
                              << "\n");
   LLPC_OUTS("Hash for pipeline cache lookup: " << formatBytesLittleEndian<uint8_t>(originalCacheHash.bytes) << "\n");
 
-  for (unsigned stage = 0; stage < shaderInfo.size() && result == Result::Success; ++stage) {
+  // Look up the caches for the relocatable shader of each stage first, so the stages that miss can then be built
+  // together. The cache entries of the missing stages stay claimed until they are built; they are claimed in stage
+  // order by every compile, so waiting for an entry claimed by another compile cannot deadlock.
+  MetroHash::Hash cacheHashes[ShaderStageNativeStageCount] = {};
+  ShaderCache *shaderCaches[ShaderStageNativeStageCount] = {};
+  CacheEntryHandle hEntries[ShaderStageNativeStageCount] = {};
+  EntryHandle cacheEntries[ShaderStageNativeStageCount];
+  unsigned buildStageMask = 0;
+  for (unsigned stage = 0; stage < shaderInfo.size(); ++stage) {
     if (!shaderInfo[stage] || !shaderInfo[stage]->pModuleData)
       continue;
 
-    context->getPipelineContext()->setShaderStageMask(shaderStageToMask(static_cast<ShaderStage>(stage)));
-
     // Check the cache for the relocatable shader for this stage.
-    MetroHash::Hash cacheHash = {};
+    MetroHash::Hash &cacheHash = cacheHashes[stage];
     IShaderCache *userShaderCache = nullptr;
     ICache *userCache = nullptr;
     if (context->isGraphics()) {
@@ -877,7 +957,7 @@ Result Compiler::buildPipelineWithRelocatableElf(Context *context, ArrayRef<cons
       userCache = pipelineInfo->cache;
     }
     // Note that this code updates m_pipelineHash of the pipeline context. It
-    // must be restored before we link the pipeline ELF at the end of this for-loop.
+    // must be restored before we link the pipeline ELF at the end of this function.
     context->getPipelineContext()->setHashForCacheLookUp(cacheHash);
     LLPC_OUTS("Finalized Hash for " << getShaderStageName(static_cast<ShaderStage>(stage)) << " stage cache lookup: "
                                     << formatBytesLittleEndian<uint8_t>(
@@ -887,27 +967,26 @@ Result Compiler::buildPipelineWithRelocatableElf(Context *context, ArrayRef<cons
     ShaderEntryState cacheEntryState = ShaderEntryState::New;
     BinaryData elfBin = {};
 
-    EntryHandle cacheEntry;
     HashId hashId = {};
     memcpy(&hashId.bytes, &cacheHash.bytes, sizeof(cacheHash));
-    Result cacheResult = lookUpCaches(userCache, &hashId, &elfBin, &cacheEntry);
+    std::vector<uint8_t> elfData;
+    Result cacheResult = lookUpCaches(userCache, &hashId, &elfBin, &cacheEntries[stage], &elfData);
     if (cacheResult == Result::Success) {
       auto data = reinterpret_cast<const char *>(elfBin.pCode);
       elf[stage].assign(data, data + elfBin.codeSize);
       // Release Entry
-      ReleaseCacheEntry(false, nullptr, &cacheEntry);
+      ReleaseCacheEntry(false, nullptr, &cacheEntries[stage]);
       LLPC_OUTS("Cache hit for shader stage " << getShaderStageName(static_cast<ShaderStage>(stage)) << "\n");
       stageCacheAccesses[stage] = CacheAccessInfo::CacheHit;
       continue;
     }
 
-    ShaderCache *shaderCache;
-    CacheEntryHandle hEntry;
-    cacheEntryState = lookUpShaderCaches(userShaderCache, &cacheHash, &elfBin, &shaderCache, &hEntry);
+    cacheEntryState = lookUpShaderCaches(userShaderCache, &cacheHash, &elfBin, &shaderCaches[stage], &hEntries[stage]);
 
     if (cacheEntryState == ShaderEntryState::Ready) {
       auto data = reinterpret_cast<const char *>(elfBin.pCode);
       elf[stage].assign(data, data + elfBin.codeSize);
+      shaderCaches[stage]->releaseShader(hEntries[stage]);
       LLPC_OUTS("Cache hit for shader stage " << getShaderStageName(static_cast<ShaderStage>(stage)) << "\n");
       stageCacheAccesses[stage] = userShaderCache ? CacheAccessInfo::CacheHit : CacheAccessInfo::InternalCacheHit;
       continue;
@@ -917,20 +996,80 @@ Result Compiler::buildPipelineWithRelocatableElf(Context *context, ArrayRef<cons
 
     // There was a cache miss, so we need to build the relocatable shader for
     // this stage.
-    const PipelineShaderInfo *singleStageShaderInfo[ShaderStageNativeStageCount] = {nullptr, nullptr, nullptr,
-                                                                                    nullptr, nullptr, nullptr};
-    singleStageShaderInfo[stage] = shaderInfo[stage];
+    buildStageMask |= shaderStageToMask(static_cast<ShaderStage>(stage));
+  }
 
-    result = buildPipelineInternal(context, singleStageShaderInfo, /*unlinked=*/true, &elf[stage]);
+  // Build the relocatable shaders of the stages that missed the caches.
+  Result stageResults[ShaderStageNativeStageCount] = {};
+  if (cl::EnableParallelRelocatableElf && countPopulation(buildStageMask) > 1 && !EnableOuts()) {
+    // The stages are independent, so build each of them on its own thread, with its own context and a pipeline
+    // context of its own that has the stage mask and cache hash of the stage.
+    auto buildStage = [&](unsigned stage) {
+      const PipelineShaderInfo *singleStageShaderInfo[ShaderStageNativeStageCount] = {};
+      singleStageShaderInfo[stage] = shaderInfo[stage];
+
+      MetroHash::Hash pipelineHash = context->getPipelineContext()->getPipelineHashCodeWithoutCompact();
+      std::unique_ptr<PipelineContext> stagePipelineContext;
+      if (context->isGraphics()) {
+        auto pipelineInfo = reinterpret_cast<const GraphicsPipelineBuildInfo *>(context->getPipelineBuildInfo());
+        stagePipelineContext.reset(new GraphicsContext(m_gfxIp, pipelineInfo, &pipelineHash, &cacheHashes[stage]));
+      } else {
+        auto pipelineInfo = reinterpret_cast<const ComputePipelineBuildInfo *>(context->getPipelineBuildInfo());
+        stagePipelineContext.reset(new ComputeContext(m_gfxIp, pipelineInfo, &pipelineHash, &cacheHashes[stage]));
+      }
+      stagePipelineContext->setUnlinked(true);
+      stagePipelineContext->setShaderStageMask(shaderStageToMask(static_cast<ShaderStage>(stage)));
 
-    // Add the result to the cache.
-    if (result == Result::Success) {
+      Context *stageContext = acquireContext();
+      stageContext->attachPipelineContext(&*stagePipelineContext);
+      stageResults[stage] = buildPipelineInternal(stageContext, singleStageShaderInfo, /*unlinked=*/true, &elf[stage]);
+      releaseContext(stageContext);
+    };
+
+    std::vector<std::thread> threads;
+    unsigned firstStage = countTrailingZeros(buildStageMask);
+    for (unsigned stage = firstStage + 1; stage < ShaderStageNativeStageCount; ++stage) {
+      if (buildStageMask & shaderStageToMask(static_cast<ShaderStage>(stage)))
+        threads.push_back(std::thread(buildStage, stage));
+    }
+    buildStage(firstStage);
+    for (std::thread &thread : threads)
+      thread.join();
+  } else {
+    // Build the stages one after the other in the pipeline's context, giving up on the remaining stages after a
+    // failure.
+    for (unsigned stage = 0; stage < shaderInfo.size(); ++stage) {
+      if (!(buildStageMask & shaderStageToMask(static_cast<ShaderStage>(stage))))
+        continue;
+      if (result != Result::Success) {
+        stageResults[stage] = result;
+        continue;
+      }
+      const PipelineShaderInfo *singleStageShaderInfo[ShaderStageNativeStageCount] = {nullptr, nullptr, nullptr,
+                                                                                      nullptr, nullptr, nullptr};
+      singleStageShaderInfo[stage] = shaderInfo[stage];
+
+      context->getPipelineContext()->setShaderStageMask(shaderStageToMask(static_cast<ShaderStage>(stage)));
+      context->getPipelineContext()->setHashForCacheLookUp(cacheHashes[stage]);
+      stageResults[stage] = buildPipelineInternal(context, singleStageShaderInfo, /*unlinked=*/true, &elf[stage]);
+      result = stageResults[stage];
+    }
+  }
+
+  // Add the results to the caches.
+  for (unsigned stage = 0; stage < shaderInfo.size(); ++stage) {
+    if (!(buildStageMask & shaderStageToMask(static_cast<ShaderStage>(stage))))
+      continue;
+    if (result == Result::Success)
+      result = stageResults[stage];
+    BinaryData elfBin = {};
+    if (stageResults[stage] == Result::Success) {
       elfBin.codeSize = elf[stage].size();
       elfBin.pCode = elf[stage].data();
     }
-    updateShaderCache((result == Result::Success), &elfBin, shaderCache, hEntry);
+    updateShaderCache((stageResults[stage] == Result::Success), &elfBin, shaderCaches[stage], hEntries[stage]);
     LLPC_OUTS("Updating the cache for shader stage " << stage << "\n");
-    ReleaseCacheEntry((result == Result::Success), &elfBin, &cacheEntry);
+    ReleaseCacheEntry((stageResults[stage] == Result::Success), &elfBin, &cacheEntries[stage]);
   }
   context->getPipelineContext()->setHashForCacheLookUp(originalCacheHash);
   context->getPipelineContext()->setShaderStageMask(originalShaderStageMask);
@@ -1113,6 +1252,169 @@ bool Compiler::canUseRelocatableComputeShaderElf(const ComputePipelineBuildInfo
   return true;
 }
 
+// =====================================================================================================================
+// Get the pass manager to run the per-shader SPIR-V lowering passes with. The lowering passes do not depend on the
+// shader, so when they are neither timed nor dumped, the pass manager cached in the context's LgcContext is used,
+// saving the cost of creating and initializing the passes for every shader. Otherwise a new pass manager is created,
+// owned by the caller through ownedPassMgr.
+//
+// @param context : LLPC context
+// @param stage : Shader stage
+// @param lowerTimer : Timer to time lower passes with, nullptr if not timing
+// @param passIndex : Pass index counter for a newly created pass manager
+// @param [out] ownedPassMgr : Newly created pass manager, if the cached one is not used
+static lgc::PassManager *getLowerPassManager(Context *context, ShaderStage stage, Timer *lowerTimer,
+                                             unsigned *passIndex, std::unique_ptr<lgc::PassManager> &ownedPassMgr) {
+  if (!lowerTimer && !EnableOuts()) {
+    lgc::PassManager *cachedPassMgr = context->getLgcContext()->getFrontEndPassManager(
+        [context, stage](lgc::PassManager &passMgr) { SpirvLower::addPasses(context, stage, passMgr, nullptr); });
+    if (cachedPassMgr)
+      return cachedPassMgr;
+  }
+
+  ownedPassMgr.reset(lgc::PassManager::Create());
+  ownedPassMgr->setPassIndex(passIndex);
+  SpirvLower::addPasses(context, stage, *ownedPassMgr, lowerTimer);
+  return &*ownedPassMgr;
+}
+
+// =====================================================================================================================
+// Run SPIR-V translation and per-shader lowering passes of the shaders of a pipeline concurrently, each shader on its
+// own thread in its own LLVM context. Each resulting module is brought into the pipeline's context through bitcode,
+// and replaces the shader's entry in modules. Shaders handled here are added to the stage skip mask, so the caller
+// links them like shaders that were given as IR.
+//
+// @param context : Acquired context of the pipeline
+// @param pipeline : Middle-end pipeline object
+// @param shaderInfo : Shader info of this pipeline
+// @param [in/out] modules : Empty shader modules in the pipeline's context, replaced by the lowered modules
+// @param [in/out] stageSkipMask : Mask of shader stages that do not need translation and lowering
+Result Compiler::buildShadersInParallel(Context *context, Pipeline *pipeline,
+                                        ArrayRef<const PipelineShaderInfo *> shaderInfo,
+                                        MutableArrayRef<Module *> modules, unsigned *stageSkipMask) {
+  // State of the translation and lowering of one shader on its own thread.
+  struct ShaderJob {
+    unsigned shaderIndex;                             // Index of the shader in shaderInfo
+    std::unique_ptr<PipelineContext> pipelineContext; // Pipeline context of this thread
+    Context *context;                                 // Context the shader is translated and lowered in
+    Module *module;                                   // Shader module in that context
+    SmallVector<char, 0> bitcode;                     // Bitcode of the lowered shader module
+    bool success;                                     // Whether the passes ran successfully
+    bool hasError;                                    // Whether the diagnostic handler saw an error
+  };
+
+  std::vector<ShaderJob> jobs;
+  for (unsigned shaderIndex = 0; shaderIndex < shaderInfo.size(); ++shaderIndex) {
+    const PipelineShaderInfo *shaderInfoEntry = shaderInfo[shaderIndex];
+    if (!shaderInfoEntry || !shaderInfoEntry->pModuleData ||
+        (*stageSkipMask & shaderStageToMask(shaderInfoEntry->entryStage)))
+      continue;
+    jobs.push_back({});
+    jobs.back().shaderIndex = shaderIndex;
+  }
+
+  // Nothing to gain from a thread for a single shader.
+  if (jobs.size() < 2)
+    return Result::Success;
+
+  // Set up a context for each shader. This is done here rather than on the threads, as creating the middle-end
+  // context of a Context is not thread-safe. The Builder is created without a pipeline, as for a shader compile, so
+  // the shader modes are recorded into the shader module rather than into the pipeline state. Each thread also has
+  // its own pipeline context, as the pipeline context is not thread-safe either.
+  const PipelineContext *pipelineContext = context->getPipelineContext();
+  MetroHash::Hash pipelineHash = pipelineContext->getPipelineHashCodeWithoutCompact();
+  MetroHash::Hash cacheHash = pipelineContext->getCacheHashCodeWithoutCompact();
+  for (ShaderJob &job : jobs) {
+    const PipelineShaderInfo *shaderInfoEntry = shaderInfo[job.shaderIndex];
+    if (pipelineContext->isGraphics()) {
+      auto pipelineInfo = reinterpret_cast<const GraphicsPipelineBuildInfo *>(pipelineContext->getPipelineBuildInfo());
+      job.pipelineContext.reset(new GraphicsContext(m_gfxIp, pipelineInfo, &pipelineHash, &cacheHash));
+    } else {
+      auto pipelineInfo = reinterpret_cast<const ComputePipelineBuildInfo *>(pipelineContext->getPipelineBuildInfo());
+      job.pipelineContext.reset(new ComputeContext(m_gfxIp, pipelineInfo, &pipelineHash, &cacheHash));
+    }
+    job.pipelineContext->setUnlinked(pipelineContext->isUnlinked());
+    job.pipelineContext->setShaderStageMask(pipelineContext->getShaderStageMask());
+
+    Context *shaderContext = acquireContext();
+    shaderContext->attachPipelineContext(&*job.pipelineContext);
+    shaderContext->setDiagnosticHandler(std::make_unique<LlpcDiagnosticHandler>(&job.hasError));
+    shaderContext->setInlineAsmDiagnosticHandler(InlineAsmDiagHandler, &job.hasError);
+    shaderContext->setScalarBlockLayout(context->getScalarBlockLayout());
+    shaderContext->setRobustBufferAccess(context->getRobustBufferAccess());
+    shaderContext->setBuilder(shaderContext->getLgcContext()->createBuilder(nullptr, true));
+    shaderContext->getBuilder()->setShaderStage(getLgcShaderStage(shaderInfoEntry->entryStage));
+
+    job.context = shaderContext;
+    job.module = new Module(modules[job.shaderIndex]->getModuleIdentifier(), *shaderContext);
+    shaderContext->setModuleTargetMachine(job.module);
+  }
+
+  // Run the passes of each shader on its own thread.
+  auto runJob = [this, shaderInfo](ShaderJob *job) {
+    const PipelineShaderInfo *shaderInfoEntry = shaderInfo[job->shaderIndex];
+    unsigned passIndex = 0;
+    std::unique_ptr<lgc::PassManager> translatePassMgr(lgc::PassManager::Create());
+    translatePassMgr->setPassIndex(&passIndex);
+    translatePassMgr->add(createSpirvLowerTranslator(shaderInfoEntry->entryStage, shaderInfoEntry));
+    job->success = runPasses(&*translatePassMgr, job->module);
+    if (!job->success)
+      return;
+
+    std::unique_ptr<lgc::PassManager> ownedLowerPassMgr;
+    lgc::PassManager *lowerPassMgr =
+        getLowerPassManager(job->context, shaderInfoEntry->entryStage, nullptr, &passIndex, ownedLowerPassMgr);
+    job->success = runPasses(lowerPassMgr, job->module);
+    if (!job->success)
+      return;
+
+    raw_svector_ostream bitcodeStream(job->bitcode);
+    WriteBitcodeToFile(*job->module, bitcodeStream);
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned jobIndex = 1; jobIndex < jobs.size(); ++jobIndex)
+    threads.push_back(std::thread(runJob, &jobs[jobIndex]));
+  runJob(&jobs[0]);
+  for (std::thread &thread : threads)
+    thread.join();
+
+  // Bring the lowered modules into the pipeline's context, and pass their shader modes to the pipeline state.
+  Result result = Result::Success;
+  for (ShaderJob &job : jobs) {
+    delete job.module;
+    job.context->setDiagnosticHandler(nullptr);
+    job.context->setInlineAsmDiagnosticHandler(nullptr);
+    releaseContext(job.context);
+
+    if (!job.success || job.hasError) {
+      LLPC_ERRS("Failed to translate SPIR-V or run per-shader passes\n");
+      result = Result::ErrorInvalidShader;
+      continue;
+    }
+    if (result != Result::Success)
+      continue;
+
+    BinaryData bitcode = {};
+    bitcode.pCode = job.bitcode.data();
+    bitcode.codeSize = job.bitcode.size();
+    std::unique_ptr<Module> module = context->loadLibary(&bitcode);
+    if (!module) {
+      result = Result::ErrorInvalidShader;
+      continue;
+    }
+
+    ShaderStage entryStage = shaderInfo[job.shaderIndex]->entryStage;
+    module->setModuleIdentifier(modules[job.shaderIndex]->getModuleIdentifier());
+    pipeline->setShaderModesFromModule(&*module, getLgcShaderStage(entryStage));
+    delete modules[job.shaderIndex];
+    modules[job.shaderIndex] = module.release();
+    *stageSkipMask |= shaderStageToMask(entryStage);
+  }
+
+  return result;
+}
+
 // =====================================================================================================================
 // Build pipeline internally -- common code for graphics and compute
 //
@@ -1132,6 +1434,12 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
   context->setDiagnosticHandler(std::make_unique<LlpcDiagnosticHandler>(&hasError));
   context->setInlineAsmDiagnosticHandler(InlineAsmDiagHandler, &hasError);
 
+  // An asynchronous build is paused or cancelled between passes through its checkpoint, and the cancellation is also
+  // checked between the phases of the build.
+  PipelineBuildTask *buildTask = PipelineBuildTask::getCurrent();
+  if (buildTask)
+    lgc::PassManager::setCheckpoint(*context, buildTask);
+
   // Set a couple of pipeline options for front-end use.
   // TODO: The front-end should not be using pipeline options.
   context->setScalarBlockLayout(context->getPipelineContext()->getPipelineOptions()->scalarBlockLayout);
@@ -1208,6 +1516,15 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
       context->setModuleTargetMachine(module);
     }
 
+    if (result == Result::Success && buildTask && buildTask->isCancelled())
+      result = Result::Aborted;
+
+    // Optionally translate and lower the shaders concurrently. That is not done when the passes are being dumped or
+    // timed, as those are per-pipeline and not thread-safe.
+    if (result == Result::Success && cl::EnableParallelFrontEnd && UseBuilderRecorder && !EnableOuts() &&
+        !TimePassesIsEnabled && !cl::EnableTimerProfile)
+      result = buildShadersInParallel(context, &*pipeline, shaderInfo, modules, &stageSkipMask);
+
     for (unsigned shaderIndex = 0; shaderIndex < shaderInfo.size() && result == Result::Success; ++shaderIndex) {
       const PipelineShaderInfo *shaderInfoEntry = shaderInfo[shaderIndex];
       ShaderStage entryStage = shaderInfoEntry ? shaderInfoEntry->entryStage : ShaderStageInvalid;
@@ -1244,6 +1561,17 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
         result = Result::ErrorInvalidShader;
       }
     }
+
+    if (result == Result::Success && buildTask && buildTask->isCancelled())
+      result = Result::Aborted;
+    if (result == Result::Aborted) {
+      // The build has been cancelled, so the shader modules are not lowered or linked.
+      for (Module *&module : modules) {
+        delete module;
+        module = nullptr;
+      }
+    }
+
     SmallVector<Module *, 5> modulesToLink;
     for (unsigned shaderIndex = 0; shaderIndex < shaderInfo.size() && result == Result::Success; ++shaderIndex) {
       // Per-shader SPIR-V lowering passes.
@@ -1259,13 +1587,12 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
       }
 
       context->getBuilder()->setShaderStage(getLgcShaderStage(entryStage));
-      std::unique_ptr<lgc::PassManager> lowerPassMgr(lgc::PassManager::Create());
-      lowerPassMgr->setPassIndex(&passIndex);
+      std::unique_ptr<lgc::PassManager> ownedLowerPassMgr;
+      lgc::PassManager *lowerPassMgr = getLowerPassManager(context, entryStage, timerProfiler.getTimer(TimerLower),
+                                                           &passIndex, ownedLowerPassMgr);
 
-      SpirvLower::addPasses(context, entryStage, *lowerPassMgr, timerProfiler.getTimer(TimerLower)
-      );
       // Run the passes.
-      bool success = runPasses(&*lowerPassMgr, modules[shaderIndex]);
+      bool success = runPasses(lowerPassMgr, modules[shaderIndex]);
       if (!success) {
         LLPC_ERRS("Failed to translate SPIR-V or run per-shader passes\n");
         result = Result::ErrorInvalidShader;
@@ -1305,6 +1632,9 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
   // Generate pipeline.
   raw_svector_ostream elfStream(*pipelineElf);
 
+  if (result == Result::Success && buildTask && buildTask->isCancelled())
+    result = Result::Aborted;
+
   if (result == Result::Success) {
     result = Result::ErrorInvalidShader;
 #if LLPC_ENABLE_EXCEPTION
@@ -1324,6 +1654,10 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
     catch (const char *) {
     }
 #endif
+
+    // The passes were stopped if the build was cancelled while they ran, so the output is not usable.
+    if (buildTask && buildTask->isCancelled())
+      result = Result::Aborted;
   }
   if (checkPerStageCache) {
     // For graphics, update shader caches with results of compile, and merge ELF outputs if necessary.
@@ -1336,6 +1670,8 @@ Result Compiler::buildPipelineInternal(Context *context, ArrayRef<const Pipeline
 
   context->setDiagnosticHandler(nullptr);
   context->setInlineAsmDiagnosticHandler(nullptr);
+  if (buildTask)
+    lgc::PassManager::setCheckpoint(*context, nullptr);
 
   if (result == Result::Success && hasError)
     result = Result::ErrorInvalidShader;
@@ -1402,12 +1738,13 @@ unsigned GraphicsShaderCacheChecker::check(const Module *module, unsigned stageM
 
   using LookupHelperType = std::function<void(void)>;
   LookupHelperType lookupFragCache = [this, userCache, &fragmentHashId]() {
-    m_fragmentCacheResult = m_compiler->lookUpCaches(userCache, &fragmentHashId, &m_fragmentElf, &m_fragmentEntry);
+    m_fragmentCacheResult =
+        m_compiler->lookUpCaches(userCache, &fragmentHashId, &m_fragmentElf, &m_fragmentEntry, &m_fragmentElfData);
   };
 
   LookupHelperType lookupNonFragCache = [this, userCache, &nonFragmentHashId]() {
-    m_nonFragmentCacheResult =
-        m_compiler->lookUpCaches(userCache, &nonFragmentHashId, &m_nonFragmentElf, &m_nonFragmentEntry);
+    m_nonFragmentCacheResult = m_compiler->lookUpCaches(userCache, &nonFragmentHashId, &m_nonFragmentElf,
+                                                        &m_nonFragmentEntry, &m_nonFragmentElfData);
   };
 
   LookupHelperType lookupFragShader = [this, appCache, &fragmentHash]() {
@@ -1455,6 +1792,28 @@ void GraphicsShaderCacheChecker::updateRootUserDateOffset(ElfPackage *pipelineEl
   writer.updateElfBinary(m_context, pipelineElf);
 }
 
+// =====================================================================================================================
+// Extract the fragment shader part or the non-fragment shader part of a compiled pipeline ELF, to be stored in the
+// corresponding per-stage shader cache entry. mergeElfBinary accepts either part in place of the full pipeline ELF.
+//
+// @param pipelineElf : ELF of the full pipeline
+// @param fragmentPart : Whether to extract the fragment shader part (otherwise the non-fragment shader part)
+// @param [out] partElf : Storage for the extracted ELF
+// @returns : The extracted ELF, pointing into partElf
+BinaryData GraphicsShaderCacheChecker::extractPipelinePart(const BinaryData &pipelineElf, bool fragmentPart,
+                                                           ElfPackage *partElf) {
+  ElfWriter<Elf64> writer(m_context->getGfxIpVersion());
+  auto result = writer.ReadFromBuffer(pipelineElf.pCode, pipelineElf.codeSize);
+  assert(result == Result::Success);
+  (void(result)); // unused
+  writer.extractElfBinary(fragmentPart, partElf);
+
+  BinaryData partBinary = {};
+  partBinary.codeSize = partElf->size();
+  partBinary.pCode = partElf->data();
+  return partBinary;
+}
+
 // =====================================================================================================================
 // Update shader caches for graphics pipeline from compile result, and merge ELF outputs if necessary.
 //
@@ -1469,21 +1828,37 @@ void GraphicsShaderCacheChecker::updateAndMerge(Result result, ElfPackage *outpu
     pipelineElf.codeSize = outputPipelineElf->size();
     pipelineElf.pCode = outputPipelineElf->data();
 
+    // Each per-stage entry only stores its own part of the compiled pipeline.
+    bool insertFragment = m_fragmentCacheEntryState == ShaderEntryState::Compiling ||
+                          (m_compiler->IsCacheValid() && m_fragmentCacheResult == Result::NotFound);
+    bool insertNonFragment = m_nonFragmentCacheEntryState == ShaderEntryState::Compiling ||
+                             (m_compiler->IsCacheValid() && m_nonFragmentCacheResult == Result::NotFound);
+    ElfPackage fragmentPartElf;
+    ElfPackage nonFragmentPartElf;
+    BinaryData fragmentElf = pipelineElf;
+    BinaryData nonFragmentElf = pipelineElf;
+    if (result == Result::Success) {
+      if (insertFragment)
+        fragmentElf = extractPipelinePart(pipelineElf, true, &fragmentPartElf);
+      if (insertNonFragment)
+        nonFragmentElf = extractPipelinePart(pipelineElf, false, &nonFragmentPartElf);
+    }
+
     if (m_compiler->IsCacheValid()) {
       bool withValue = (result == Result::Success);
 
-      m_compiler->ReleaseCacheEntry(withValue && (m_fragmentCacheResult == Result::NotFound), &pipelineElf,
+      m_compiler->ReleaseCacheEntry(withValue && (m_fragmentCacheResult == Result::NotFound), &fragmentElf,
                                     &m_fragmentEntry);
-      m_compiler->ReleaseCacheEntry(withValue && (m_nonFragmentCacheResult == Result::NotFound), &pipelineElf,
+      m_compiler->ReleaseCacheEntry(withValue && (m_nonFragmentCacheResult == Result::NotFound), &nonFragmentElf,
                                     &m_nonFragmentEntry);
     }
 
     if (m_fragmentCacheEntryState == ShaderEntryState::Compiling) {
-      m_compiler->updateShaderCache(result == Result::Success, &pipelineElf, m_fragmentShaderCache, m_hFragmentEntry);
+      m_compiler->updateShaderCache(result == Result::Success, &fragmentElf, m_fragmentShaderCache, m_hFragmentEntry);
     }
 
     if (m_nonFragmentCacheEntryState == ShaderEntryState::Compiling) {
-      m_compiler->updateShaderCache(result == Result::Success, &pipelineElf, m_nonFragmentShaderCache,
+      m_compiler->updateShaderCache(result == Result::Success, &nonFragmentElf, m_nonFragmentShaderCache,
                                     m_hNonFragmentEntry);
     }
   }
@@ -1522,6 +1897,12 @@ void GraphicsShaderCacheChecker::updateAndMerge(Result result, ElfPackage *outpu
     (void(result)); // unused
     writer.mergeElfBinary(m_context, &fragmentElf, outputPipelineElf);
   }
+
+  // The ELFs from the shader cache are not needed any more.
+  if (m_fragmentCacheEntryState == ShaderEntryState::Ready)
+    m_fragmentShaderCache->releaseShader(m_hFragmentEntry);
+  if (m_nonFragmentCacheEntryState == ShaderEntryState::Ready)
+    m_nonFragmentShaderCache->releaseShader(m_hNonFragmentEntry);
 }
 
 // =====================================================================================================================
@@ -1585,6 +1966,8 @@ Result Compiler::buildGraphicsPipelineInternal(GraphicsContext *graphicsContext,
 // @param pipelineDumpFile : Handle of pipeline dump file
 Result Compiler::BuildGraphicsPipeline(const GraphicsPipelineBuildInfo *pipelineInfo,
                                        GraphicsPipelineBuildOut *pipelineOut, void *pipelineDumpFile) {
+  // Background builds pause while this build runs, unless it is a background build itself.
+  ForegroundBuildScope foregroundScope;
   Result result = Result::Success;
   BinaryData elfBin = {};
 
@@ -1640,11 +2023,12 @@ Result Compiler::BuildGraphicsPipeline(const GraphicsPipelineBuildInfo *pipeline
   HashId hashId = {};
   memcpy(&hashId.bytes, &cacheHash.bytes, sizeof(cacheHash));
   EntryHandle cacheEntry;
+  std::vector<uint8_t> elfData;
   Result cacheResult = Result::ErrorUnknown;
 
   if (!buildingRelocatableElf) {
     if (m_cache) {
-      cacheResult = lookUpCaches(userCache, &hashId, &elfBin, &cacheEntry);
+      cacheResult = lookUpCaches(userCache, &hashId, &elfBin, &cacheEntry, &elfData);
       if (cacheResult == Result::Success)
         pipelineOut->pipelineCacheAccess = CacheAccessInfo::CacheHit;
     } else {
@@ -1695,7 +2079,10 @@ Result Compiler::BuildGraphicsPipeline(const GraphicsPipelineBuildInfo *pipeline
   if (m_cache) {
     bool withValue = (result == Result::Success) && (cacheResult != Result::Success);
     ReleaseCacheEntry(withValue, &elfBin, &cacheEntry);
-  }
+  } else if (cacheEntryState == ShaderEntryState::Ready)
+    shaderCache->releaseShader(hEntry);
+
+  recordCacheAccesses(pipelineOut->pipelineCacheAccess, pipelineOut->stageCacheAccesses);
 
   return result;
 }
@@ -1737,6 +2124,8 @@ Result Compiler::buildComputePipelineInternal(ComputeContext *computeContext,
 // @param pipelineDumpFile : Handle of pipeline dump file
 Result Compiler::BuildComputePipeline(const ComputePipelineBuildInfo *pipelineInfo,
                                       ComputePipelineBuildOut *pipelineOut, void *pipelineDumpFile) {
+  // Background builds pause while this build runs, unless it is a background build itself.
+  ForegroundBuildScope foregroundScope;
   BinaryData elfBin = {};
 
   bool buildingRelocatableElf = pipelineInfo->options.enableRelocatableShaderElf || cl::UseRelocatableShaderElf;
@@ -1782,11 +2171,12 @@ Result Compiler::BuildComputePipeline(const ComputePipelineBuildInfo *pipelineIn
   HashId hashId = {};
   memcpy(&hashId.bytes, &cacheHash.bytes, sizeof(cacheHash));
   EntryHandle cacheEntry;
+  std::vector<uint8_t> elfData;
   Result cacheResult = Result::ErrorUnknown;
 
   if (!buildingRelocatableElf) {
     if (m_cache) {
-      cacheResult = lookUpCaches(userCache, &hashId, &elfBin, &cacheEntry);
+      cacheResult = lookUpCaches(userCache, &hashId, &elfBin, &cacheEntry, &elfData);
       if (cacheResult == Result::Success)
         pipelineOut->pipelineCacheAccess = CacheAccessInfo::CacheHit;
     } else {
@@ -1838,11 +2228,237 @@ Result Compiler::BuildComputePipeline(const ComputePipelineBuildInfo *pipelineIn
   if (m_cache) {
     bool withValue = (result == Result::Success) && (cacheResult != Result::Success);
     ReleaseCacheEntry(withValue, &elfBin, &cacheEntry);
-  }
+  } else if (cacheEntryState == ShaderEntryState::Ready)
+    shaderCache->releaseShader(hEntry);
+
+  CacheAccessInfo stageCacheAccesses[ShaderStageCount] = {};
+  stageCacheAccesses[ShaderStageCompute] = pipelineOut->stageCacheAccess;
+  recordCacheAccesses(pipelineOut->pipelineCacheAccess, stageCacheAccesses);
 
   return result;
 }
 
+// =====================================================================================================================
+// Copies the output of a built pipeline to a pipeline of the batch with the same cache hash, allocating its binary with
+// the output allocator of the destination pipeline.
+//
+// @param source : Built pipeline
+// @param [in/out] dest : Pipeline with the same cache hash as the built pipeline
+static Result copyPipelineOutput(const PipelineBuildItem &source, PipelineBuildItem *dest) {
+  if (source.result != Result::Success)
+    return source.result;
+
+  const BinaryData *sourceBin = nullptr;
+  BinaryData *destBin = nullptr;
+  void *allocBuf = nullptr;
+  if (dest->pGraphicsInfo) {
+    const GraphicsPipelineBuildInfo *pipelineInfo = dest->pGraphicsInfo;
+    sourceBin = &source.pGraphicsOut->pipelineBin;
+    destBin = &dest->pGraphicsOut->pipelineBin;
+    memcpy(dest->pGraphicsOut->stageCacheAccesses, source.pGraphicsOut->stageCacheAccesses,
+           sizeof(dest->pGraphicsOut->stageCacheAccesses));
+    dest->pGraphicsOut->pipelineCacheAccess = CacheAccessInfo::InternalCacheHit;
+    if (pipelineInfo->pfnOutputAlloc)
+      allocBuf = pipelineInfo->pfnOutputAlloc(pipelineInfo->pInstance, pipelineInfo->pUserData, sourceBin->codeSize);
+    else
+      return Result::ErrorInvalidPointer;
+  } else {
+    const ComputePipelineBuildInfo *pipelineInfo = dest->pComputeInfo;
+    sourceBin = &source.pComputeOut->pipelineBin;
+    destBin = &dest->pComputeOut->pipelineBin;
+    dest->pComputeOut->stageCacheAccess = source.pComputeOut->stageCacheAccess;
+    dest->pComputeOut->pipelineCacheAccess = CacheAccessInfo::InternalCacheHit;
+    if (pipelineInfo->pfnOutputAlloc)
+      allocBuf = pipelineInfo->pfnOutputAlloc(pipelineInfo->pInstance, pipelineInfo->pUserData, sourceBin->codeSize);
+    else
+      return Result::ErrorInvalidPointer;
+  }
+
+  if (!allocBuf)
+    return Result::ErrorOutOfMemory;
+  memcpy(allocBuf, sourceBin->pCode, sourceBin->codeSize);
+  destBin->codeSize = sourceBin->codeSize;
+  destBin->pCode = allocBuf;
+  return Result::Success;
+}
+
+// =====================================================================================================================
+// Build a batch of graphics and compute pipelines on a pool of threads. The threads take the pipelines to build from a
+// shared counter, so a thread that finishes a cheap pipeline goes on with the next one instead of waiting for the
+// others. Each build acquires its LLVM context from the context pool of the compiler, so no more contexts than threads
+// are in use at the same time.
+//
+// @param itemCount : Count of pipelines in the batch
+// @param [in/out] items : Array of pipelines to build, the result of each is set in it
+// @param threadCount : Maximum count of threads to build the pipelines on, 0 for the count of hardware threads
+// @param callback : Function called once each pipeline has been built, or nullptr
+// @param userData : User data passed to callback
+Result Compiler::BuildPipelines(unsigned itemCount, PipelineBuildItem *items, unsigned threadCount,
+                                PipelineBuildCallback callback, void *userData) {
+  // Find the pipelines to build. A pipeline with the same cache hash as an earlier pipeline of the batch is not built
+  // again; it gets a copy of the output of the earlier pipeline once that one is built.
+  std::vector<MetroHash::Hash> cacheHashes(itemCount);
+  std::vector<unsigned> buildItems;
+  std::vector<SmallVector<unsigned, 1>> duplicateItems(itemCount);
+  std::unordered_multimap<uint64_t, unsigned> hashItemMap;
+  for (unsigned itemIdx = 0; itemIdx < itemCount; ++itemIdx) {
+    PipelineBuildItem &item = items[itemIdx];
+    bool isGraphics = item.pGraphicsInfo;
+    if (isGraphics == !!item.pComputeInfo || (isGraphics ? !item.pGraphicsOut : !item.pComputeOut)) {
+      item.result = Result::ErrorInvalidPointer;
+      if (callback)
+        callback(userData, itemIdx, &item);
+      continue;
+    }
+
+    cacheHashes[itemIdx] = isGraphics ? PipelineDumper::generateHashForGraphicsPipeline(item.pGraphicsInfo, true, false)
+                                      : PipelineDumper::generateHashForComputePipeline(item.pComputeInfo, true, false);
+
+    uint64_t hashCode64 = MetroHash::compact64(&cacheHashes[itemIdx]);
+    auto range = hashItemMap.equal_range(hashCode64);
+    auto it = range.first;
+    for (; it != range.second; ++it) {
+      unsigned buildIdx = it->second;
+      if (!!items[buildIdx].pGraphicsInfo == isGraphics &&
+          memcmp(cacheHashes[buildIdx].bytes, cacheHashes[itemIdx].bytes, sizeof(MetroHash::Hash)) == 0)
+        break;
+    }
+
+    if (it != range.second)
+      duplicateItems[it->second].push_back(itemIdx);
+    else {
+      hashItemMap.insert({hashCode64, itemIdx});
+      buildItems.push_back(itemIdx);
+    }
+  }
+
+  std::atomic<unsigned> nextBuild(0);
+  auto runBuilds = [&]() {
+    for (;;) {
+      unsigned buildIdx = nextBuild.fetch_add(1);
+      if (buildIdx >= buildItems.size())
+        break;
+
+      unsigned itemIdx = buildItems[buildIdx];
+      PipelineBuildItem &item = items[itemIdx];
+      if (item.pGraphicsInfo)
+        item.result = BuildGraphicsPipeline(item.pGraphicsInfo, item.pGraphicsOut);
+      else
+        item.result = BuildComputePipeline(item.pComputeInfo, item.pComputeOut);
+
+      // Copy the output to all the duplicates before calling the callback for any of them, so that a callback that
+      // frees or reuses the output of the pipeline does not affect them.
+      for (unsigned duplicateIdx : duplicateItems[itemIdx]) {
+        PipelineBuildItem &duplicate = items[duplicateIdx];
+        duplicate.result = copyPipelineOutput(item, &duplicate);
+        if (duplicate.result == Result::Success) {
+          if (duplicate.pGraphicsInfo)
+            recordCacheAccesses(CacheAccessInfo::InternalCacheHit, duplicate.pGraphicsOut->stageCacheAccesses);
+          else {
+            CacheAccessInfo stageCacheAccesses[ShaderStageCount] = {};
+            stageCacheAccesses[ShaderStageCompute] = duplicate.pComputeOut->stageCacheAccess;
+            recordCacheAccesses(CacheAccessInfo::InternalCacheHit, stageCacheAccesses);
+          }
+        }
+      }
+
+      if (callback) {
+        callback(userData, itemIdx, &item);
+        for (unsigned duplicateIdx : duplicateItems[itemIdx])
+          callback(userData, duplicateIdx, &items[duplicateIdx]);
+      }
+    }
+  };
+
+  // The builds run on the calling thread and on threads of the pool of the compiler, which are kept for later batches.
+  // The pool has as many threads as the hardware, so that limits the thread count too.
+  if (threadCount == 0)
+    threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+  threadCount = std::min(threadCount, static_cast<unsigned>(buildItems.size()));
+
+  std::vector<std::shared_future<void>> threadsDone;
+  if (threadCount > 1) {
+    ThreadPool *batchBuildThreads = nullptr;
+    {
+      std::lock_guard<sys::Mutex> lock(m_buildSchedulerMutex);
+      if (!m_batchBuildThreads)
+        m_batchBuildThreads = new ThreadPool();
+      batchBuildThreads = m_batchBuildThreads;
+    }
+    for (unsigned threadIdx = 1; threadIdx < threadCount; ++threadIdx)
+      threadsDone.push_back(batchBuildThreads->async(runBuilds));
+  }
+  runBuilds();
+  for (std::shared_future<void> &threadDone : threadsDone)
+    threadDone.wait();
+
+  for (unsigned itemIdx = 0; itemIdx < itemCount; ++itemIdx) {
+    if (items[itemIdx].result != Result::Success)
+      return items[itemIdx].result;
+  }
+  return Result::Success;
+}
+
+// =====================================================================================================================
+// Start building a graphics or compute pipeline on a thread of the scheduler of asynchronous builds, which is created
+// the first time this is called.
+//
+// @param [in/out] item : Pipeline to build, the result of which is set in it when the build completes
+// @param priority : Initial priority of the build
+// @param [out] task : Task of the build
+Result Compiler::BuildPipelineAsync(PipelineBuildItem *item, PipelineBuildPriority priority,
+                                    IPipelineBuildTask **task) {
+  if (!item || !task)
+    return Result::ErrorInvalidPointer;
+  bool isGraphics = item->pGraphicsInfo;
+  if (isGraphics == !!item->pComputeInfo || (isGraphics ? !item->pGraphicsOut : !item->pComputeOut))
+    return Result::ErrorInvalidPointer;
+
+  {
+    std::lock_guard<sys::Mutex> lock(m_buildSchedulerMutex);
+    if (!m_buildScheduler)
+      m_buildScheduler = new PipelineBuildScheduler(cl::AsyncBuildThreads);
+  }
+
+  PipelineBuildTask *buildTask = new PipelineBuildTask(this, m_buildScheduler, item, priority);
+  item->result = Result::NotReady;
+  m_buildScheduler->enqueue(buildTask);
+  *task = buildTask;
+  return Result::Success;
+}
+
+// =====================================================================================================================
+// Counts the cache access results of a pipeline build in the cache statistics of the compiler.
+//
+// @param pipelineCacheAccess : Pipeline cache access result
+// @param stageCacheAccesses : Cache access result of each shader stage, stages that were not checked are not counted
+void Compiler::recordCacheAccesses(CacheAccessInfo pipelineCacheAccess, ArrayRef<CacheAccessInfo> stageCacheAccesses) {
+  m_pipelineCacheAccesses[pipelineCacheAccess].fetch_add(1, std::memory_order_relaxed);
+  for (unsigned stage = 0; stage < stageCacheAccesses.size(); ++stage) {
+    if (stageCacheAccesses[stage] != CacheNotChecked)
+      m_stageCacheAccesses[stage][stageCacheAccesses[stage]].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// =====================================================================================================================
+// Gets the statistics of the caches used by this pipeline compiler.
+//
+// @param [out] statistics : Cache statistics, accumulated since the compiler was created
+void Compiler::GetCacheStatistics(CompilerCacheStatistics *statistics) const {
+  *statistics = {};
+  if (m_shaderCache)
+    m_shaderCache->getStatistics(&statistics->shaderCache);
+  m_contextPool->getStatistics(&statistics->contextPool);
+
+  for (unsigned access = 0; access < CacheAccessInfoCount; ++access) {
+    statistics->pipelineCacheAccesses[access] = m_pipelineCacheAccesses[access].load(std::memory_order_relaxed);
+    for (unsigned stage = 0; stage < ShaderStageCount; ++stage) {
+      statistics->stageCacheAccesses[stage][access] =
+          m_stageCacheAccesses[stage][access].load(std::memory_order_relaxed);
+    }
+  }
+}
+
 // =====================================================================================================================
 // Builds hash code from compilation-options
 //
@@ -1854,6 +2470,7 @@ MetroHash::Hash Compiler::generateHashForCompileOptions(unsigned optionCount, co
                                        cl::EnablePipelineDump.ArgStr,
                                        cl::ShaderCacheFileDir.ArgStr,
                                        cl::ShaderCacheMode.ArgStr,
+                                       cl::ShaderCacheCompression.ArgStr,
                                        cl::EnableOuts.ArgStr,
                                        cl::EnableErrs.ArgStr,
                                        cl::LogFileDbgs.ArgStr,
@@ -1972,36 +2589,7 @@ Result Compiler::CreateShaderCache(const ShaderCacheCreateInfo *pCreateInfo, ISh
 // =====================================================================================================================
 // Acquires a free context from context pool.
 Context *Compiler::acquireContext() const {
-  Context *freeContext = nullptr;
-
-  std::lock_guard<sys::Mutex> lock(m_contextPoolMutex);
-
-  // Try to find a free context from pool first
-  for (auto &context : *m_contextPool) {
-    GfxIpVersion gfxIpVersion = context->getGfxIpVersion();
-
-    if (!context->isInUse() && gfxIpVersion == m_gfxIp) {
-      // Free up context if it is being used too many times to avoid consuming too much memory.
-      int contextReuseLimit = cl::ContextReuseLimit.getValue();
-      if (contextReuseLimit > 0 && context->getUseCount() > contextReuseLimit) {
-        delete context;
-        context = new Context(m_gfxIp);
-      }
-      freeContext = context;
-      break;
-    }
-  }
-
-  if (!freeContext) {
-    // Create a new one if we fail to find an available one
-    freeContext = new Context(m_gfxIp);
-    m_contextPool->push_back(freeContext);
-  }
-
-  assert(freeContext);
-  freeContext->setInUse(true);
-
-  return freeContext;
+  return m_contextPool->acquireContext(m_gfxIp);
 }
 
 // =====================================================================================================================
@@ -2031,9 +2619,7 @@ bool Compiler::runPasses(lgc::PassManager *passMgr, Module *module) const {
 //
 // @param context : LLPC context
 void Compiler::releaseContext(Context *context) const {
-  std::lock_guard<sys::Mutex> lock(m_contextPoolMutex);
-  context->reset();
-  context->setInUse(false);
+  m_contextPool->releaseContext(context);
 }
 
 // =====================================================================================================================
@@ -2041,7 +2627,8 @@ void Compiler::releaseContext(Context *context) const {
 // It will try App's pipelince cache first if that's available.
 // Then try on the internal shader cache next if it misses.
 //
-// Upon hit, Ready is returned and pElfBin is filled in. Upon miss, Compiling is returned and ppShaderCache and
+// Upon hit, Ready is returned and pElfBin, ppShaderCache and phEntry are filled in; the entry must be released with
+// ShaderCache::releaseShader once pElfBin is no longer used. Upon miss, Compiling is returned and ppShaderCache and
 // phEntry are filled in.
 //
 // @param appPipelineCache : App's pipeline cache
@@ -2070,8 +2657,12 @@ ShaderEntryState Compiler::lookUpShaderCaches(IShaderCache *appPipelineCache, Me
     ShaderEntryState cacheEntryState = shaderCache[i]->findShader(*cacheHash, allocateOnMiss, &currentEntry);
     if (cacheEntryState == ShaderEntryState::Ready) {
       Result result = shaderCache[i]->retrieveShader(currentEntry, &elfBin->pCode, &elfBin->codeSize);
-      if (result == Result::Success)
+      if (result == Result::Success) {
+        *ppShaderCache = shaderCache[i];
+        *phEntry = currentEntry;
         return ShaderEntryState::Ready;
+      }
+      shaderCache[i]->releaseShader(currentEntry);
     } else if (cacheEntryState == ShaderEntryState::Compiling) {
       *ppShaderCache = shaderCache[i];
       *phEntry = currentEntry;
@@ -2115,14 +2706,16 @@ void Compiler::updateShaderCache(bool insert, const BinaryData *elfBin, ShaderCa
 //
 // Upon hit, Ready is returned and pElfBin is filled in. Upon miss, NotFound is returned and ppShaderCache and
 // phEntry are filled in. If NotReady is returned, means cache will be updated by another thread.
-// The returned phEntry must be released by calling ReleaseCacheEntry().
+// The returned phEntry must be released by calling ReleaseCacheEntry(). If the shader data is stored compressed, it
+// is decompressed into elfData, which must be kept alive as long as elfBin is used.
 //
 // @param appPipelineCache : App's pipeline cache
 // @param cacheHash : Hash code of the shader
 // @param [out] elfBin : Pointer to shader data
 // @param [out] entryHandle : Handle to use
+// @param [out] elfData : Storage for the decompressed shader data
 Result Compiler::lookUpCaches(ICache *appPipelineCache, HashId *cacheHash, BinaryData *elfBin,
-                              EntryHandle *entryHandle) {
+                              EntryHandle *entryHandle, std::vector<uint8_t> *elfData) {
   Result cacheResult = Result::Unsupported;
 
   auto LookUpCache = [](ICache *cache, bool allocateOnMiss, HashId *cacheHash, BinaryData *elfBin,
@@ -2130,10 +2723,13 @@ Result Compiler::lookUpCaches(ICache *appPipelineCache, HashId *cacheHash, Binar
     EntryHandle currentEntry;
     Result cacheResult = Result::Unsupported;
 
-    cacheResult = cache->GetEntry(*cacheHash, allocateOnMiss, &currentEntry);
+    cacheResult = cache->GetEntry(getCacheValueKey(*cacheHash), allocateOnMiss, &currentEntry);
 
-    if (cacheResult == Result::NotReady)
+    if (cacheResult == Result::NotReady) {
+      // The entry may be compiled by a paused background build, which must be allowed to go on.
+      ForegroundBuildWaitScope waitScope;
       cacheResult = currentEntry.WaitForEntry();
+    }
 
     if (cacheResult == Result::Success) {
       cacheResult = currentEntry.GetValueZeroCopy(&elfBin->pCode, &elfBin->codeSize);
@@ -2151,6 +2747,19 @@ Result Compiler::lookUpCaches(ICache *appPipelineCache, HashId *cacheHash, Binar
   if (appPipelineCache && cacheResult != Result::Success)
     cacheResult = LookUpCache(appPipelineCache, true, cacheHash, elfBin, entryHandle);
 
+  if (cacheResult == Result::Success) {
+    Result blobResult = decompressCacheBlob(elfBin->pCode, elfBin->codeSize, elfData);
+    if (blobResult == Result::Success) {
+      elfBin->pCode = elfData->data();
+      elfBin->codeSize = elfData->size();
+    } else if (blobResult != Result::NotFound) {
+      // A blob with another layout is not used. It cannot be replaced either, so the shader is built without storing
+      // it.
+      EntryHandle::ReleaseHandle(std::move(*entryHandle));
+      cacheResult = Result::NotFound;
+    }
+  }
+
   return cacheResult;
 }
 
@@ -2168,7 +2777,12 @@ void Compiler::ReleaseCacheEntry(bool withValue, const BinaryData *elfBin, Entry
 
   if (withValue) {
     assert(elfBin->codeSize > 0);
-    entryHandle->SetValue(withValue, elfBin->pCode, elfBin->codeSize);
+    // Store the shader data compressed if that makes it smaller.
+    std::vector<uint8_t> compressedElf;
+    if (cl::ShaderCacheCompression && compressCacheBlob(elfBin->pCode, elfBin->codeSize, &compressedElf))
+      entryHandle->SetValue(withValue, compressedElf.data(), compressedElf.size());
+    else
+      entryHandle->SetValue(withValue, elfBin->pCode, elfBin->codeSize);
   }
 
   // Empty EntryHandle
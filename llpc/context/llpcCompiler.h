@@ -40,12 +40,14 @@
 namespace llvm {
 
 class Module;
+class ThreadPool;
 
 } // namespace llvm
 
 namespace lgc {
 
 class PassManager;
+class Pipeline;
 
 } // namespace lgc
 
@@ -58,6 +60,8 @@ using Vkgc::findVkStructInChain;
 class Compiler;
 class ComputeContext;
 class Context;
+class ContextPool;
+class PipelineBuildScheduler;
 class GraphicsContext;
 
 // =====================================================================================================================
@@ -78,6 +82,8 @@ public:
   void updateRootUserDateOffset(ElfPackage *pipelineElf);
 
 private:
+  BinaryData extractPipelinePart(const BinaryData &pipelineElf, bool fragmentPart, ElfPackage *partElf);
+
   Compiler *m_compiler;
   Context *m_context;
 
@@ -95,9 +101,11 @@ private:
   // New ICache
   Vkgc::Result m_nonFragmentCacheResult = Vkgc::Result::ErrorUnknown;
   Vkgc::EntryHandle m_nonFragmentEntry;
+  std::vector<uint8_t> m_nonFragmentElfData; // Decompressed ELF, if it is stored compressed in the cache
 
   Vkgc::Result m_fragmentCacheResult = Vkgc::Result::ErrorUnknown;
   Vkgc::EntryHandle m_fragmentEntry;
+  std::vector<uint8_t> m_fragmentElfData; // Decompressed ELF, if it is stored compressed in the cache
 };
 
 // =====================================================================================================================
@@ -120,6 +128,15 @@ public:
 
   virtual Result BuildComputePipeline(const ComputePipelineBuildInfo *pipelineInfo,
                                       ComputePipelineBuildOut *pipelineOut, void *pipelineDumpFile = nullptr);
+
+  virtual Result BuildPipelines(unsigned itemCount, PipelineBuildItem *items, unsigned threadCount,
+                                PipelineBuildCallback callback, void *userData);
+
+  virtual Result BuildPipelineAsync(PipelineBuildItem *item, PipelineBuildPriority priority,
+                                    IPipelineBuildTask **task);
+
+  virtual void GetCacheStatistics(CompilerCacheStatistics *statistics) const;
+
   Result buildGraphicsPipelineInternal(GraphicsContext *graphicsContext,
                                        llvm::ArrayRef<const PipelineShaderInfo *> shaderInfo,
                                        bool buildingRelocatableElf, ElfPackage *pipelineElf,
@@ -154,7 +171,7 @@ public:
   void updateShaderCache(bool insert, const BinaryData *elfBin, ShaderCache *shaderCache, CacheEntryHandle phEntry);
 
   Vkgc::Result lookUpCaches(Vkgc::ICache *appPipelineCache, Vkgc::HashId *cacheHash, BinaryData *elfBin,
-                            Vkgc::EntryHandle *entryHandle);
+                            Vkgc::EntryHandle *entryHandle, std::vector<uint8_t> *elfData);
 
   void ReleaseCacheEntry(bool withValue, const BinaryData *elfBin, Vkgc::EntryHandle *entryHandle);
 
@@ -175,10 +192,14 @@ private:
   void releaseContext(Context *context) const;
 
   bool runPasses(lgc::PassManager *passMgr, llvm::Module *module) const;
+  Result buildShadersInParallel(Context *context, lgc::Pipeline *pipeline,
+                                llvm::ArrayRef<const PipelineShaderInfo *> shaderInfo,
+                                llvm::MutableArrayRef<llvm::Module *> modules, unsigned *stageSkipMask);
   void linkRelocatableShaderElf(ElfPackage *shaderElfs, ElfPackage *pipelineElf, Context *context);
   bool canUseRelocatableGraphicsShaderElf(const llvm::ArrayRef<const PipelineShaderInfo *> &shaderInfo,
                                           const GraphicsPipelineBuildInfo *pipelineInfo);
   bool canUseRelocatableComputeShaderElf(const ComputePipelineBuildInfo *pipelineInfo);
+  void recordCacheAccesses(CacheAccessInfo pipelineCacheAccess, llvm::ArrayRef<CacheAccessInfo> stageCacheAccesses);
 
   std::vector<std::string> m_options;           // Compilation options
   MetroHash::Hash m_optionHash;                 // Hash code of compilation options
@@ -187,9 +208,17 @@ private:
   static unsigned m_instanceCount;              // The count of compiler instance
   static unsigned m_outRedirectCount;           // The count of output redirect
   ShaderCachePtr m_shaderCache;                 // Shader cache
-  static llvm::sys::Mutex m_contextPoolMutex;   // Mutex for context pool access
-  static std::vector<Context *> *m_contextPool; // Context pool
+  static llvm::sys::Mutex m_contextPoolMutex;   // Mutex for context pool creation and destruction
+  static ContextPool *m_contextPool;            // Context pool
   unsigned m_relocatablePipelineCompilations;   // The number of pipelines compiled using relocatable shader elf
+  llvm::sys::Mutex m_buildSchedulerMutex;       // Mutex for creating the scheduler of asynchronous builds and the
+                                                // threads of batch builds
+  PipelineBuildScheduler *m_buildScheduler;     // Scheduler of asynchronous builds, created on first use
+  llvm::ThreadPool *m_batchBuildThreads;        // Threads that BuildPipelines runs builds on, created on first use
+
+  // Counts of the cache access results of pipeline builds, and of the shader stages built with relocatable shader elf
+  std::atomic<uint64_t> m_pipelineCacheAccesses[CacheAccessInfoCount] = {};
+  std::atomic<uint64_t> m_stageCacheAccesses[ShaderStageCount][CacheAccessInfoCount] = {};
 };
 
 // Convert front-end LLPC shader stage to middle-end LGC shader stage
@@ -74,6 +74,10 @@ void Context::reset() {
   m_pipelineContext = nullptr;
   delete m_builder;
   m_builder = nullptr;
+
+  // Let other contexts for the same GPU use the target machine while this one is idle.
+  if (m_builderContext)
+    m_builderContext->releaseTargetMachine();
 }
 
 // =====================================================================================================================
@@ -42,6 +42,17 @@
 
 namespace Llpc {
 
+// Represents the memory usage of a context, measured by the context pool from the growth of the heap while the context
+// is in use.
+struct ContextMemoryUsage {
+  size_t retainedBytes;      // Estimated size of the memory retained by the context between pipeline compilations
+  size_t measuredBytes;      // Total retained memory growth of the uses that were measured exactly
+  unsigned measuredUseCount; // Count of the uses that were measured exactly
+  size_t acquireHeapBytes;   // Size of the heap in use when the context was acquired
+  uint64_t acquireEpoch;     // Count of contexts acquired from the pool when the context was acquired
+  bool acquiredAlone;        // Whether no other context was in use when the context was acquired
+};
+
 // =====================================================================================================================
 // Represents LLPC context for pipeline compilation. Derived from the base class llvm::LLVMContext.
 class Context : public llvm::LLVMContext {
@@ -65,6 +76,9 @@ public:
   // Get the number of times this context is used.
   unsigned getUseCount() const { return m_useCount; }
 
+  // Gets the memory usage of this context, which is measured by the context pool.
+  ContextMemoryUsage &getMemoryUsage() { return m_memoryUsage; }
+
   // Attaches pipeline context to LLPC context.
   void attachPipelineContext(PipelineContext *pipelineContext) { m_pipelineContext = pipelineContext; }
 
@@ -147,7 +161,8 @@ private:
   bool m_scalarBlockLayout = false;                     // scalarBlockLayout option from last pipeline compile
   bool m_robustBufferAccess = false;                    // robustBufferAccess option from last pipeline compile
 
-  unsigned m_useCount = 0; // Number of times this context is used.
+  unsigned m_useCount = 0;                 // Number of times this context is used.
+  ContextMemoryUsage m_memoryUsage = {}; // Memory usage measured by the context pool
 };
 
 } // namespace Llpc
@@ -0,0 +1,357 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2021 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  llpcContextPool.cpp
+ * @brief LLPC source file: contains implementation of class Llpc::ContextPool.
+ ***********************************************************************************************************************
+ */
+#include "llpcContextPool.h"
+#include "llpcContext.h"
+#include "llvm/Support/CommandLine.h"
+#include <functional>
+#include <thread>
+
+#ifdef WIN_OS
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#define DEBUG_TYPE "llpc-context-pool"
+
+using namespace llvm;
+
+namespace llvm {
+namespace cl {
+
+extern opt<int> ContextReuseLimit;
+
+extern opt<unsigned> ContextMemoryLimit;
+
+extern opt<unsigned> ContextPoolMemoryBudget;
+
+} // namespace cl
+} // namespace llvm
+
+namespace Llpc {
+
+// Context released last by the current thread, and the slot of the free list it was put in. The context may have been
+// taken by another thread or deleted since; it is only used if the slot still holds it.
+static thread_local Context *LastReleasedContext = nullptr;
+static thread_local unsigned LastReleasedSlot = 0;
+
+// =====================================================================================================================
+// Gets the slot of a free list that the current thread starts scanning from, which is spread over the slots by hashing
+// the ID of the thread.
+//
+// @param slotCount : Count of slots in a free list
+static unsigned getThreadStartSlot(unsigned slotCount) {
+  static thread_local unsigned ThreadStartSlot = static_cast<unsigned>(
+      (std::hash<std::thread::id>()(std::this_thread::get_id()) * 0x9E3779B97F4A7C15ull) >> 32);
+  return ThreadStartSlot % slotCount;
+}
+
+// =====================================================================================================================
+// Gets the size of the heap memory in use by the process, or 0 if it can't be measured on this platform.
+static size_t getHeapUsedBytes() {
+#ifdef WIN_OS
+  PROCESS_MEMORY_COUNTERS_EX counters = {};
+  if (GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS *>(&counters),
+                           sizeof(counters)))
+    return counters.PrivateUsage;
+  return 0;
+#elif defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 33)
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+#else
+  struct mallinfo info = mallinfo();
+  return static_cast<unsigned>(info.uordblks) + static_cast<unsigned>(info.hblkhd);
+#endif
+#else
+  return 0;
+#endif
+}
+
+// =====================================================================================================================
+ContextPool::ContextPool() : m_canMeasureMemory(getHeapUsedBytes() != 0) {
+}
+
+// =====================================================================================================================
+ContextPool::~ContextPool() {
+  for (std::atomic<FreeList *> &freeListSlot : m_freeLists) {
+    FreeList *freeList = freeListSlot.load();
+    if (!freeList)
+      continue;
+    for (std::atomic<Context *> &slot : freeList->slots)
+      delete slot.load();
+    delete freeList;
+  }
+}
+
+// =====================================================================================================================
+// Gets the free list of contexts of the specified GFXIP, adding it if it is the first time the GFXIP is used. Returns
+// nullptr if there are already free lists for too many GFXIPs.
+//
+// @param gfxIp : Graphics IP version
+ContextPool::FreeList *ContextPool::getFreeList(GfxIpVersion gfxIp) {
+  // A free list is never removed and its GFXIP is set before it is published, so it can be looked up without a lock.
+  for (std::atomic<FreeList *> &freeListSlot : m_freeLists) {
+    FreeList *freeList = freeListSlot.load(std::memory_order_acquire);
+    if (!freeList)
+      break;
+    if (freeList->gfxIp == gfxIp)
+      return freeList;
+  }
+
+  std::lock_guard<std::mutex> lock(m_freeListLock);
+  for (std::atomic<FreeList *> &freeListSlot : m_freeLists) {
+    FreeList *freeList = freeListSlot.load(std::memory_order_relaxed);
+    if (!freeList) {
+      freeList = new FreeList();
+      freeList->gfxIp = gfxIp;
+      freeListSlot.store(freeList, std::memory_order_release);
+      return freeList;
+    }
+    if (freeList->gfxIp == gfxIp)
+      return freeList;
+  }
+  return nullptr;
+}
+
+// =====================================================================================================================
+// Acquires a free context of the specified GFXIP from the pool, creating one if there is none.
+//
+// @param gfxIp : Graphics IP version
+Context *ContextPool::acquireContext(GfxIpVersion gfxIp) {
+  Context *context = nullptr;
+  FreeList *freeList = getFreeList(gfxIp);
+
+  if (freeList) {
+    // Try to get back the context released last by this thread first.
+    Context *lastContext = LastReleasedContext;
+    if (lastContext && freeList->slots[LastReleasedSlot].compare_exchange_strong(lastContext, nullptr)) {
+      context = lastContext;
+      m_affinityHitCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Otherwise take any free context, if there is one.
+    unsigned startSlot = getThreadStartSlot(MaxFreeContexts);
+    for (unsigned slotCount = 0;
+         !context && slotCount < MaxFreeContexts && freeList->freeCount.load(std::memory_order_relaxed) != 0;
+         ++slotCount) {
+      unsigned slotIdx = (startSlot + slotCount) % MaxFreeContexts;
+      if (freeList->slots[slotIdx].load(std::memory_order_relaxed))
+        context = freeList->slots[slotIdx].exchange(nullptr);
+    }
+    if (context)
+      freeList->freeCount.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // Free up context if it is being used too many times to avoid consuming too much memory. This is the only limit if
+  // the memory retained by contexts can't be measured on this platform, and a backstop for the estimates otherwise.
+  int contextReuseLimit = cl::ContextReuseLimit.getValue();
+  if (context && contextReuseLimit > 0 &&
+      context->getUseCount() > static_cast<unsigned>(contextReuseLimit)) {
+    deleteContext(context);
+    m_recycleCount.fetch_add(1, std::memory_order_relaxed);
+    context = nullptr;
+  }
+
+  if (!context) {
+    // Create a new one if we fail to find an available one
+    context = new Context(gfxIp);
+    m_createCount.fetch_add(1, std::memory_order_relaxed);
+    m_residentCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  context->setInUse(true);
+  uint64_t inUseCount = m_inUseCount.fetch_add(1, std::memory_order_relaxed) + 1;
+  uint64_t peakInUseCount = m_peakInUseCount.load(std::memory_order_relaxed);
+  while (inUseCount > peakInUseCount &&
+         !m_peakInUseCount.compare_exchange_weak(peakInUseCount, inUseCount, std::memory_order_relaxed))
+    ;
+
+  ContextMemoryUsage &memoryUsage = context->getMemoryUsage();
+  memoryUsage.acquireEpoch = m_acquireCount.fetch_add(1, std::memory_order_relaxed) + 1;
+  memoryUsage.acquiredAlone = inUseCount == 1;
+  // The heap is only sampled when the sample can be used, as it is costly with some allocators (mallinfo2 walks the
+  // arenas of glibc).
+  memoryUsage.acquireHeapBytes = m_canMeasureMemory && memoryUsage.acquiredAlone ? getHeapUsedBytes() : 0;
+
+  return context;
+}
+
+// =====================================================================================================================
+// Measures the growth of the memory retained by a context during its last use, which has ended. The growth of the heap
+// is only attributed to the context if no other context was in use meanwhile; otherwise the growth is estimated from
+// the uses of the context (or of all contexts) that were measured.
+//
+// NOTE: The heap is that of the whole process, so anything else the process allocates and keeps during a measured use
+// (in the client or in other LLPC objects such as the shader cache) is charged to the context too. That can make a
+// context be recycled early, but never kept when it retains too much; -context-reuse-limit also bounds the reuse of a
+// context whatever its estimate.
+//
+// @param [in/out] context : LLPC context, which has been reset
+void ContextPool::measureRetainedMemory(Context *context) {
+  ContextMemoryUsage &memoryUsage = context->getMemoryUsage();
+  size_t growth = 0;
+  if (memoryUsage.acquiredAlone && m_inUseCount.load(std::memory_order_relaxed) == 1 &&
+      m_acquireCount.load(std::memory_order_relaxed) == memoryUsage.acquireEpoch) {
+    size_t heapBytes = getHeapUsedBytes();
+    growth = heapBytes > memoryUsage.acquireHeapBytes ? heapBytes - memoryUsage.acquireHeapBytes : 0;
+    memoryUsage.measuredBytes += growth;
+    ++memoryUsage.measuredUseCount;
+    m_measuredBytes.fetch_add(growth, std::memory_order_relaxed);
+    m_measuredUseCount.fetch_add(1, std::memory_order_relaxed);
+  } else if (memoryUsage.measuredUseCount > 0)
+    growth = memoryUsage.measuredBytes / memoryUsage.measuredUseCount;
+  else {
+    uint64_t measuredUseCount = m_measuredUseCount.load(std::memory_order_relaxed);
+    if (measuredUseCount > 0)
+      growth = m_measuredBytes.load(std::memory_order_relaxed) / measuredUseCount;
+  }
+
+  memoryUsage.retainedBytes += growth;
+  m_retainedBytes.fetch_add(growth, std::memory_order_relaxed);
+}
+
+// =====================================================================================================================
+// Deletes a context that is not in a free list.
+//
+// @param context : LLPC context
+void ContextPool::deleteContext(Context *context) {
+  m_retainedBytes.fetch_sub(context->getMemoryUsage().retainedBytes, std::memory_order_relaxed);
+  m_residentCount.fetch_sub(1, std::memory_order_relaxed);
+  delete context;
+}
+
+// =====================================================================================================================
+// Releases a context acquired from the pool, putting it in the free list of its GFXIP.
+//
+// The context is recycled (deleted, so a new one is created when needed) if the memory it retains exceeds
+// -context-memory-limit, or if the contexts of the pool retain more memory than -context-pool-memory-budget and it
+// retains more than the average context. Other free contexts are recycled too while the pool is over budget, so a
+// warm context is only thrown away when the memory of the pool must be reduced.
+//
+// @param context : LLPC context
+void ContextPool::releaseContext(Context *context) {
+  context->reset();
+  if (m_canMeasureMemory)
+    measureRetainedMemory(context);
+  context->setInUse(false);
+  m_inUseCount.fetch_sub(1, std::memory_order_relaxed);
+
+  const uint64_t memoryLimit = uint64_t(cl::ContextMemoryLimit) << 20;
+  const uint64_t memoryBudget = uint64_t(cl::ContextPoolMemoryBudget) << 20;
+  size_t retainedBytes = context->getMemoryUsage().retainedBytes;
+  bool recycle = memoryLimit != 0 && retainedBytes > memoryLimit;
+  if (!recycle && memoryBudget != 0 && m_retainedBytes.load(std::memory_order_relaxed) > memoryBudget)
+    recycle = retainedBytes * m_residentCount.load(std::memory_order_relaxed) >=
+              m_retainedBytes.load(std::memory_order_relaxed);
+
+  bool released = false;
+  FreeList *freeList = recycle ? nullptr : getFreeList(context->getGfxIpVersion());
+  unsigned startSlot = getThreadStartSlot(MaxFreeContexts);
+  for (unsigned slotCount = 0; freeList && !released && slotCount < MaxFreeContexts; ++slotCount) {
+    unsigned slotIdx = (startSlot + slotCount) % MaxFreeContexts;
+    Context *freeSlot = nullptr;
+    if (freeList->slots[slotIdx].load(std::memory_order_relaxed) == nullptr &&
+        freeList->slots[slotIdx].compare_exchange_strong(freeSlot, context)) {
+      freeList->freeCount.fetch_add(1, std::memory_order_relaxed);
+      LastReleasedContext = context;
+      LastReleasedSlot = slotIdx;
+      released = true;
+    }
+  }
+
+  if (!released) {
+    deleteContext(context);
+    if (recycle)
+      m_recycleCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Recycle other free contexts while the pool is over budget.
+  if (memoryBudget != 0) {
+    for (std::atomic<FreeList *> &freeListSlot : m_freeLists) {
+      FreeList *otherFreeList = freeListSlot.load(std::memory_order_acquire);
+      if (!otherFreeList)
+        break;
+      for (std::atomic<Context *> &slot : otherFreeList->slots) {
+        if (m_retainedBytes.load(std::memory_order_relaxed) <= memoryBudget)
+          return;
+        if (slot.load(std::memory_order_relaxed) == context)
+          continue;
+        Context *freeContext = slot.exchange(nullptr);
+        if (freeContext) {
+          otherFreeList->freeCount.fetch_sub(1, std::memory_order_relaxed);
+          deleteContext(freeContext);
+          m_recycleCount.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    }
+  }
+}
+
+// =====================================================================================================================
+// Deletes free contexts until the count of contexts held by the pool is no more than the specified count.
+//
+// @param maxResidentContexts : Maximum count of contexts to keep in the pool
+void ContextPool::trim(uint64_t maxResidentContexts) {
+  for (std::atomic<FreeList *> &freeListSlot : m_freeLists) {
+    FreeList *freeList = freeListSlot.load(std::memory_order_acquire);
+    if (!freeList)
+      break;
+    for (std::atomic<Context *> &slot : freeList->slots) {
+      if (m_residentCount.load(std::memory_order_relaxed) <= maxResidentContexts)
+        return;
+      Context *context = slot.exchange(nullptr);
+      if (context) {
+        freeList->freeCount.fetch_sub(1, std::memory_order_relaxed);
+        deleteContext(context);
+      }
+    }
+  }
+}
+
+// =====================================================================================================================
+// Gets the statistics of the pool.
+//
+// @param [out] statistics : Context pool statistics
+void ContextPool::getStatistics(ContextPoolStatistics *statistics) const {
+  statistics->acquireCount = m_acquireCount.load(std::memory_order_relaxed);
+  statistics->affinityHitCount = m_affinityHitCount.load(std::memory_order_relaxed);
+  statistics->createCount = m_createCount.load(std::memory_order_relaxed);
+  statistics->residentCount = m_residentCount.load(std::memory_order_relaxed);
+  statistics->inUseCount = m_inUseCount.load(std::memory_order_relaxed);
+  statistics->peakInUseCount = m_peakInUseCount.load(std::memory_order_relaxed);
+  statistics->retainedBytes = m_retainedBytes.load(std::memory_order_relaxed);
+  statistics->recycleCount = m_recycleCount.load(std::memory_order_relaxed);
+}
+
+} // namespace Llpc
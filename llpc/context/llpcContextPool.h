@@ -0,0 +1,101 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2021 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  llpcContextPool.h
+ * @brief LLPC header file: contains declaration of class Llpc::ContextPool.
+ ***********************************************************************************************************************
+ */
+#pragma once
+
+#include "llpc.h"
+#include <atomic>
+#include <mutex>
+
+namespace Llpc {
+
+class Context;
+
+// =====================================================================================================================
+// Represents the pool of LLPC contexts shared by all compilers.
+//
+// Free contexts are kept in a free list per GFXIP, which is an array of slots that contexts are put in and taken from
+// with atomic operations, so acquiring and releasing a context never takes a lock. A thread first tries to get back
+// the context it released last, which already has its LgcContext and target machine created and is likely to be warm
+// in the caches of the core it runs on. Otherwise it scans the slots from a start slot of its own, so that concurrent
+// threads do not all contend for the first slots, and it does not scan at all for a context when the list is empty.
+//
+// The pool also measures the memory each context retains between pipeline compilations, and recycles contexts that
+// retain too much memory (see releaseContext). The measurement is of the heap of the whole process, so it is an upper
+// bound (see measureRetainedMemory); contexts are also recycled after -context-reuse-limit uses.
+class ContextPool {
+public:
+  ContextPool();
+  ~ContextPool();
+
+  Context *acquireContext(GfxIpVersion gfxIp);
+  void releaseContext(Context *context);
+
+  void trim(uint64_t maxResidentContexts);
+
+  void getStatistics(ContextPoolStatistics *statistics) const;
+
+private:
+  ContextPool(const ContextPool &) = delete;
+  ContextPool &operator=(const ContextPool &) = delete;
+
+  static constexpr unsigned MaxFreeContexts = 128; // Maximum count of free contexts kept per GFXIP
+  static constexpr unsigned MaxFreeLists = 16;     // Maximum count of GFXIPs with a free list
+
+  // Represents the free contexts of one GFXIP. A slot holds a free context or nullptr.
+  struct FreeList {
+    GfxIpVersion gfxIp;                            // Graphics IP version of the contexts
+    std::atomic<unsigned> freeCount;               // Count of the slots holding a free context, only a hint as it is
+                                                   // updated after the slot
+    std::atomic<Context *> slots[MaxFreeContexts]; // Slots of free contexts
+  };
+
+  FreeList *getFreeList(GfxIpVersion gfxIp);
+  void measureRetainedMemory(Context *context);
+  void deleteContext(Context *context);
+
+  std::mutex m_freeListLock;                              // Lock for adding the free list of a GFXIP
+  std::atomic<FreeList *> m_freeLists[MaxFreeLists] = {}; // Free list of each GFXIP used so far
+
+  std::atomic<uint64_t> m_acquireCount = {};     // Count of contexts acquired
+  std::atomic<uint64_t> m_affinityHitCount = {}; // Count of contexts acquired that the thread had released last
+  std::atomic<uint64_t> m_createCount = {};      // Count of contexts created
+  std::atomic<uint64_t> m_residentCount = {};    // Count of contexts held by the pool, in use or free
+  std::atomic<uint64_t> m_inUseCount = {};       // Count of contexts in use
+  std::atomic<uint64_t> m_peakInUseCount = {};   // Maximum count of contexts in use at the same time
+  std::atomic<uint64_t> m_recycleCount = {};     // Count of contexts recycled because of the memory they retain
+
+  const bool m_canMeasureMemory;                 // Whether the memory retained by contexts can be measured
+  std::atomic<uint64_t> m_retainedBytes = {};    // Estimated size of the memory retained by the contexts of the pool
+  std::atomic<uint64_t> m_measuredBytes = {};    // Total retained memory growth of the uses measured exactly
+  std::atomic<uint64_t> m_measuredUseCount = {}; // Count of the uses measured exactly
+};
+
+} // namespace Llpc
@@ -0,0 +1,300 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2021 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  llpcPipelineBuildTask.cpp
+ * @brief LLPC source file: contains implementation of classes Llpc::PipelineBuildTask and Llpc::PipelineBuildScheduler.
+ ***********************************************************************************************************************
+ */
+#include "llpcPipelineBuildTask.h"
+#include <algorithm>
+
+#define DEBUG_TYPE "llpc-pipeline-build-task"
+
+namespace Llpc {
+
+// Asynchronous build running on the current thread, if any.
+static thread_local PipelineBuildTask *CurrentTask = nullptr;
+
+// Whether the build running on the current thread is counted as a foreground build.
+static thread_local bool InForegroundBuild = false;
+
+// Count of the foreground builds running in the process, which background builds wait for. It is changed with
+// ForegroundLock held, and ForegroundChanged is signaled when it drops to 0 or when a paused build may have to resume.
+// It is atomic so that a background build can check it between passes without taking the lock.
+static std::mutex ForegroundLock;
+static std::condition_variable ForegroundChanged;
+static std::atomic<unsigned> ForegroundBuildCount(0);
+
+// =====================================================================================================================
+// Counts the build running on the current thread as a foreground build.
+static void enterForegroundBuild() {
+  std::lock_guard<std::mutex> lock(ForegroundLock);
+  ++ForegroundBuildCount;
+  InForegroundBuild = true;
+}
+
+// =====================================================================================================================
+// Stops counting the build running on the current thread as a foreground build, resuming the paused background builds
+// if it was the last one.
+static void leaveForegroundBuild() {
+  std::lock_guard<std::mutex> lock(ForegroundLock);
+  InForegroundBuild = false;
+  if (--ForegroundBuildCount == 0)
+    ForegroundChanged.notify_all();
+}
+
+// =====================================================================================================================
+// Wakes the paused background builds, so they check whether they have been raised to foreground or cancelled.
+static void notifyForegroundChanged() {
+  std::lock_guard<std::mutex> lock(ForegroundLock);
+  ForegroundChanged.notify_all();
+}
+
+// =====================================================================================================================
+//
+// @param compiler : Compiler that started the build
+// @param scheduler : Scheduler the build is queued in
+// @param item : Pipeline to build
+// @param priority : Initial priority of the build
+PipelineBuildTask::PipelineBuildTask(ICompiler *compiler, PipelineBuildScheduler *scheduler, PipelineBuildItem *item,
+                                     PipelineBuildPriority priority)
+    : m_compiler(compiler), m_scheduler(scheduler), m_item(item), m_priority(priority), m_cancelled(false) {
+}
+
+// =====================================================================================================================
+// Changes the priority of the build.
+//
+// @param priority : New priority of the build
+void PipelineBuildTask::SetPriority(PipelineBuildPriority priority) {
+  m_priority.store(priority, std::memory_order_relaxed);
+  notifyForegroundChanged();
+}
+
+// =====================================================================================================================
+// Requests cancellation of the build. A queued build is completed right away; a running one stops at its next
+// cancellation point.
+void PipelineBuildTask::Cancel() {
+  m_cancelled.store(true, std::memory_order_relaxed);
+  if (m_scheduler->remove(this))
+    complete(Result::Aborted);
+  else
+    notifyForegroundChanged();
+}
+
+// =====================================================================================================================
+// Checks whether the build has completed.
+bool PipelineBuildTask::IsDone() const {
+  std::lock_guard<std::mutex> lock(m_stateLock);
+  return m_state == State::Done;
+}
+
+// =====================================================================================================================
+// Waits for the build to complete, running it on this thread with foreground priority if it has not been started.
+Result PipelineBuildTask::Wait() {
+  if (m_scheduler->remove(this)) {
+    m_priority.store(PipelineBuildPriority::Foreground, std::memory_order_relaxed);
+    run();
+  }
+
+  std::unique_lock<std::mutex> lock(m_stateLock);
+  m_stateChanged.wait(lock, [this] { return m_state == State::Done; });
+  return m_item->result;
+}
+
+// =====================================================================================================================
+// Cancels the build if it has not completed, waits for it, and destroys the task.
+void PipelineBuildTask::Destroy() {
+  Cancel();
+  Wait();
+  delete this;
+}
+
+// =====================================================================================================================
+// Called between the passes of the build. A background build pauses here while foreground builds are running. Once
+// the build has been raised to foreground, it is counted as a foreground build itself. The lock is only taken when the
+// build has to pause, or to count it as a foreground build.
+//
+// @returns : False if the build has been cancelled
+bool PipelineBuildTask::check() {
+  if (isForeground()) {
+    if (!m_countedForeground) {
+      enterForegroundBuild();
+      m_countedForeground = true;
+    }
+  } else if (!m_countedForeground && ForegroundBuildCount.load(std::memory_order_relaxed) != 0) {
+    std::unique_lock<std::mutex> lock(ForegroundLock);
+    ForegroundChanged.wait(lock, [this] { return ForegroundBuildCount == 0 || isForeground() || isCancelled(); });
+  }
+  return !isCancelled();
+}
+
+// =====================================================================================================================
+// Runs the build on the current thread. The task must have been taken out of the queue of the scheduler.
+void PipelineBuildTask::run() {
+  {
+    std::lock_guard<std::mutex> lock(m_stateLock);
+    if (m_state != State::Queued)
+      return;
+    m_state = State::Running;
+  }
+
+  CurrentTask = this;
+  if (isForeground()) {
+    enterForegroundBuild();
+    m_countedForeground = true;
+  }
+
+  Result result = Result::Aborted;
+  if (!isCancelled()) {
+    if (m_item->pGraphicsInfo)
+      result = m_compiler->BuildGraphicsPipeline(m_item->pGraphicsInfo, m_item->pGraphicsOut);
+    else
+      result = m_compiler->BuildComputePipeline(m_item->pComputeInfo, m_item->pComputeOut);
+  }
+
+  if (m_countedForeground) {
+    leaveForegroundBuild();
+    m_countedForeground = false;
+  }
+  CurrentTask = nullptr;
+  complete(result);
+}
+
+// =====================================================================================================================
+// Sets the result of the build and wakes the threads waiting for it.
+//
+// @param result : Result of the build
+void PipelineBuildTask::complete(Result result) {
+  m_item->result = result;
+  std::lock_guard<std::mutex> lock(m_stateLock);
+  m_state = State::Done;
+  m_stateChanged.notify_all();
+}
+
+// =====================================================================================================================
+// Gets the asynchronous build running on the current thread, or nullptr if there is none.
+PipelineBuildTask *PipelineBuildTask::getCurrent() {
+  return CurrentTask;
+}
+
+// =====================================================================================================================
+//
+// @param threadCount : Count of threads to run the builds on, 0 for the count of hardware threads
+PipelineBuildScheduler::PipelineBuildScheduler(unsigned threadCount) {
+  if (threadCount == 0)
+    threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+  for (unsigned threadIdx = 0; threadIdx < threadCount; ++threadIdx)
+    m_threads.emplace_back(&PipelineBuildScheduler::runWorker, this);
+}
+
+// =====================================================================================================================
+// Stops the threads of the scheduler once the builds they are running complete. The builds still queued are completed
+// as aborted.
+PipelineBuildScheduler::~PipelineBuildScheduler() {
+  std::deque<PipelineBuildTask *> queue;
+  {
+    std::lock_guard<std::mutex> lock(m_queueLock);
+    queue.swap(m_queue);
+    m_shutdown = true;
+    m_queueChanged.notify_all();
+  }
+
+  for (PipelineBuildTask *task : queue)
+    task->complete(Result::Aborted);
+  for (std::thread &thread : m_threads)
+    thread.join();
+}
+
+// =====================================================================================================================
+// Queues a build, to be run by the next free thread.
+//
+// @param task : Build to queue
+void PipelineBuildScheduler::enqueue(PipelineBuildTask *task) {
+  std::lock_guard<std::mutex> lock(m_queueLock);
+  m_queue.push_back(task);
+  m_queueChanged.notify_one();
+}
+
+// =====================================================================================================================
+// Takes a build out of the queue, so it is not started by a thread of the scheduler.
+//
+// @param task : Build to take out of the queue
+// @returns : True if the build was queued, false if it has been started already
+bool PipelineBuildScheduler::remove(PipelineBuildTask *task) {
+  std::lock_guard<std::mutex> lock(m_queueLock);
+  auto it = std::find(m_queue.begin(), m_queue.end(), task);
+  if (it == m_queue.end())
+    return false;
+  m_queue.erase(it);
+  return true;
+}
+
+// =====================================================================================================================
+// Runs queued builds until the scheduler shuts down, foreground builds first.
+void PipelineBuildScheduler::runWorker() {
+  for (;;) {
+    PipelineBuildTask *task = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(m_queueLock);
+      m_queueChanged.wait(lock, [this] { return m_shutdown || !m_queue.empty(); });
+      if (m_shutdown)
+        return;
+      auto it = std::find_if(m_queue.begin(), m_queue.end(),
+                             [](const PipelineBuildTask *queuedTask) { return queuedTask->isForeground(); });
+      if (it == m_queue.end())
+        it = m_queue.begin();
+      task = *it;
+      m_queue.erase(it);
+    }
+    task->run();
+  }
+}
+
+// =====================================================================================================================
+ForegroundBuildScope::ForegroundBuildScope() : m_entered(!CurrentTask && !InForegroundBuild) {
+  if (m_entered)
+    enterForegroundBuild();
+}
+
+// =====================================================================================================================
+ForegroundBuildScope::~ForegroundBuildScope() {
+  if (m_entered)
+    leaveForegroundBuild();
+}
+
+// =====================================================================================================================
+ForegroundBuildWaitScope::ForegroundBuildWaitScope() : m_suspended(InForegroundBuild) {
+  if (m_suspended)
+    leaveForegroundBuild();
+}
+
+// =====================================================================================================================
+ForegroundBuildWaitScope::~ForegroundBuildWaitScope() {
+  if (m_suspended)
+    enterForegroundBuild();
+}
+
+} // namespace Llpc
@@ -0,0 +1,149 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2021 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  llpcPipelineBuildTask.h
+ * @brief LLPC header file: contains declaration of classes Llpc::PipelineBuildTask and Llpc::PipelineBuildScheduler.
+ ***********************************************************************************************************************
+ */
+#pragma once
+
+#include "llpc.h"
+#include "lgc/PassManager.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Llpc {
+
+class PipelineBuildScheduler;
+
+// =====================================================================================================================
+// Represents a pipeline build started by ICompiler::BuildPipelineAsync.
+//
+// The build runs on a thread of the scheduler, or on the thread that waits for it if it has not been started by then.
+// While it runs, it is the checkpoint of the passes run in its LLVM context (see lgc::PassManager::setCheckpoint), so
+// between passes a background build pauses while foreground builds are running, and a cancelled build stops the run
+// of its pass manager. The compiler also checks for cancellation between the phases of the build.
+class PipelineBuildTask final : public IPipelineBuildTask, public lgc::PassCheckpoint {
+public:
+  PipelineBuildTask(ICompiler *compiler, PipelineBuildScheduler *scheduler, PipelineBuildItem *item,
+                    PipelineBuildPriority priority);
+
+  // Implementation of IPipelineBuildTask
+  void SetPriority(PipelineBuildPriority priority) override;
+  void Cancel() override;
+  bool IsDone() const override;
+  Result Wait() override;
+  void Destroy() override;
+
+  // Implementation of lgc::PassCheckpoint
+  bool check() override;
+
+  bool isForeground() const { return m_priority.load(std::memory_order_relaxed) == PipelineBuildPriority::Foreground; }
+  bool isCancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+
+  void run();
+  void complete(Result result);
+
+  static PipelineBuildTask *getCurrent();
+
+private:
+  PipelineBuildTask(const PipelineBuildTask &) = delete;
+  PipelineBuildTask &operator=(const PipelineBuildTask &) = delete;
+  ~PipelineBuildTask() override {}
+
+  // Enumerates the states of a build.
+  enum class State : unsigned {
+    Queued,  // Waiting for a thread to run it
+    Running, // Being built
+    Done,    // Completed, its result is set in the build item
+  };
+
+  ICompiler *m_compiler;                         // Compiler that started the build
+  PipelineBuildScheduler *m_scheduler;           // Scheduler the build is queued in
+  PipelineBuildItem *m_item;                     // Pipeline to build
+  std::atomic<PipelineBuildPriority> m_priority; // Current priority of the build
+  std::atomic<bool> m_cancelled;                 // Whether cancellation has been requested
+  bool m_countedForeground = false;              // Whether the running build counts as a foreground build
+  mutable std::mutex m_stateLock;                // Lock for the state
+  std::condition_variable m_stateChanged;        // Signaled when the build completes
+  State m_state = State::Queued;                 // State of the build
+};
+
+// =====================================================================================================================
+// Runs the pipeline builds started by ICompiler::BuildPipelineAsync on a pool of threads. Queued builds are started
+// foreground ones first, then in the order they were started.
+class PipelineBuildScheduler {
+public:
+  PipelineBuildScheduler(unsigned threadCount);
+  ~PipelineBuildScheduler();
+
+  void enqueue(PipelineBuildTask *task);
+  bool remove(PipelineBuildTask *task);
+
+private:
+  PipelineBuildScheduler(const PipelineBuildScheduler &) = delete;
+  PipelineBuildScheduler &operator=(const PipelineBuildScheduler &) = delete;
+
+  void runWorker();
+
+  std::mutex m_queueLock;                  // Lock for the queue
+  std::condition_variable m_queueChanged;  // Signaled when a build is queued or the scheduler shuts down
+  std::deque<PipelineBuildTask *> m_queue; // Builds waiting for a thread
+  bool m_shutdown = false;                 // Whether the scheduler is shutting down
+  std::vector<std::thread> m_threads;      // Threads running the builds
+};
+
+// =====================================================================================================================
+// Marks the pipeline build running on the current thread as a foreground build while it is in scope, so that
+// background builds pause between their passes until it is done. It has no effect on the thread of an asynchronous
+// build, whose priority decides whether it is a foreground build.
+class ForegroundBuildScope {
+public:
+  ForegroundBuildScope();
+  ~ForegroundBuildScope();
+
+private:
+  bool m_entered; // Whether this scope made the build a foreground build
+};
+
+// =====================================================================================================================
+// Suspends the foreground state of the pipeline build running on the current thread while it is in scope. It is used
+// when the build waits for another thread, e.g. for a cache entry being compiled by a background build, which would
+// otherwise stay paused.
+class ForegroundBuildWaitScope {
+public:
+  ForegroundBuildWaitScope();
+  ~ForegroundBuildWaitScope();
+
+private:
+  bool m_suspended; // Whether this scope suspended the foreground state of the build
+};
+
+} // namespace Llpc
@@ -122,6 +122,9 @@ public:
   // Gets pipeline hash code compacted to 64-bits.
   uint64_t getPipelineHashCode() const { return MetroHash::compact64(&m_pipelineHash); }
 
+  // Get the pipeline hash code without compacting it.
+  MetroHash::Hash getPipelineHashCodeWithoutCompact() const { return m_pipelineHash; }
+
   // Gets cache hash code compacted to 64-bits.
   uint64_t get64BitCacheHashCode() const { return MetroHash::compact64(&m_cacheHash); }
 
@@ -29,11 +29,16 @@
 ***********************************************************************************************************************
 */
 #include "llpcShaderCache.h"
+#include "llpcPipelineBuildTask.h"
 #include "vkgcUtil.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/DJB.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Process.h"
+#include <algorithm>
+#include <chrono>
 #include <string.h>
 
 #define DEBUG_TYPE "llpc-shader-cache"
@@ -43,6 +48,51 @@ using namespace llvm;
 static cl::opt<std::string> ShaderCacheFilename("shader-cache-filename", cl::desc("Filename for the shader cache"),
                                                 cl::value_desc("filename"), cl::init(""));
 
+// -shader-cache-map-file: map the on-disk shader cache file instead of reading it in read-only mode
+static cl::opt<bool> ShaderCacheMapFile("shader-cache-map-file",
+                                        cl::desc("Map the on-disk shader cache file into memory instead of reading it "
+                                                 "when the cache is read-only"),
+                                        cl::init(false));
+
+// -shader-cache-max-memory-size: maximum size of the shader data a shader cache holds in memory
+static cl::opt<unsigned>
+    ShaderCacheMaxMemorySize("shader-cache-max-memory-size",
+                             cl::desc("Maximum size in MB of the shader data a shader cache holds in memory, least "
+                                      "recently used shaders are evicted beyond it (0 for no limit)"),
+                             cl::value_desc("size"), cl::init(0));
+
+// -shader-cache-max-file-size: maximum size of the on-disk shader cache file
+static cl::opt<unsigned>
+    ShaderCacheMaxFileSize("shader-cache-max-file-size",
+                           cl::desc("Maximum size in MB of the on-disk shader cache file, least recently used shaders "
+                                    "are evicted and the file is compacted beyond it (0 for no limit)"),
+                           cl::value_desc("size"), cl::init(0));
+
+// -shader-cache-shared: share the on-disk shader cache file with other processes
+static cl::opt<bool> ShaderCacheShared("shader-cache-shared",
+                                       cl::desc("Share the on-disk shader cache file with other processes, which wait "
+                                                "for the shaders being compiled by each other"),
+                                       cl::init(false));
+
+// -shader-cache-in-flight-timeout: maximum time to wait for a shader that another process is compiling
+static cl::opt<unsigned> ShaderCacheInFlightTimeout(
+    "shader-cache-in-flight-timeout",
+    cl::desc("Maximum time in milliseconds to wait for a shader that another process sharing the on-disk shader cache "
+             "file is compiling, before compiling it as well"),
+    cl::value_desc("time"), cl::init(10000));
+
+namespace llvm {
+namespace cl {
+
+// -shader-cache-compression: compress the shader data stored in shader caches
+opt<bool>
+    ShaderCacheCompression("shader-cache-compression",
+                           desc("Compress the shader data stored in shader caches when it makes the data smaller"),
+                           init(false));
+
+} // namespace cl
+} // namespace llvm
+
 namespace Llpc {
 
 #if defined(__unix__)
@@ -53,67 +103,84 @@ static const char CacheFileSubPath[] = "\\AMD\\LlpcCache\\";
 
 static const char ClientStr[] = "LLPC";
 
-static constexpr uint64_t CrcWidth = sizeof(uint64_t) * 8;
+// Reflected ECMA-182 polynomial of the 64-bit CRC (as in CRC-64/XZ)
+static constexpr uint64_t CrcPolynomial = 0xC96C5795D7870F42;
 static constexpr uint64_t CrcInitialValue = 0xFFFFFFFFFFFFFFFF;
 
-static const uint64_t CrcLookup[256] = {
-    0x0000000000000000, 0xAD93D23594C935A9, 0xF6B4765EBD5B5EFB, 0x5B27A46B29926B52, 0x40FB3E88EE7F885F,
-    0xED68ECBD7AB6BDF6, 0xB64F48D65324D6A4, 0x1BDC9AE3C7EDE30D, 0x81F67D11DCFF10BE, 0x2C65AF2448362517,
-    0x77420B4F61A44E45, 0xDAD1D97AF56D7BEC, 0xC10D4399328098E1, 0x6C9E91ACA649AD48, 0x37B935C78FDBC61A,
-    0x9A2AE7F21B12F3B3, 0xAE7F28162D3714D5, 0x03ECFA23B9FE217C, 0x58CB5E48906C4A2E, 0xF5588C7D04A57F87,
-    0xEE84169EC3489C8A, 0x4317C4AB5781A923, 0x183060C07E13C271, 0xB5A3B2F5EADAF7D8, 0x2F895507F1C8046B,
-    0x821A8732650131C2, 0xD93D23594C935A90, 0x74AEF16CD85A6F39, 0x6F726B8F1FB78C34, 0xC2E1B9BA8B7EB99D,
-    0x99C61DD1A2ECD2CF, 0x3455CFE43625E766, 0xF16D8219CEA71C03, 0x5CFE502C5A6E29AA, 0x07D9F44773FC42F8,
-    0xAA4A2672E7357751, 0xB196BC9120D8945C, 0x1C056EA4B411A1F5, 0x4722CACF9D83CAA7, 0xEAB118FA094AFF0E,
-    0x709BFF0812580CBD, 0xDD082D3D86913914, 0x862F8956AF035246, 0x2BBC5B633BCA67EF, 0x3060C180FC2784E2,
-    0x9DF313B568EEB14B, 0xC6D4B7DE417CDA19, 0x6B4765EBD5B5EFB0, 0x5F12AA0FE39008D6, 0xF281783A77593D7F,
-    0xA9A6DC515ECB562D, 0x04350E64CA026384, 0x1FE994870DEF8089, 0xB27A46B29926B520, 0xE95DE2D9B0B4DE72,
-    0x44CE30EC247DEBDB, 0xDEE4D71E3F6F1868, 0x7377052BABA62DC1, 0x2850A14082344693, 0x85C3737516FD733A,
-    0x9E1FE996D1109037, 0x338C3BA345D9A59E, 0x68AB9FC86C4BCECC, 0xC5384DFDF882FB65, 0x4F48D60609870DAF,
-    0xE2DB04339D4E3806, 0xB9FCA058B4DC5354, 0x146F726D201566FD, 0x0FB3E88EE7F885F0, 0xA2203ABB7331B059,
-    0xF9079ED05AA3DB0B, 0x54944CE5CE6AEEA2, 0xCEBEAB17D5781D11, 0x632D792241B128B8, 0x380ADD49682343EA,
-    0x95990F7CFCEA7643, 0x8E45959F3B07954E, 0x23D647AAAFCEA0E7, 0x78F1E3C1865CCBB5, 0xD56231F41295FE1C,
-    0xE137FE1024B0197A, 0x4CA42C25B0792CD3, 0x1783884E99EB4781, 0xBA105A7B0D227228, 0xA1CCC098CACF9125,
-    0x0C5F12AD5E06A48C, 0x5778B6C67794CFDE, 0xFAEB64F3E35DFA77, 0x60C18301F84F09C4, 0xCD5251346C863C6D,
-    0x9675F55F4514573F, 0x3BE6276AD1DD6296, 0x203ABD891630819B, 0x8DA96FBC82F9B432, 0xD68ECBD7AB6BDF60,
-    0x7B1D19E23FA2EAC9, 0xBE25541FC72011AC, 0x13B6862A53E92405, 0x489122417A7B4F57, 0xE502F074EEB27AFE,
-    0xFEDE6A97295F99F3, 0x534DB8A2BD96AC5A, 0x086A1CC99404C708, 0xA5F9CEFC00CDF2A1, 0x3FD3290E1BDF0112,
-    0x9240FB3B8F1634BB, 0xC9675F50A6845FE9, 0x64F48D65324D6A40, 0x7F281786F5A0894D, 0xD2BBC5B36169BCE4,
-    0x899C61D848FBD7B6, 0x240FB3EDDC32E21F, 0x105A7C09EA170579, 0xBDC9AE3C7EDE30D0, 0xE6EE0A57574C5B82,
-    0x4B7DD862C3856E2B, 0x50A1428104688D26, 0xFD3290B490A1B88F, 0xA61534DFB933D3DD, 0x0B86E6EA2DFAE674,
-    0x91AC011836E815C7, 0x3C3FD32DA221206E, 0x671877468BB34B3C, 0xCA8BA5731F7A7E95, 0xD1573F90D8979D98,
-    0x7CC4EDA54C5EA831, 0x27E349CE65CCC363, 0x8A709BFBF105F6CA, 0x9E91AC0C130E1B5E, 0x33027E3987C72EF7,
-    0x6825DA52AE5545A5, 0xC5B608673A9C700C, 0xDE6A9284FD719301, 0x73F940B169B8A6A8, 0x28DEE4DA402ACDFA,
-    0x854D36EFD4E3F853, 0x1F67D11DCFF10BE0, 0xB2F403285B383E49, 0xE9D3A74372AA551B, 0x44407576E66360B2,
-    0x5F9CEF95218E83BF, 0xF20F3DA0B547B616, 0xA92899CB9CD5DD44, 0x04BB4BFE081CE8ED, 0x30EE841A3E390F8B,
-    0x9D7D562FAAF03A22, 0xC65AF24483625170, 0x6BC9207117AB64D9, 0x7015BA92D04687D4, 0xDD8668A7448FB27D,
-    0x86A1CCCC6D1DD92F, 0x2B321EF9F9D4EC86, 0xB118F90BE2C61F35, 0x1C8B2B3E760F2A9C, 0x47AC8F555F9D41CE,
-    0xEA3F5D60CB547467, 0xF1E3C7830CB9976A, 0x5C7015B69870A2C3, 0x0757B1DDB1E2C991, 0xAAC463E8252BFC38,
-    0x6FFC2E15DDA9075D, 0xC26FFC20496032F4, 0x9948584B60F259A6, 0x34DB8A7EF43B6C0F, 0x2F07109D33D68F02,
-    0x8294C2A8A71FBAAB, 0xD9B366C38E8DD1F9, 0x7420B4F61A44E450, 0xEE0A5304015617E3, 0x43998131959F224A,
-    0x18BE255ABC0D4918, 0xB52DF76F28C47CB1, 0xAEF16D8CEF299FBC, 0x0362BFB97BE0AA15, 0x58451BD25272C147,
-    0xF5D6C9E7C6BBF4EE, 0xC1830603F09E1388, 0x6C10D43664572621, 0x3737705D4DC54D73, 0x9AA4A268D90C78DA,
-    0x8178388B1EE19BD7, 0x2CEBEABE8A28AE7E, 0x77CC4ED5A3BAC52C, 0xDA5F9CE03773F085, 0x40757B122C610336,
-    0xEDE6A927B8A8369F, 0xB6C10D4C913A5DCD, 0x1B52DF7905F36864, 0x008E459AC21E8B69, 0xAD1D97AF56D7BEC0,
-    0xF63A33C47F45D592, 0x5BA9E1F1EB8CE03B, 0xD1D97A0A1A8916F1, 0x7C4AA83F8E402358, 0x276D0C54A7D2480A,
-    0x8AFEDE61331B7DA3, 0x91224482F4F69EAE, 0x3CB196B7603FAB07, 0x679632DC49ADC055, 0xCA05E0E9DD64F5FC,
-    0x502F071BC676064F, 0xFDBCD52E52BF33E6, 0xA69B71457B2D58B4, 0x0B08A370EFE46D1D, 0x10D4399328098E10,
-    0xBD47EBA6BCC0BBB9, 0xE6604FCD9552D0EB, 0x4BF39DF8019BE542, 0x7FA6521C37BE0224, 0xD2358029A377378D,
-    0x891224428AE55CDF, 0x2481F6771E2C6976, 0x3F5D6C94D9C18A7B, 0x92CEBEA14D08BFD2, 0xC9E91ACA649AD480,
-    0x647AC8FFF053E129, 0xFE502F0DEB41129A, 0x53C3FD387F882733, 0x08E45953561A4C61, 0xA5778B66C2D379C8,
-    0xBEAB1185053E9AC5, 0x1338C3B091F7AF6C, 0x481F67DBB865C43E, 0xE58CB5EE2CACF197, 0x20B4F813D42E0AF2,
-    0x8D272A2640E73F5B, 0xD6008E4D69755409, 0x7B935C78FDBC61A0, 0x604FC69B3A5182AD, 0xCDDC14AEAE98B704,
-    0x96FBB0C5870ADC56, 0x3B6862F013C3E9FF, 0xA142850208D11A4C, 0x0CD157379C182FE5, 0x57F6F35CB58A44B7,
-    0xFA6521692143711E, 0xE1B9BB8AE6AE9213, 0x4C2A69BF7267A7BA, 0x170DCDD45BF5CCE8, 0xBA9E1FE1CF3CF941,
-    0x8ECBD005F9191E27, 0x235802306DD02B8E, 0x787FA65B444240DC, 0xD5EC746ED08B7575, 0xCE30EE8D17669678,
-    0x63A33CB883AFA3D1, 0x388498D3AA3DC883, 0x95174AE63EF4FD2A, 0x0F3DAD1425E60E99, 0xA2AE7F21B12F3B30,
-    0xF989DB4A98BD5062, 0x541A097F0C7465CB, 0x4FC6939CCB9986C6, 0xE25541A95F50B36F, 0xB972E5C276C2D83D,
-    0x14E137F7E20BED94};
+// Lookup tables of the slice-by-8 CRC. lookup[0] is the usual byte-wise table, and lookup[n] gives the CRC of a byte
+// followed by n zero bytes, so that eight bytes can be processed with independent lookups.
+struct CrcTables {
+  uint64_t lookup[8][256];
+};
+
+// =====================================================================================================================
+// Gets the lookup tables of the slice-by-8 CRC, which are built on first use.
+static const CrcTables &getCrcTables() {
+  static const CrcTables tables = []() {
+    CrcTables crcTables = {};
+    for (unsigned i = 0; i < 256; ++i) {
+      uint64_t crc = i;
+      for (unsigned bit = 0; bit < 8; ++bit)
+        crc = (crc & 1) ? ((crc >> 1) ^ CrcPolynomial) : (crc >> 1);
+      crcTables.lookup[0][i] = crc;
+    }
+    for (unsigned i = 0; i < 256; ++i) {
+      for (unsigned slice = 1; slice < 8; ++slice) {
+        const uint64_t prev = crcTables.lookup[slice - 1][i];
+        crcTables.lookup[slice][i] = (prev >> 8) ^ crcTables.lookup[0][prev & 0xFF];
+      }
+    }
+    return crcTables;
+  }();
+  return tables;
+}
+
+// =====================================================================================================================
+// Gets the time elapsed since the specified point in time, in microseconds.
+//
+// @param start : Point in time to measure from
+static uint64_t getElapsedMicroseconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// =====================================================================================================================
+// Creates an empty file with a unique name next to the cache file, to write a new version of the cache file into. Each
+// process gets its own file, so processes replacing the same cache file at once do not write into each other's file.
+//
+// @param fileFullPath : Full path of the cache file
+// @param [out] tempFilePath : Full path of the new file
+static Result createTempCacheFile(const char *fileFullPath, std::string &tempFilePath) {
+  SmallString<256> path;
+  if (sys::fs::createUniqueFile(Twine(fileFullPath) + ".%%%%%%%%.tmp", path))
+    return Result::ErrorUnknown;
+  tempFilePath = path.str().str();
+  return Result::Success;
+}
+
+// =====================================================================================================================
+// Gets the key of a shader in the client's external cache. It also depends on the version of the layout of the shader
+// data, so that shaders stored with another layout are never found.
+//
+// @param key : Key of the shader in this cache
+static uint64_t getExternalCacheKey(uint64_t key) {
+  Util::MetroHash64 hasher;
+  hasher.Update(key);
+  hasher.Update(ShaderCacheVersion);
+  MetroHash::Hash hash = {};
+  hasher.Finalize(hash.bytes);
+  return MetroHash::compact64(&hash);
+}
 
 // =====================================================================================================================
 ShaderCache::ShaderCache()
-    : m_onDiskFile(), m_disableCache(true), m_shaderDataEnd(sizeof(ShaderCacheSerializedHeader)), m_totalShaders(0),
-      m_serializedSize(sizeof(ShaderCacheSerializedHeader)), m_getValueFunc(nullptr), m_storeValueFunc(nullptr) {
+    : m_onDiskFile(), m_disableCache(true), m_shaderCacheMode(ShaderCacheDisable), m_liveFileDataSize(0),
+      m_pendingShaderCount(0), m_stopFileWriter(false), m_committedShaderCount(0),
+      m_committedDataEnd(sizeof(ShaderCacheSerializedHeader)), m_fileTocValid(false), m_sharedFile(false),
+      m_sharedFileLockFd(-1), m_importedDataEnd(sizeof(ShaderCacheSerializedHeader)), m_cacheDataSize(0),
+      m_useCounter(0), m_lockContentionCount(0), m_hitCount(0), m_missCount(0), m_waitCount(0), m_waitTime(0),
+      m_storedBytes(0), m_evictedBytes(0), m_loadTime(0),
+      m_shaderDataEnd(sizeof(ShaderCacheSerializedHeader)), m_totalShaders(0), m_getValueFunc(nullptr),
+      m_storeValueFunc(nullptr) {
   memset(m_fileFullPath, 0, MaxFilePathLen);
   memset(&m_gfxIp, 0, sizeof(m_gfxIp));
 }
@@ -126,25 +193,53 @@ ShaderCache::~ShaderCache() {
 // =====================================================================================================================
 // Destruction, does clean-up work.
 void ShaderCache::Destroy() {
-  if (m_onDiskFile.isOpen())
+  // Write the shaders that are still waiting for it to the on-disk file.
+  stopFileWriter();
+
+  // Other processes append to a shared file, so neither a table of contents nor compaction can be used for it.
+  if (m_onDiskFile.isOpen()) {
+    if ((m_shaderCacheMode == ShaderCacheEnableOnDisk || m_shaderCacheMode == ShaderCacheForceInternalCacheOnDisk) &&
+        !m_sharedFile) {
+      // Drop the evicted shaders from the file before it is closed, otherwise they are loaded again next time.
+      if (ShaderCacheMaxFileSize != 0 && m_fileTocIndex.size() != m_fileToc.size()) {
+        std::lock_guard<sys::Mutex> lock(m_lock);
+        compactCacheFile();
+      }
+      writeTocToFile();
+    }
     m_onDiskFile.close();
+  }
+
+  if (m_sharedFileLockFd >= 0) {
+    sys::Process::SafelyCloseFileDescriptor(m_sharedFileLockFd);
+    m_sharedFileLockFd = -1;
+  }
+  m_sharedFile = false;
+
   resetRuntimeCache();
 }
 
 // =====================================================================================================================
 // Resets the runtime shader cache to an empty state. Releases all allocator memory and decommits it back to the OS.
 void ShaderCache::resetRuntimeCache() {
-  for (auto indexMap : m_shaderIndexMap)
-    delete indexMap.second;
-  m_shaderIndexMap.clear();
+  for (auto &shard : m_shaderIndexShards) {
+    for (auto indexMap : shard.indexMap)
+      delete indexMap.second;
+    shard.indexMap.clear();
+  }
 
   for (auto allocIt : m_allocationList)
-    delete[] allocIt.first;
+    delete[] allocIt.mem;
   m_allocationList.clear();
 
+  m_mappedFile.reset();
+  m_fileToc.clear();
+  m_fileTocIndex.clear();
+
   m_totalShaders = 0;
   m_shaderDataEnd = sizeof(ShaderCacheSerializedHeader);
-  m_serializedSize = sizeof(ShaderCacheSerializedHeader);
+  m_liveFileDataSize = 0;
+  m_cacheDataSize = 0;
 }
 
 // =====================================================================================================================
@@ -159,43 +254,60 @@ Result ShaderCache::Serialize(void *blob, size_t *size) {
   Result result = Result::Success;
 
   if (*size == 0) {
-    // Query shader cache serailzied size
-    (*size) = m_serializedSize;
+    // Query shader cache serailzied size, which is the size of the header and of the data of all ready shaders
+    size_t serializedSize = sizeof(ShaderCacheSerializedHeader);
+    for (auto &shard : m_shaderIndexShards) {
+      lockIndexShard(shard, true);
+      for (auto it : shard.indexMap) {
+        if (it.second->state == ShaderEntryState::Ready)
+          serializedSize += it.second->header.size;
+      }
+      unlockIndexShard(shard, true);
+    }
+    (*size) = serializedSize;
   } else {
     // Do serialize
-    assert(m_shaderDataEnd == m_serializedSize || m_shaderDataEnd == sizeof(ShaderCacheSerializedHeader));
-
-    if (m_serializedSize >= sizeof(ShaderCacheSerializedHeader)) {
-      if (blob && (*size) >= m_serializedSize) {
-        // First construct the header and copy it into the memory provided
-        ShaderCacheSerializedHeader header = {};
-        header.headerSize = sizeof(ShaderCacheSerializedHeader);
-        header.shaderCount = m_totalShaders;
-        header.shaderDataEnd = m_shaderDataEnd;
-        getBuildTime(&header.buildId);
-
-        memcpy(blob, &header, sizeof(ShaderCacheSerializedHeader));
-
-        void *dataDst = voidPtrInc(blob, sizeof(ShaderCacheSerializedHeader));
-
-        // Then iterate through all allocators (which hold the backing memory for the shader data)
-        // and copy their contents to the blob.
-        for (auto it : m_allocationList) {
-          assert(it.first);
-
-          const size_t copySize = it.second;
+    if (blob && (*size) >= sizeof(ShaderCacheSerializedHeader)) {
+      void *dataDst = voidPtrInc(blob, sizeof(ShaderCacheSerializedHeader));
+      size_t shaderCount = 0;
+
+      // Iterate through all ready shaders and copy their data (which starts with a copy of their header) to the blob.
+      // Shaders evicted from the cache are not in the index any more, so they are left out.
+      for (auto &shard : m_shaderIndexShards) {
+        lockIndexShard(shard, true);
+        for (auto it : shard.indexMap) {
+          const ShaderIndex *index = it.second;
+          if (index->state != ShaderEntryState::Ready)
+            continue;
+
+          const size_t copySize = index->header.size;
           if (voidPtrDiff(dataDst, blob) + copySize > (*size)) {
             result = Result::ErrorUnknown;
             break;
           }
 
-          memcpy(dataDst, it.first, copySize);
+          memcpy(dataDst, index->dataBlob, copySize);
           dataDst = voidPtrInc(dataDst, copySize);
+          ++shaderCount;
         }
-      } else {
-        llvm_unreachable("Should never be called!");
-        result = Result::ErrorUnknown;
+        unlockIndexShard(shard, true);
+
+        if (result != Result::Success)
+          break;
       }
+
+      // Then construct the header and copy it into the memory provided
+      ShaderCacheSerializedHeader header = {};
+      header.headerSize = sizeof(ShaderCacheSerializedHeader);
+      header.version = ShaderCacheVersion;
+      header.shaderCount = shaderCount;
+      header.shaderDataEnd = voidPtrDiff(dataDst, blob);
+      getBuildTime(&header.buildId);
+
+      memcpy(blob, &header, sizeof(ShaderCacheSerializedHeader));
+    } else {
+      llvm_unreachable("Should never be called!");
+      result = Result::ErrorUnknown;
     }
   }
 
@@ -213,34 +325,52 @@ Result ShaderCache::Merge(unsigned srcCacheCount, const IShaderCache **ppSrcCach
 
   Result result = Result::Success;
 
-  lockCacheMap(false);
-
   for (unsigned i = 0; i < srcCacheCount; i++) {
     ShaderCache *srcCache = static_cast<ShaderCache *>(const_cast<IShaderCache *>(ppSrcCaches[i]));
-    srcCache->lockCacheMap(true);
 
-    for (auto it : srcCache->m_shaderIndexMap) {
-      uint64_t key = it.first;
+    for (auto &srcShard : srcCache->m_shaderIndexShards) {
+      srcCache->lockIndexShard(srcShard, true);
+
+      for (auto it : srcShard.indexMap) {
+        uint64_t key = it.first;
+        if (it.second->state != ShaderEntryState::Ready)
+          continue;
+
+        ShaderIndexShard &shard = getIndexShard(key);
+        lockIndexShard(shard, false);
+
+        auto indexMap = shard.indexMap.find(key);
+        if (indexMap == shard.indexMap.end()) {
+          ShaderIndex *index = nullptr;
+          ShaderCacheAllocation *allocation = nullptr;
+          void *mem = nullptr;
+          {
+            std::lock_guard<sys::Mutex> lock(m_lock);
+            mem = getCacheSpace(it.second->header.size, &allocation);
+            m_totalShaders++;
+          }
+          memcpy(mem, it.second->dataBlob, it.second->header.size);
+          m_cacheDataSize += it.second->header.size;
 
-      auto indexMap = m_shaderIndexMap.find(key);
-      if (indexMap == m_shaderIndexMap.end()) {
-        ShaderIndex *index = nullptr;
-        void *mem = getCacheSpace(it.second->header.size);
-        memcpy(mem, it.second->dataBlob, it.second->header.size);
+          index = new ShaderIndex();
+          index->dataBlob = mem;
+          index->allocation = allocation;
+          index->state = ShaderEntryState::Ready;
+          index->header = it.second->header;
+          index->needsCrcCheck = it.second->needsCrcCheck.load();
+          index->lastUse = it.second->lastUse.load();
 
-        index = new ShaderIndex;
-        index->dataBlob = mem;
-        index->state = ShaderEntryState::Ready;
-        index->header = it.second->header;
+          shard.indexMap[key] = index;
+        }
 
-        m_shaderIndexMap[key] = index;
-        m_totalShaders++;
+        unlockIndexShard(shard, false);
       }
+      srcCache->unlockIndexShard(srcShard, true);
     }
-    srcCache->unlockCacheMap(true);
   }
 
-  unlockCacheMap(false);
+  if (isOverBudget(false))
+    evictShaders();
 
   return result;
 }
@@ -260,8 +390,10 @@ Result ShaderCache::init(const ShaderCacheCreateInfo *createInfo, const ShaderCa
     m_storeValueFunc = createInfo->pfnStoreValueFunc;
     m_gfxIp = auxCreateInfo->gfxIp;
     m_hash = auxCreateInfo->hash;
+    m_shaderCacheMode = auxCreateInfo->shaderCacheMode;
 
-    lockCacheMap(false);
+    m_lock.lock();
+    const auto loadStart = std::chrono::steady_clock::now();
 
     // If we're in runtime mode and the caller provided a data blob, try to load the from that blob.
     if (auxCreateInfo->shaderCacheMode == ShaderCacheEnableRuntime && createInfo->initialDataSize > 0) {
@@ -280,7 +412,36 @@ Result ShaderCache::init(const ShaderCacheCreateInfo *createInfo, const ShaderCa
       result = buildFileName(auxCreateInfo->executableName, auxCreateInfo->cacheFilePath, auxCreateInfo->gfxIp,
                              &cacheFileExists);
 
-      if (result == Result::Success) {
+      // A file shared with other processes is only created, validated and loaded while holding its lock file. If the
+      // lock file cannot be used, the on-disk file is not used at all, as it could be corrupted by the other processes.
+      bool sharedFileLocked = false;
+      if (result == Result::Success && ShaderCacheShared &&
+          (auxCreateInfo->shaderCacheMode == ShaderCacheEnableOnDisk ||
+           auxCreateInfo->shaderCacheMode == ShaderCacheForceInternalCacheOnDisk)) {
+        const std::string lockFilePath = std::string(m_fileFullPath) + ".lock";
+        if (!sys::fs::openFileForReadWrite(lockFilePath, m_sharedFileLockFd, sys::fs::CD_OpenAlways,
+                                           sys::fs::OF_None)) {
+          m_sharedFile = true;
+          result = lockSharedFile();
+          sharedFileLocked = result == Result::Success;
+          cacheFileExists = File::exists(m_fileFullPath);
+        } else {
+          m_sharedFileLockFd = -1;
+          result = Result::ErrorUnavailable;
+        }
+      }
+
+      // A read-only cache file can be mapped into memory, so only the pages of the shaders that are actually used are
+      // read, and they are shared with other processes using the same file.
+      bool fileMapped = false;
+      if (result == Result::Success && cacheFileExists &&
+          auxCreateInfo->shaderCacheMode == ShaderCacheEnableOnDiskReadOnly && ShaderCacheMapFile) {
+        fileMapped = loadCacheFromMappedFile() == Result::Success;
+        if (!fileMapped)
+          resetRuntimeCache();
+      }
+
+      if (result == Result::Success && !fileMapped) {
         // Open the storage file if it exists
         if (cacheFileExists) {
           if (auxCreateInfo->shaderCacheMode == ShaderCacheEnableOnDiskReadOnly)
@@ -292,9 +453,9 @@ Result ShaderCache::init(const ShaderCacheCreateInfo *createInfo, const ShaderCa
           result = m_onDiskFile.open(m_fileFullPath, (FileAccessRead | FileAccessAppend | FileAccessBinary));
       }
 
-      Result loadResult = Result::ErrorUnknown;
+      Result loadResult = fileMapped ? Result::Success : Result::ErrorUnknown;
       // If the cache file already existed, then we can try loading the data from it
-      if (result == Result::Success) {
+      if (result == Result::Success && !fileMapped) {
         if (cacheFileExists) {
           loadResult = loadCacheFromFile();
           if (auxCreateInfo->shaderCacheMode == ShaderCacheEnableOnDiskReadOnly && loadResult == Result::Success)
@@ -307,9 +468,24 @@ Result ShaderCache::init(const ShaderCacheCreateInfo *createInfo, const ShaderCa
       // any memory allocated
       if (loadResult != Result::Success)
         resetRuntimeCache();
+
+      if (sharedFileLocked) {
+        m_importedDataEnd = m_committedDataEnd;
+        unlockSharedFile();
+      }
     }
 
-    unlockCacheMap(false);
+    m_loadTime = getElapsedMicroseconds(loadStart);
+
+    // New shaders are written to the on-disk file by a background thread.
+    if (m_onDiskFile.isOpen())
+      startFileWriter();
+
+    m_lock.unlock();
+
+    // The cache may have been created with a larger budget than it has now, so it may have to be shrunk right away.
+    if (isOverBudget(false))
+      evictShaders();
   } else
     m_disableCache = true;
 
@@ -360,26 +536,61 @@ Result ShaderCache::buildFileName(const char *executableName, const char *cacheF
 
 // =====================================================================================================================
 // Resets the contents of the cache file, assumes the shader cache has been locked for writes.
+//
+// NOTE: Other processes may have mapped the old file, and truncating it would make their accesses to the mapping fault.
+// So the empty file is written next to the old one and then renamed over it, which leaves the old file intact for the
+// processes that still use it. A shared file is truncated in place instead, under its lock file, as the processes
+// sharing it keep it open and would not see a file renamed over it. It is never mapped, as it is not read-only.
 void ShaderCache::resetCacheFile() {
   m_onDiskFile.close();
-  Result fileResult = m_onDiskFile.open(m_fileFullPath, (FileAccessRead | FileAccessWrite | FileAccessBinary));
-  assert(fileResult == Result::Success);
-  (void(fileResult)); // unused
 
   ShaderCacheSerializedHeader header = {};
   header.headerSize = sizeof(ShaderCacheSerializedHeader);
+  header.version = ShaderCacheVersion;
   header.shaderCount = 0;
   header.shaderDataEnd = header.headerSize;
   getBuildTime(&header.buildId);
 
-  m_onDiskFile.write(&header, header.headerSize);
+  Result fileResult = Result::Success;
+  if (m_sharedFile) {
+    fileResult = m_onDiskFile.open(m_fileFullPath, (FileAccessRead | FileAccessWrite | FileAccessBinary));
+    if (fileResult == Result::Success)
+      fileResult = m_onDiskFile.write(&header, header.headerSize);
+    if (fileResult == Result::Success)
+      fileResult = m_onDiskFile.flush();
+  } else {
+    std::string tempFilePath;
+    fileResult = createTempCacheFile(m_fileFullPath, tempFilePath);
+    if (fileResult == Result::Success) {
+      File tempFile;
+      fileResult = tempFile.open(tempFilePath.c_str(), (FileAccessWrite | FileAccessBinary));
+      if (fileResult == Result::Success)
+        fileResult = tempFile.write(&header, header.headerSize);
+      if (fileResult == Result::Success)
+        fileResult = tempFile.flush();
+      tempFile.close();
+      if (fileResult == Result::Success && sys::fs::rename(tempFilePath, m_fileFullPath))
+        fileResult = Result::ErrorUnknown;
+      if (fileResult != Result::Success)
+        sys::fs::remove(tempFilePath);
+    }
+
+    if (fileResult == Result::Success)
+      fileResult = m_onDiskFile.open(m_fileFullPath, (FileAccessReadUpdate | FileAccessBinary));
+  }
+  assert(fileResult == Result::Success);
+  (void(fileResult)); // unused
+
+  m_committedShaderCount = header.shaderCount;
+  m_committedDataEnd = header.shaderDataEnd;
+  m_fileTocValid = false;
 }
 
 // =====================================================================================================================
 // Searches the shader cache for a shader with the matching key, allocating a new entry if it didn't already exist.
 //
 // Returns:
-//    Ready       - if a matching shader was found and is ready for use
+//    Ready       - if a matching shader was found and is ready for use, the caller must release it with releaseShader
 //    Compiling   - if an entry was created and must be compiled/populated by the caller
 //    Unavailable - if an unrecoverable error was encountered
 //
@@ -399,16 +610,30 @@ ShaderEntryState ShaderCache::findShader(MetroHash::Hash hash, bool allocateOnMi
   Result mapResult = Result::Success;
   assert(phEntry);
 
-  bool readOnlyLock = (!allocateOnMiss);
-  lockCacheMap(readOnlyLock);
   uint64_t hashKey = MetroHash::compact64(&hash);
-  auto indexMap = m_shaderIndexMap.find(hashKey);
-  if (indexMap != m_shaderIndexMap.end()) {
+  ShaderIndexShard &shard = getIndexShard(hashKey);
+
+  // Most lookups are hits, so search with the read lock first and only take the write lock to allocate a new entry.
+  bool readOnlyLock = true;
+  lockIndexShard(shard, readOnlyLock);
+  auto indexMap = shard.indexMap.find(hashKey);
+  if (indexMap != shard.indexMap.end()) {
     existed = true;
     index = indexMap->second;
   } else if (allocateOnMiss) {
-    index = new ShaderIndex;
-    m_shaderIndexMap[hashKey] = index;
+    unlockIndexShard(shard, readOnlyLock);
+    readOnlyLock = false;
+    lockIndexShard(shard, readOnlyLock);
+
+    // Another thread may have added the entry while we did not hold the lock.
+    indexMap = shard.indexMap.find(hashKey);
+    if (indexMap != shard.indexMap.end()) {
+      existed = true;
+      index = indexMap->second;
+    } else {
+      index = new ShaderIndex();
+      shard.indexMap[hashKey] = index;
+    }
   }
 
   if (!index)
@@ -418,9 +643,9 @@ ShaderEntryState ShaderCache::findShader(MetroHash::Hash hash, bool allocateOnMi
     if (existed) {
       // We don't need to hold on to the write lock if we're not the one doing the compile
       if (!readOnlyLock) {
-        unlockCacheMap(readOnlyLock);
+        unlockIndexShard(shard, readOnlyLock);
         readOnlyLock = true;
-        lockCacheMap(readOnlyLock);
+        lockIndexShard(shard, readOnlyLock);
       }
     } else {
       bool needsInit = true;
@@ -428,28 +653,40 @@ ShaderEntryState ShaderCache::findShader(MetroHash::Hash hash, bool allocateOnMi
       // We didn't find the entry in our own hash map, now search the external cache if available
       if (useExternalCache()) {
         // The first call to the external cache queries the existence and the size of the cached shader.
-        Result extResult = m_getValueFunc(m_clientData, hashKey, nullptr, &index->header.size);
+        const uint64_t externalKey = getExternalCacheKey(hashKey);
+        Result extResult = m_getValueFunc(m_clientData, externalKey, nullptr, &index->header.size);
         if (extResult == Result::Success) {
           // An entry was found matching our hash, we should allocate memory to hold the data and call again
           assert(index->header.size > 0);
-          index->dataBlob = getCacheSpace(index->header.size);
+          {
+            std::lock_guard<sys::Mutex> lock(m_lock);
+            index->dataBlob = getCacheSpace(index->header.size, &index->allocation);
+          }
 
           if (!index->dataBlob)
             extResult = Result::ErrorOutOfMemory;
           else {
-            extResult = m_getValueFunc(m_clientData, hashKey, index->dataBlob, &index->header.size);
+            extResult = m_getValueFunc(m_clientData, externalKey, index->dataBlob, &index->header.size);
           }
         }
 
-        if (extResult == Result::Success) {
-          // We now have a copy of the shader data from the external cache, just need to update the
-          // ShaderIndex. The first item in the data blob is a ShaderHeader, followed by the serialized
-          // data blob for the shader.
-          const auto *const header = static_cast<const ShaderHeader *>(index->dataBlob);
-          assert(index->header.size == header->size);
+        // We now have a copy of the shader data from the external cache. The first item in the data blob is a
+        // ShaderHeader, followed by the serialized data blob for the shader. Data that does not match its header is
+        // not used.
+        const auto *const header = static_cast<const ShaderHeader *>(index->dataBlob);
+        if (extResult == Result::Success &&
+            (index->header.size < sizeof(ShaderHeader) || header->size != index->header.size ||
+             header->key != hashKey ||
+             (header->codec != CompressionCodec::None && header->codec != CompressionCodec::Lz4) ||
+             calculateCrc(reinterpret_cast<const uint8_t *>(header + 1), header->size - sizeof(ShaderHeader)) !=
+                 header->crc))
+          extResult = Result::ErrorUnknown;
 
+        if (extResult == Result::Success) {
+          // Just need to update the ShaderIndex.
           index->header = (*header);
           index->state = ShaderEntryState::Ready;
+          m_cacheDataSize += index->header.size;
           needsInit = false;
         } else if (extResult == Result::ErrorUnavailable) {
           // This means the external cache is unavailable and we shouldn't bother using it anymore. To
@@ -467,31 +704,45 @@ ShaderEntryState ShaderCache::findShader(MetroHash::Hash hash, bool allocateOnMi
 
       if (needsInit) {
         // This is a brand new cache entry so we need to initialize the ShaderIndex.
-        memset(index, 0, sizeof(*index));
+        if (index->allocation) {
+          std::lock_guard<sys::Mutex> lock(m_lock);
+          releaseCacheSpace(index->allocation);
+        }
+        index->header = {};
         index->header.key = hashKey;
+        index->dataBlob = nullptr;
+        index->allocation = nullptr;
         index->state = ShaderEntryState::New;
       }
     } // End if (existed == false)
 
-    if (index->state == ShaderEntryState::Compiling) {
-      // The shader is being compiled by another thread, we should release the lock and wait for it to complete
-      while (index->state == ShaderEntryState::Compiling) {
-        unlockCacheMap(readOnlyLock);
-        {
-          std::unique_lock<std::mutex> lock(m_conditionMutex);
+    bool retry = false;
+    do {
+      retry = false;
+      if (index->state == ShaderEntryState::Compiling) {
+        // The shader is being compiled by another thread, we should release the lock and wait for it to complete
+        waitForEntry(shard, index, readOnlyLock);
+        // At this point the shader entry is either Ready, New or something failed. We've already
+        // initialized our result code to an error code above, the Ready and New cases are handled below so
+        // nothing else to do here.
+      }
 
-          m_conditionVariable.wait_for(lock, std::chrono::seconds(1));
-        }
-        lockCacheMap(readOnlyLock);
+      if (index->state == ShaderEntryState::New && readOnlyLock) {
+        // Claiming the entry for compilation modifies it, so we need the write lock. Another thread may claim it
+        // while we switch locks, so check the state again afterwards.
+        unlockIndexShard(shard, readOnlyLock);
+        readOnlyLock = false;
+        lockIndexShard(shard, readOnlyLock);
+        retry = true;
       }
-      // At this point the shader entry is either Ready, New or something failed. We've already
-      // initialized our result code to an error code above, the Ready and New cases are handled below so
-      // nothing else to do here.
-    }
+    } while (retry);
 
     if (index->state == ShaderEntryState::Ready) {
-      // The shader has been compiled, just verify it has valid data and then return success.
+      // The shader has been compiled, just verify it has valid data and then return success. The entry cannot be
+      // evicted until the caller releases it.
       assert(index->dataBlob && index->header.size != 0);
+      index->refCount.fetch_add(1, std::memory_order_relaxed);
+      index->lastUse.store(m_useCounter.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
     } else if (index->state == ShaderEntryState::New) {
       // The shader entry is new (or previously failed compilation) and we're the first thread to get a
       // crack at it, move it into the Compiling state
@@ -503,7 +754,21 @@ ShaderEntryState ShaderCache::findShader(MetroHash::Hash hash, bool allocateOnMi
     result = index->state;
   }
 
-  unlockCacheMap(readOnlyLock);
+  unlockIndexShard(shard, readOnlyLock);
+
+  // Another process sharing the on-disk file may have added the shader to it, or may be compiling it right now.
+  if (result == ShaderEntryState::Compiling && m_sharedFile && waitForSharedShader(index)) {
+    lockIndexShard(shard, false);
+    index->refCount.fetch_add(1, std::memory_order_relaxed);
+    completeEntry(shard, index, ShaderEntryState::Ready);
+    unlockIndexShard(shard, false);
+    result = ShaderEntryState::Ready;
+  }
+
+  if (result == ShaderEntryState::Ready)
+    m_hitCount.fetch_add(1, std::memory_order_relaxed);
+  else
+    m_missCount.fetch_add(1, std::memory_order_relaxed);
 
   return result;
 }
@@ -520,68 +785,116 @@ void ShaderCache::insertShader(CacheEntryHandle hEntry, const void *blob, size_t
   assert(m_disableCache == false);
   assert(index && index->state == ShaderEntryState::Compiling);
 
-  lockCacheMap(false);
-
   Result result = Result::Success;
 
-  if (result == Result::Success) {
-    // Allocate space to store the serialized shader and a copy of the header. The header is duplicated in the
-    // data to simplify serialize/load.
-    index->header.size = (shaderSize + sizeof(ShaderHeader));
-    index->dataBlob = getCacheSpace(index->header.size);
-
-    if (!index->dataBlob)
-      result = Result::ErrorOutOfMemory;
-    else {
-      ++m_totalShaders;
-
-      auto *const header = static_cast<ShaderHeader *>(index->dataBlob);
-      void *const dataBlob = (header + 1);
-
-      // Serialize the shader into an opaque blob of data.
-      memcpy(dataBlob, blob, shaderSize);
+  // Compress the shader data if that makes it smaller, otherwise it is stored as it is.
+  assert(shaderSize <= UINT32_MAX);
+  std::vector<uint8_t> compressedData;
+  const void *storedData = blob;
+  size_t storedSize = shaderSize;
+  CompressionCodec codec = CompressionCodec::None;
+  if (cl::ShaderCacheCompression && shaderSize > 1) {
+    compressedData.resize(shaderSize - 1);
+    const size_t compressedSize = compressLz4(blob, shaderSize, compressedData.data(), compressedData.size());
+    if (compressedSize != 0) {
+      storedData = compressedData.data();
+      storedSize = compressedSize;
+      codec = CompressionCodec::Lz4;
+    }
+  }
 
-      // Compute a CRC for the serialized data (useful for detecting data corruption), and copy the index's
-      // header into the data's header.
-      index->header.crc = calculateCrc(static_cast<uint8_t *>(dataBlob), shaderSize);
-      (*header) = index->header;
+  // Allocate space to store the serialized shader and a copy of the header. The header is duplicated in the
+  // data to simplify serialize/load.
+  ShaderHeader shaderHeader = index->header;
+  shaderHeader.size = (storedSize + sizeof(ShaderHeader));
+  shaderHeader.codec = codec;
+  shaderHeader.rawSize = static_cast<uint32_t>(shaderSize);
+  ShaderCacheAllocation *allocation = nullptr;
+  void *dataBlob = nullptr;
+  {
+    std::lock_guard<sys::Mutex> lock(m_lock);
+    dataBlob = getCacheSpace(shaderHeader.size, &allocation);
+  }
 
-      if (useExternalCache()) {
-        // If we're making use of the external shader cache then we need to store the compiled shader data here.
-        Result externalResult = m_storeValueFunc(m_clientData, index->header.key, index->dataBlob, index->header.size);
-        if (externalResult == Result::ErrorUnavailable) {
-          // This is the only return code we can do anything about. In this case it means the external cache
-          // is not available and we should zero out the function pointers to avoid making useless calls on
-          // subsequent shader compiles.
-          m_getValueFunc = nullptr;
-          m_storeValueFunc = nullptr;
-        } else {
-          // Otherwise the store either succeeded (yay!) or failed in some other transient way. Either way,
-          // we will just continue, there's nothing to be done.
-        }
+  if (!dataBlob)
+    result = Result::ErrorOutOfMemory;
+  else {
+    // Only the compiling thread touches the new allocation, so it can be filled in without holding any lock.
+    auto *const header = static_cast<ShaderHeader *>(dataBlob);
+    void *const shaderData = (header + 1);
+
+    // Serialize the shader into an opaque blob of data.
+    memcpy(shaderData, storedData, storedSize);
+
+    // Compute a CRC for the serialized data (useful for detecting data corruption), and copy the index's
+    // header into the data's header.
+    shaderHeader.crc = calculateCrc(static_cast<uint8_t *>(shaderData), storedSize);
+    (*header) = shaderHeader;
+
+    if (useExternalCache()) {
+      // If we're making use of the external shader cache then we need to store the compiled shader data here.
+      Result externalResult =
+          m_storeValueFunc(m_clientData, getExternalCacheKey(shaderHeader.key), dataBlob, shaderHeader.size);
+      if (externalResult == Result::ErrorUnavailable) {
+        // This is the only return code we can do anything about. In this case it means the external cache
+        // is not available and we should zero out the function pointers to avoid making useless calls on
+        // subsequent shader compiles.
+        m_getValueFunc = nullptr;
+        m_storeValueFunc = nullptr;
+      } else {
+        // Otherwise the store either succeeded (yay!) or failed in some other transient way. Either way,
+        // we will just continue, there's nothing to be done.
       }
-
-      // Mark this entry as ready, we'll wake the waiting threads once we release the lock
-      index->state = ShaderEntryState::Ready;
-
-      // Finally, update the file if necessary.
-      if (m_onDiskFile.isOpen())
-        addShaderToFile(index);
     }
   }
 
-  if (result != Result::Success) {
+  ShaderIndexShard &shard = getIndexShard(shaderHeader.key);
+  lockIndexShard(shard, false);
+
+  if (result == Result::Success) {
+    // Mark this entry as ready, which wakes the threads waiting for it.
+    index->header = shaderHeader;
+    index->dataBlob = dataBlob;
+    index->allocation = allocation;
+    index->lastUse.store(m_useCounter.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_cacheDataSize += shaderHeader.size;
+    m_storedBytes.fetch_add(shaderHeader.size, std::memory_order_relaxed);
+    // Pin the entry until it has been added to the file, so that it cannot be evicted once it is ready.
+    index->refCount.fetch_add(1, std::memory_order_relaxed);
+    completeEntry(shard, index, ShaderEntryState::Ready);
+  } else {
     // Something failed while attempting to add the shader, most likely memory allocation. There's not much we
     // can do here except give up on adding data. This means we need to set the entry back to New so if another
     // thread is waiting it will be allowed to continue (it will likely just get to this same point, but at least
     // we won't hang or crash).
-    index->state = ShaderEntryState::New;
     index->header.size = 0;
     index->dataBlob = nullptr;
+    completeEntry(shard, index, ShaderEntryState::New);
+  }
+
+  unlockIndexShard(shard, false);
+
+  bool addedToFile = false;
+  if (result == Result::Success) {
+    // Finally, update the file if necessary.
+    {
+      std::lock_guard<sys::Mutex> lock(m_lock);
+      ++m_totalShaders;
+      if (m_onDiskFile.isOpen()) {
+        addShaderToFile(index);
+        addedToFile = true;
+      }
+    }
+    releaseShader(index);
+
+    if (isOverBudget(false))
+      evictShaders();
   }
 
-  unlockCacheMap(false);
-  m_conditionVariable.notify_all();
+  // The file writer releases the in-flight marker of a shader it writes to the shared file once the shader has been
+  // committed, otherwise other processes can stop waiting for the shader right away.
+  if (m_sharedFile && !addedToFile)
+    releaseInFlightMarker(shaderHeader.key);
 }
 
 // =====================================================================================================================
@@ -592,64 +905,602 @@ void ShaderCache::resetShader(CacheEntryHandle hEntry) {
   auto *const index = static_cast<ShaderIndex *>(hEntry);
   assert(m_disableCache == false);
   assert(index && index->state == ShaderEntryState::Compiling);
-  lockCacheMap(false);
-  index->state = ShaderEntryState::New;
+  ShaderIndexShard &shard = getIndexShard(index->header.key);
+  lockIndexShard(shard, false);
   index->header.size = 0;
   index->dataBlob = nullptr;
-  unlockCacheMap(false);
-  m_conditionVariable.notify_all();
+  completeEntry(shard, index, ShaderEntryState::New);
+  unlockIndexShard(shard, false);
+
+  if (m_sharedFile)
+    releaseInFlightMarker(index->header.key);
 }
 
 // =====================================================================================================================
 // Retrieves the shader from the cache which is identified by the specified entry handle.
 //
+// Compressed shader data is decompressed into a buffer that is shared by all users of the entry, and freed when the
+// last of them releases it.
+//
 // @param hEntry : Handle of shader cache entry
 // @param [out] ppBlob : Shader data
 // @param [out] size : Size of shader data in bytes
 Result ShaderCache::retrieveShader(CacheEntryHandle hEntry, const void **ppBlob, size_t *size) {
-  const auto *const index = static_cast<ShaderIndex *>(hEntry);
+  auto *const index = static_cast<ShaderIndex *>(hEntry);
 
   assert(m_disableCache == false);
   assert(index);
   assert(index->header.size >= sizeof(ShaderHeader));
 
-  lockCacheMap(true);
+  // The decompressed data is created under the write lock, so that only one thread does it.
+  const bool compressed = index->header.codec != CompressionCodec::None;
+  ShaderIndexShard &shard = getIndexShard(index->header.key);
+  lockIndexShard(shard, !compressed);
 
   *ppBlob = voidPtrInc(index->dataBlob, sizeof(ShaderHeader));
   *size = index->header.size - sizeof(ShaderHeader);
 
-  unlockCacheMap(true);
+  // Shaders loaded from a mapped cache file are only verified when they are first used. Several threads may do the
+  // check at the same time, which is harmless.
+  Result result = *size > 0 ? Result::Success : Result::ErrorUnknown;
+  if (result == Result::Success && index->needsCrcCheck) {
+    ShaderHeader dataHeader = {};
+    memcpy(&dataHeader, index->dataBlob, sizeof(ShaderHeader));
+    if (dataHeader.key == index->header.key && dataHeader.size == index->header.size &&
+        calculateCrc(static_cast<const uint8_t *>(*ppBlob), *size) == index->header.crc)
+      index->needsCrcCheck = false;
+    else
+      result = Result::ErrorUnknown;
+  }
+
+  if (result == Result::Success && compressed) {
+    if (!index->rawData) {
+      std::unique_ptr<uint8_t[]> rawData(new uint8_t[index->header.rawSize]);
+      if (index->header.codec == CompressionCodec::Lz4 &&
+          decompressLz4(*ppBlob, *size, rawData.get(), index->header.rawSize))
+        index->rawData = std::move(rawData);
+      else
+        result = Result::ErrorUnknown;
+    }
+    *ppBlob = index->rawData.get();
+    *size = index->header.rawSize;
+  }
+
+  unlockIndexShard(shard, !compressed);
+
+  return result;
+}
+
+// =====================================================================================================================
+// Releases a shader that findShader returned as ready, so it can be evicted again. The data returned by retrieveShader
+// for it must not be used any more.
+//
+// @param hEntry : Handle of shader cache entry
+void ShaderCache::releaseShader(CacheEntryHandle hEntry) {
+  auto *const index = static_cast<ShaderIndex *>(hEntry);
+  assert(m_disableCache == false);
+  assert(index && index->refCount > 0);
+  if (index->header.codec == CompressionCodec::None) {
+    index->refCount.fetch_sub(1, std::memory_order_relaxed);
+    return;
+  }
+
+  // The decompressed data is freed once the entry is not used any more. findShader takes the shard lock to pin the
+  // entry, so no new user can appear while the write lock is held.
+  ShaderIndexShard &shard = getIndexShard(index->header.key);
+  lockIndexShard(shard, false);
+  if (index->refCount.fetch_sub(1, std::memory_order_relaxed) == 1)
+    index->rawData.reset();
+  unlockIndexShard(shard, false);
+}
+
+// =====================================================================================================================
+// Locks a shard of the shader index map, counting the lock as contended if it cannot be taken without blocking.
+//
+// NOTE: A shard lock may be held while taking m_lock, but never the other way round.
+//
+// @param shard : Shard to lock
+// @param readOnly : Whether to take the reader (shared) lock rather than the writer (exclusive) lock
+void ShaderCache::lockIndexShard(ShaderIndexShard &shard, bool readOnly) {
+  if (readOnly) {
+    if (!shard.lock.try_lock_shared()) {
+      m_lockContentionCount.fetch_add(1, std::memory_order_relaxed);
+      shard.lock.lock_shared();
+    }
+  } else if (!shard.lock.try_lock()) {
+    m_lockContentionCount.fetch_add(1, std::memory_order_relaxed);
+    shard.lock.lock();
+  }
+}
+
+// =====================================================================================================================
+// Unlocks a shard of the shader index map.
+//
+// @param shard : Shard to unlock
+// @param readOnly : Whether the reader (shared) lock rather than the writer (exclusive) lock is held
+void ShaderCache::unlockIndexShard(ShaderIndexShard &shard, bool readOnly) {
+  if (readOnly)
+    shard.lock.unlock_shared();
+  else
+    shard.lock.unlock();
+}
+
+// =====================================================================================================================
+// Blocks until the specified entry leaves the Compiling state. The shard lock must be held by the caller in the given
+// mode; it is released while waiting and held again on return.
+//
+// @param shard : Shard holding the entry
+// @param index : Entry to wait for
+// @param readOnly : Whether the caller holds the reader (shared) lock rather than the writer (exclusive) lock
+void ShaderCache::waitForEntry(ShaderIndexShard &shard, ShaderIndex *index, bool readOnly) {
+  // The waiter count may be updated under the shared lock. It is still seen by the compiling thread, which can only
+  // complete the entry while holding the exclusive lock.
+  index->waiterCount.fetch_add(1, std::memory_order_relaxed);
+  // The entry may be compiled by a paused background build, which must be allowed to go on.
+  ForegroundBuildWaitScope waitScope;
+  const auto waitStart = std::chrono::steady_clock::now();
+
+  auto isDone = [index]() { return index->state != ShaderEntryState::Compiling; };
+  if (readOnly) {
+    std::shared_lock<std::shared_timed_mutex> lock(shard.lock, std::adopt_lock);
+    shard.entryReady.wait(lock, isDone);
+    lock.release();
+  } else {
+    std::unique_lock<std::shared_timed_mutex> lock(shard.lock, std::adopt_lock);
+    shard.entryReady.wait(lock, isDone);
+    lock.release();
+  }
+
+  index->waiterCount.fetch_sub(1, std::memory_order_relaxed);
+  m_waitCount.fetch_add(1, std::memory_order_relaxed);
+  m_waitTime.fetch_add(getElapsedMicroseconds(waitStart), std::memory_order_relaxed);
+}
 
-  return *size > 0 ? Result::Success : Result::ErrorUnknown;
+// =====================================================================================================================
+// Moves an entry out of the Compiling state and wakes the threads waiting for it. The caller must hold the writer
+// lock of the shard, so a waiter cannot miss the state change between checking it and starting to wait.
+//
+// @param shard : Shard holding the entry
+// @param index : Entry that has finished compiling
+// @param state : New state of the entry
+void ShaderCache::completeEntry(ShaderIndexShard &shard, ShaderIndex *index, ShaderEntryState state) {
+  index->state = state;
+  if (index->waiterCount.load(std::memory_order_relaxed) != 0)
+    shard.entryReady.notify_all();
 }
 
 // =====================================================================================================================
-// Adds data for a new shader to the on-disk file
+// Adds data for a new shader to the on-disk file. The data is queued for the file writer thread, which writes it
+// together with the other queued shaders.
+//
+// NOTE: This function assumes that m_lock has already been taken by the calling function.
 //
 // @param index : A new shader
 void ShaderCache::addShaderToFile(const ShaderIndex *index) {
   assert(m_onDiskFile.isOpen());
 
-  // We only need to update the parts of the file that changed, which is the number of shaders, the new data section,
-  // and the shaderDataEnd.
+  // The location of the shader in the file is decided now, even though it is only written later. Shaders are queued in
+  // the same order, so they end up at these locations.
+  ShaderCacheTocEntry tocEntry = {};
+  tocEntry.header = index->header;
+  tocEntry.offset = m_shaderDataEnd;
+  m_fileTocIndex[tocEntry.header.key] = m_fileToc.size();
+  m_fileToc.push_back(tocEntry);
+  m_liveFileDataSize += tocEntry.header.size;
+  m_shaderDataEnd += index->header.size;
 
-  // Calculate the header offsets, then write the relavent data to the file.
-  const unsigned shaderCountOffset = offsetof(struct ShaderCacheSerializedHeader, shaderCount);
-  const unsigned dataEndOffset = offsetof(struct ShaderCacheSerializedHeader, shaderDataEnd);
+  {
+    std::lock_guard<std::mutex> journalLock(m_journalLock);
+    const uint8_t *const data = static_cast<const uint8_t *>(index->dataBlob);
+    m_pendingFileData.insert(m_pendingFileData.end(), data, data + index->header.size);
+    ++m_pendingShaderCount;
+    if (m_sharedFile)
+      m_pendingInFlightKeys.push_back(index->header.key);
+  }
+  m_journalCond.notify_one();
+}
 
-  m_onDiskFile.seek(shaderCountOffset, true);
-  m_onDiskFile.write(&m_totalShaders, sizeof(size_t));
+// =====================================================================================================================
+// Starts the thread that writes new shaders to the on-disk file.
+void ShaderCache::startFileWriter() {
+  assert(!m_fileWriter.joinable());
+  m_stopFileWriter = false;
+  m_fileWriter = std::thread([this]() { runFileWriter(); });
+}
 
-  // Write the new shader data at the current end of the data section
-  m_onDiskFile.seek(static_cast<unsigned>(m_shaderDataEnd), true);
-  m_onDiskFile.write(index->dataBlob, index->header.size);
+// =====================================================================================================================
+// Stops the thread that writes new shaders to the on-disk file, once it has written all of the queued shaders.
+void ShaderCache::stopFileWriter() {
+  if (!m_fileWriter.joinable())
+    return;
+
+  {
+    std::lock_guard<std::mutex> journalLock(m_journalLock);
+    m_stopFileWriter = true;
+  }
+  m_journalCond.notify_one();
+  m_fileWriter.join();
+}
 
-  // Then update the data end value and write it out to the file.
-  m_shaderDataEnd += index->header.size;
-  m_onDiskFile.seek(dataEndOffset, true);
-  m_onDiskFile.write(&m_shaderDataEnd, sizeof(size_t));
+// =====================================================================================================================
+// Main function of the file writer thread. Every time it wakes up, it writes all of the shaders queued since it last
+// did, so the more shaders are added at a time, the larger the batches are.
+void ShaderCache::runFileWriter() {
+  std::unique_lock<std::mutex> journalLock(m_journalLock);
+  while (true) {
+    m_journalCond.wait(journalLock, [this]() { return m_stopFileWriter || m_pendingShaderCount != 0; });
+    if (m_pendingShaderCount == 0)
+      break;
+
+    journalLock.unlock();
+    {
+      std::lock_guard<std::mutex> fileLock(m_fileLock);
+      writePendingShaders();
+    }
+    journalLock.lock();
+  }
+}
+
+// =====================================================================================================================
+// Writes the queued shaders to the on-disk file with a single write, then commits them by updating the header. A
+// crash at any point leaves a consistent file: until the header is updated, the new data is beyond the end of the
+// shader data and is ignored.
+//
+// NOTE: This function assumes that m_fileLock has already been taken by the calling function.
+void ShaderCache::writePendingShaders() {
+  std::vector<uint8_t> fileData;
+  size_t shaderCount = 0;
+  std::vector<uint64_t> inFlightKeys;
+  {
+    std::lock_guard<std::mutex> journalLock(m_journalLock);
+    std::swap(fileData, m_pendingFileData);
+    std::swap(shaderCount, m_pendingShaderCount);
+    std::swap(inFlightKeys, m_pendingInFlightKeys);
+  }
+
+  if (m_sharedFile) {
+    if (shaderCount != 0 && m_onDiskFile.isOpen())
+      appendToSharedFile(fileData, shaderCount);
+
+    // Other processes can find the shaders in the file now, so they do not have to wait for them any more.
+    for (uint64_t hashKey : inFlightKeys)
+      releaseInFlightMarker(hashKey);
+    return;
+  }
+
+  if (shaderCount == 0 || !m_onDiskFile.isOpen())
+    return;
+
+  // The new data overwrites the table of contents, so it has to be invalidated first.
+  Result result = Result::Success;
+  if (m_fileTocValid) {
+    result = writeFileCommitRecord(m_committedShaderCount, m_committedDataEnd, 0);
+    m_fileTocValid = false;
+  }
+
+  if (result == Result::Success) {
+    m_onDiskFile.seek(static_cast<unsigned>(m_committedDataEnd), true);
+    result = m_onDiskFile.write(fileData.data(), fileData.size());
+  }
+  if (result == Result::Success)
+    result = m_onDiskFile.flush();
+
+  // If anything failed, these shaders are not committed and the header still describes the data before them. Later
+  // shaders are written in their place, so the file stays consistent, but the table of contents no longer matches it
+  // and is neither written out nor used for compaction.
+  if (result == Result::Success)
+    result = writeFileCommitRecord(m_committedShaderCount + shaderCount, m_committedDataEnd + fileData.size(), 0);
+  if (result == Result::Success) {
+    m_committedShaderCount += shaderCount;
+    m_committedDataEnd += fileData.size();
+  }
+}
+
+// =====================================================================================================================
+// Updates the shader count, the end of the shader data and the offset of the table of contents in the header of the
+// on-disk file with a single write, and flushes it.
+//
+// NOTE: This function assumes that m_fileLock has already been taken by the calling function, or that no other
+// thread is using the cache.
+//
+// @param shaderCount : Number of shaders in the file
+// @param shaderDataEnd : Offset to the end of shader data
+// @param tocOffset : Offset to the table of contents, or zero if there is none
+Result ShaderCache::writeFileCommitRecord(size_t shaderCount, size_t shaderDataEnd, size_t tocOffset) {
+  static_assert(offsetof(ShaderCacheSerializedHeader, shaderDataEnd) ==
+                        offsetof(ShaderCacheSerializedHeader, shaderCount) + sizeof(size_t) &&
+                    offsetof(ShaderCacheSerializedHeader, tocOffset) ==
+                        offsetof(ShaderCacheSerializedHeader, shaderDataEnd) + sizeof(size_t),
+                "Commit record of the shader cache file must be contiguous");
+
+  const size_t commitRecord[] = {shaderCount, shaderDataEnd, tocOffset};
+  m_onDiskFile.seek(offsetof(ShaderCacheSerializedHeader, shaderCount), true);
+  Result result = m_onDiskFile.write(commitRecord, sizeof(commitRecord));
+  if (result == Result::Success)
+    result = m_onDiskFile.flush();
+  return result;
+}
+
+// =====================================================================================================================
+// Takes the lock file of the shared on-disk file, blocking until no other process holds it.
+//
+// NOTE: Other threads of this process are excluded by m_fileLock, or by m_lock during initialization.
+Result ShaderCache::lockSharedFile() {
+  if (m_sharedFileLockFd < 0 || sys::fs::lockFile(m_sharedFileLockFd))
+    return Result::ErrorUnavailable;
+  return Result::Success;
+}
+
+// =====================================================================================================================
+// Releases the lock file of the shared on-disk file.
+void ShaderCache::unlockSharedFile() {
+  sys::fs::unlockFile(m_sharedFileLockFd);
+}
+
+// =====================================================================================================================
+// Reads the header of the shared on-disk file, which other processes may have updated since it was last read.
+//
+// NOTE: This function assumes that m_fileLock and the lock file have been taken by the calling function.
+//
+// @param [out] header : Header of the file
+Result ShaderCache::readSharedFileHeader(ShaderCacheSerializedHeader *header) {
+  size_t bytesRead = 0;
+  m_onDiskFile.seek(0, true);
+  Result result = m_onDiskFile.read(header, sizeof(ShaderCacheSerializedHeader), &bytesRead);
+
+  // A process with a different build or different options may have reset the file, then it cannot be shared.
+  if (result == Result::Success &&
+      (bytesRead != sizeof(ShaderCacheSerializedHeader) || !isHeaderCompatible(header) ||
+       header->shaderDataEnd < sizeof(ShaderCacheSerializedHeader) ||
+       header->shaderDataEnd > File::getFileSize(m_fileFullPath)))
+    result = Result::ErrorUnknown;
+  return result;
+}
+
+// =====================================================================================================================
+// Appends shaders to the shared on-disk file after the shaders committed by any process, then commits them. The file
+// has no table of contents while it is shared.
+//
+// NOTE: This function assumes that m_fileLock has already been taken by the calling function.
+//
+// @param fileData : Data of the shaders, each of them starting with its header
+// @param shaderCount : Number of shaders in the data
+void ShaderCache::appendToSharedFile(const std::vector<uint8_t> &fileData, size_t shaderCount) {
+  if (lockSharedFile() != Result::Success)
+    return;
+
+  ShaderCacheSerializedHeader header = {};
+  Result result = readSharedFileHeader(&header);
+  if (result == Result::Success) {
+    m_onDiskFile.seek(static_cast<unsigned>(header.shaderDataEnd), true);
+    result = m_onDiskFile.write(fileData.data(), fileData.size());
+  }
+  if (result == Result::Success)
+    result = m_onDiskFile.flush();
+  if (result == Result::Success)
+    result = writeFileCommitRecord(header.shaderCount + shaderCount, header.shaderDataEnd + fileData.size(), 0);
+
+  // If other processes have added shaders since the last import, they are imported later together with ours, which are
+  // skipped then as they are in the cache already.
+  if (result == Result::Success && header.shaderDataEnd == m_importedDataEnd)
+    m_importedDataEnd += fileData.size();
+
+  unlockSharedFile();
+}
+
+// =====================================================================================================================
+// Adds the shaders that other processes have appended to the shared on-disk file since the last import to the cache.
+// Shaders that are already in the cache are skipped, except for the claimed entry, which is filled in (but stays in
+// the Compiling state) if its shader is found. Returns whether it was.
+//
+// @param claimedIndex : Entry this thread has claimed for compilation
+bool ShaderCache::importSharedShaders(ShaderIndex *claimedIndex) {
+  // The new data is read while holding the file locks, and added to the cache after releasing them, as the shard
+  // locks have to be taken before them.
+  std::vector<uint8_t> fileData;
+  {
+    std::lock_guard<std::mutex> fileLock(m_fileLock);
+    if (!m_onDiskFile.isOpen() || lockSharedFile() != Result::Success)
+      return false;
+
+    ShaderCacheSerializedHeader header = {};
+    Result result = readSharedFileHeader(&header);
+    if (result == Result::Success && header.shaderDataEnd > m_importedDataEnd) {
+      fileData.resize(header.shaderDataEnd - m_importedDataEnd);
+      size_t bytesRead = 0;
+      m_onDiskFile.seek(static_cast<unsigned>(m_importedDataEnd), true);
+      result = m_onDiskFile.read(fileData.data(), fileData.size(), &bytesRead);
+      if (result == Result::Success && bytesRead == fileData.size())
+        m_importedDataEnd = header.shaderDataEnd;
+      else
+        fileData.clear();
+    } else if (result == Result::Success)
+      m_importedDataEnd = header.shaderDataEnd;
+
+    unlockSharedFile();
+  }
 
-  m_onDiskFile.flush();
+  if (fileData.empty())
+    return false;
+
+  // The allocation starts out with one entry, which keeps it alive until all of the shaders have been added, even if
+  // some of them are evicted again right away.
+  ShaderCacheAllocation *allocation = nullptr;
+  void *dataMem = nullptr;
+  {
+    std::lock_guard<sys::Mutex> lock(m_lock);
+    dataMem = getCacheSpace(fileData.size(), &allocation);
+  }
+  memcpy(dataMem, fileData.data(), fileData.size());
+
+  bool claimedFound = false;
+  size_t dataOffset = 0;
+  while (dataOffset + sizeof(ShaderHeader) <= fileData.size()) {
+    auto *const header = static_cast<ShaderHeader *>(voidPtrInc(dataMem, dataOffset));
+    if (header->size < sizeof(ShaderHeader) || header->size > fileData.size() - dataOffset)
+      break;
+    dataOffset += header->size;
+
+    if (calculateCrc(reinterpret_cast<const uint8_t *>(header + 1), header->size - sizeof(ShaderHeader)) != header->crc)
+      continue;
+
+    ShaderIndexShard &shard = getIndexShard(header->key);
+    lockIndexShard(shard, false);
+
+    ShaderIndex *index = nullptr;
+    auto indexMap = shard.indexMap.find(header->key);
+    if (indexMap == shard.indexMap.end()) {
+      index = new ShaderIndex();
+      index->state = ShaderEntryState::Ready;
+      shard.indexMap[header->key] = index;
+    } else if (indexMap->second == claimedIndex) {
+      index = claimedIndex;
+      claimedFound = true;
+    }
+
+    if (index) {
+      index->header = (*header);
+      index->dataBlob = header;
+      index->allocation = allocation;
+      index->lastUse.store(m_useCounter.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      m_cacheDataSize += header->size;
+
+      std::lock_guard<sys::Mutex> lock(m_lock);
+      ++allocation->entryCount;
+      ++m_totalShaders;
+    }
+
+    unlockIndexShard(shard, false);
+  }
+
+  {
+    std::lock_guard<sys::Mutex> lock(m_lock);
+    releaseCacheSpace(allocation);
+    freeUnusedCacheSpace();
+  }
+
+  if (isOverBudget(false))
+    evictShaders();
+
+  return claimedFound;
+}
+
+// =====================================================================================================================
+// Checks whether another process has added a shader this thread has claimed for compilation to the shared on-disk
+// file, and waits while another process is compiling it. Returns true if the shader has been found, then the entry is
+// filled in. Otherwise the shader is marked as in flight for this process, unless waiting for it timed out.
+//
+// @param index : Entry this thread has claimed for compilation
+bool ShaderCache::waitForSharedShader(ShaderIndex *index) {
+  const uint64_t hashKey = index->header.key;
+  const auto waitStart = std::chrono::steady_clock::now();
+  const auto deadline = waitStart + std::chrono::milliseconds(ShaderCacheInFlightTimeout);
+
+  // Threads of this process wait for the entry on its condition variable, only this thread polls the file. The polls
+  // back off from 1 ms to MaxSharedShaderPollInterval, so a shader that is nearly done is picked up quickly, while a
+  // long compile in the other process does not keep taking the lock file.
+  static const unsigned MaxSharedShaderPollInterval = 64;
+  unsigned pollInterval = 1;
+  bool found = false;
+  bool waited = false;
+  while (true) {
+    // The file is checked after the shader has been marked, so another process cannot commit it in between unnoticed.
+    const bool marked = markShaderInFlight(hashKey);
+    found = importSharedShaders(index);
+    if (found && marked)
+      releaseInFlightMarker(hashKey);
+
+    const auto now = std::chrono::steady_clock::now();
+    if (found || marked || now >= deadline)
+      break;
+
+    std::this_thread::sleep_for(
+        std::min<std::chrono::steady_clock::duration>(std::chrono::milliseconds(pollInterval), deadline - now));
+    pollInterval = std::min(pollInterval * 2, MaxSharedShaderPollInterval);
+    waited = true;
+  }
+
+  if (waited) {
+    m_waitCount.fetch_add(1, std::memory_order_relaxed);
+    m_waitTime.fetch_add(getElapsedMicroseconds(waitStart), std::memory_order_relaxed);
+  }
+  return found;
+}
+
+// =====================================================================================================================
+// Marks a shader as being compiled by this process, with a marker file that stays locked until the shader has been
+// committed to the shared on-disk file. Returns false if another process holds the marker of the shader.
+//
+// A marker is stale if it exists but is not locked, because the process that created it is just removing it or has
+// died. Stale markers are removed, which in rare cases lets two processes compile the same shader. That is harmless,
+// only the first copy of a shader in the file is used.
+//
+// @param hashKey : Key of the shader
+bool ShaderCache::markShaderInFlight(uint64_t hashKey) {
+  std::lock_guard<std::mutex> inFlightLock(m_inFlightLock);
+  if (m_inFlightMarkers.find(hashKey) != m_inFlightMarkers.end())
+    return true;
+
+  const std::string markerPath = getInFlightMarkerPath(hashKey);
+  for (unsigned attempt = 0; attempt < 4; ++attempt) {
+    int markerFd = -1;
+    std::error_code errCode =
+        sys::fs::openFileForReadWrite(markerPath, markerFd, sys::fs::CD_CreateNew, sys::fs::OF_None);
+    if (!errCode) {
+      if (!sys::fs::tryLockFile(markerFd)) {
+        m_inFlightMarkers[hashKey] = markerFd;
+        return true;
+      }
+      // Another process has taken the new marker for a stale one already.
+      sys::Process::SafelyCloseFileDescriptor(markerFd);
+      return false;
+    }
+
+    // Without a usable marker file the shader is compiled without waiting for other processes.
+    if (errCode != std::errc::file_exists)
+      return true;
+
+    // The marker may have been removed since it was found, then there is nothing to wait for.
+    if (sys::fs::openFileForReadWrite(markerPath, markerFd, sys::fs::CD_OpenExisting, sys::fs::OF_None))
+      continue;
+
+    const bool stale = !sys::fs::tryLockFile(markerFd);
+    if (stale) {
+      sys::fs::remove(markerPath);
+      sys::fs::unlockFile(markerFd);
+    }
+    sys::Process::SafelyCloseFileDescriptor(markerFd);
+    if (!stale)
+      return false;
+  }
+
+  return false;
+}
+
+// =====================================================================================================================
+// Removes the in-flight marker of a shader, if this process holds it, so other processes stop waiting for the shader.
+//
+// @param hashKey : Key of the shader
+void ShaderCache::releaseInFlightMarker(uint64_t hashKey) {
+  std::lock_guard<std::mutex> inFlightLock(m_inFlightLock);
+  auto marker = m_inFlightMarkers.find(hashKey);
+  if (marker == m_inFlightMarkers.end())
+    return;
+
+  // The marker is removed before it is unlocked, so a process that opened it in the meantime finds it stale, and then
+  // finds the shader in the file.
+  sys::fs::remove(getInFlightMarkerPath(hashKey));
+  sys::fs::unlockFile(marker->second);
+  sys::Process::SafelyCloseFileDescriptor(marker->second);
+  m_inFlightMarkers.erase(marker);
+}
+
+// =====================================================================================================================
+// Gets the path of the in-flight marker file of a shader, which is next to the on-disk file.
+//
+// @param hashKey : Key of the shader
+std::string ShaderCache::getInFlightMarkerPath(uint64_t hashKey) const {
+  return std::string(m_fileFullPath) + "." + utohexstr(hashKey) + ".inflight";
 }
 
 // =====================================================================================================================
@@ -667,13 +1518,16 @@ Result ShaderCache::loadCacheFromFile() {
   m_onDiskFile.read(&header, sizeof(ShaderCacheSerializedHeader), nullptr);
 
   const size_t fileSize = File::getFileSize(m_fileFullPath);
-  const size_t dataSize = fileSize - sizeof(ShaderCacheSerializedHeader);
   Result result = validateAndLoadHeader(&header, fileSize);
 
+  // Anything after the end of the shader data (e.g. the table of contents) is not loaded.
+  size_t dataSize = 0;
+  ShaderCacheAllocation *allocation = nullptr;
   void *dataMem = nullptr;
   if (result == Result::Success) {
     // The header is valid, so allocate space to fit all of the shader data.
-    dataMem = getCacheSpace(dataSize);
+    dataSize = m_shaderDataEnd - sizeof(ShaderCacheSerializedHeader);
+    dataMem = getCacheSpace(dataSize, &allocation);
   }
 
   if (result == Result::Success) {
@@ -692,10 +1546,15 @@ Result ShaderCache::loadCacheFromFile() {
 
   if (result == Result::Success) {
     // Now setup the shader index hash map.
-    result = populateIndexMap(dataMem, dataSize);
+    result = populateIndexMap(dataMem, dataSize, allocation);
   }
 
-  if (result != Result::Success) {
+  if (result == Result::Success) {
+    addEntriesToToc(dataMem, dataSize);
+    m_committedShaderCount = m_totalShaders;
+    m_committedDataEnd = m_shaderDataEnd;
+    m_fileTocValid = header.tocOffset == header.shaderDataEnd;
+  } else {
     // Something went wrong in loading the file, so reset it
     resetCacheFile();
   }
@@ -703,6 +1562,134 @@ Result ShaderCache::loadCacheFromFile() {
   return result;
 }
 
+// =====================================================================================================================
+// Maps the cache file into memory and sets up the shader index hash map for the shaders in it. The shader data stays
+// in the mapping, and the CRC of each shader is only checked when it is first retrieved. Returns success if the file
+// was mapped and its header and table of contents are valid.
+//
+// NOTE: This function assumes that a write lock has already been taken by the calling function.
+Result ShaderCache::loadCacheFromMappedFile() {
+  assert(!m_mappedFile);
+
+  Expected<sys::fs::file_t> file = sys::fs::openNativeFileForRead(m_fileFullPath);
+  if (!file) {
+    consumeError(file.takeError());
+    return Result::ErrorUnavailable;
+  }
+
+  const size_t fileSize = File::getFileSize(m_fileFullPath);
+  Result result = fileSize >= sizeof(ShaderCacheSerializedHeader) ? Result::Success : Result::ErrorUnknown;
+  if (result == Result::Success) {
+    std::error_code errCode;
+    m_mappedFile = std::make_unique<sys::fs::mapped_file_region>(*file, sys::fs::mapped_file_region::readonly,
+                                                                 fileSize, 0, errCode);
+    if (errCode) {
+      m_mappedFile.reset();
+      result = Result::ErrorUnknown;
+    }
+  }
+  sys::fs::closeFile(*file);
+
+  ShaderCacheSerializedHeader header = {};
+  if (result == Result::Success) {
+    memcpy(&header, m_mappedFile->const_data(), sizeof(ShaderCacheSerializedHeader));
+    result = validateAndLoadHeader(&header, fileSize);
+  }
+
+  if (result == Result::Success) {
+    const char *const fileData = m_mappedFile->const_data();
+    // The table of contents is only valid if no shader was added to the file after it had been written.
+    const bool hasToc = header.tocOffset == m_shaderDataEnd &&
+                        m_shaderDataEnd + m_totalShaders * sizeof(ShaderCacheTocEntry) <= fileSize;
+
+    size_t dataOffset = sizeof(ShaderCacheSerializedHeader);
+    for (size_t shader = 0; (shader < m_totalShaders && result == Result::Success); ++shader) {
+      // Without a table of contents, walk the headers stored with the shader data instead.
+      ShaderCacheTocEntry tocEntry = {};
+      if (hasToc)
+        memcpy(&tocEntry, fileData + m_shaderDataEnd + shader * sizeof(ShaderCacheTocEntry), sizeof(tocEntry));
+      else if (dataOffset + sizeof(ShaderHeader) <= m_shaderDataEnd) {
+        memcpy(&tocEntry.header, fileData + dataOffset, sizeof(ShaderHeader));
+        tocEntry.offset = dataOffset;
+      }
+
+      // Guard against entries that are not within the shader data.
+      if (tocEntry.offset < sizeof(ShaderCacheSerializedHeader) || tocEntry.header.size < sizeof(ShaderHeader) ||
+          tocEntry.header.size > m_shaderDataEnd - tocEntry.offset) {
+        result = Result::ErrorUnknown;
+        break;
+      }
+      dataOffset = tocEntry.offset + tocEntry.header.size;
+
+      // NOTE: The cache is not visible to other threads while it is being initialized, so the shard does not need
+      // to be locked here.
+      ShaderIndexMap &indexMap = getIndexShard(tocEntry.header.key).indexMap;
+      if (indexMap.find(tocEntry.header.key) == indexMap.end()) {
+        ShaderIndex *index = new ShaderIndex();
+        index->header = tocEntry.header;
+        index->dataBlob = const_cast<char *>(fileData + tocEntry.offset);
+        index->state = ShaderEntryState::Ready;
+        index->needsCrcCheck = true;
+        indexMap[tocEntry.header.key] = index;
+      }
+    }
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+// Adds the shaders in the specified shader data, which has been loaded from the cache file, to the table of contents
+// of the file.
+//
+// @param dataStart : Start pointer of cached shader data
+// @param dataSize : Shader data size in bytes
+void ShaderCache::addEntriesToToc(const void *dataStart, size_t dataSize) {
+  m_fileToc.clear();
+  m_fileToc.reserve(m_totalShaders);
+  m_fileTocIndex.clear();
+  m_liveFileDataSize = 0;
+
+  size_t dataOffset = 0;
+  for (unsigned shader = 0; shader < m_totalShaders; ++shader) {
+    assert(dataOffset + sizeof(ShaderHeader) <= dataSize);
+
+    ShaderCacheTocEntry tocEntry = {};
+    memcpy(&tocEntry.header, voidPtrInc(dataStart, dataOffset), sizeof(ShaderHeader));
+    tocEntry.offset = sizeof(ShaderCacheSerializedHeader) + dataOffset;
+    // Like the shader index, only the first copy of a duplicated shader is kept.
+    if (m_fileTocIndex.insert({tocEntry.header.key, m_fileToc.size()}).second)
+      m_liveFileDataSize += tocEntry.header.size;
+    m_fileToc.push_back(tocEntry);
+
+    dataOffset += tocEntry.header.size;
+  }
+}
+
+// =====================================================================================================================
+// Writes the table of contents after the shader data in the on-disk file, so the file can later be mapped without
+// reading all of the shader data.
+//
+// NOTE: This function assumes that the on-disk file is open for writing and no other thread is using the cache.
+void ShaderCache::writeTocToFile() {
+  assert(m_onDiskFile.isOpen());
+
+  // Shaders that were added without going through the file (e.g. by merging) are not in the table of contents, and
+  // all queued shaders must have been written.
+  if (m_fileToc.size() != m_totalShaders || m_committedDataEnd != m_shaderDataEnd)
+    return;
+
+  m_onDiskFile.seek(static_cast<unsigned>(m_shaderDataEnd), true);
+  Result result = m_onDiskFile.write(m_fileToc.data(), m_fileToc.size() * sizeof(ShaderCacheTocEntry));
+  if (result == Result::Success)
+    result = m_onDiskFile.flush();
+
+  // Only point the header at the table of contents once all of it has been written.
+  if (result == Result::Success)
+    result = writeFileCommitRecord(m_committedShaderCount, m_committedDataEnd, m_shaderDataEnd);
+  m_fileTocValid = result == Result::Success;
+}
+
 // =====================================================================================================================
 // Loads all shader data from a client provided initial data blob. Returns true if the file contents were loaded
 // successfully or false if invalid data was found.
@@ -721,12 +1708,13 @@ Result ShaderCache::loadCacheFromBlob(const void *initialData, size_t initialDat
   if (result == Result::Success) {
     // The header appears valid so allocate space for the shader data.
     const size_t dataSize = initialDataSize - header->headerSize;
-    void *dataMem = getCacheSpace(dataSize);
+    ShaderCacheAllocation *allocation = nullptr;
+    void *dataMem = getCacheSpace(dataSize, &allocation);
 
     if (dataMem) {
       // Then copy the data and setup the shader index hash map.
       memcpy(dataMem, voidPtrInc(initialData, header->headerSize), dataSize);
-      result = populateIndexMap(dataMem, dataSize);
+      result = populateIndexMap(dataMem, dataSize, allocation);
     } else
       result = Result::ErrorOutOfMemory;
   }
@@ -740,13 +1728,15 @@ Result ShaderCache::loadCacheFromBlob(const void *initialData, size_t initialDat
 //
 // @param dataStart : Start pointer of cached shader data
 // @param dataSize : Shader data size in bytes
-Result ShaderCache::populateIndexMap(void *dataStart, size_t dataSize) {
+// @param allocation : Memory holding the shader data
+Result ShaderCache::populateIndexMap(void *dataStart, size_t dataSize, ShaderCacheAllocation *allocation) {
   Result result = Result::Success;
 
   // Iterate through all of the entries to verify the data CRC, zero out the GPU memory pointer/offset and add to the
   // hashmap. We zero out the GPU memory data here because we're already iterating through each entry, rather than
   // take the hit each time we add shader data to the file.
   auto *header = static_cast<ShaderHeader *>(dataStart);
+  unsigned entryCount = 0;
 
   for (unsigned shader = 0; (shader < m_totalShaders && result == Result::Success); ++shader) {
     // Guard against buffer overruns.
@@ -762,14 +1752,19 @@ Result ShaderCache::populateIndexMap(void *dataStart, size_t dataSize) {
 
     if (crc == header->crc) {
       // It all checks out, so add this shader to the hash map!
+      // NOTE: The cache is not visible to other threads while it is being initialized, so the shard does not need
+      // to be locked here.
       ShaderIndex *index = nullptr;
-      auto indexMap = m_shaderIndexMap.find(header->key);
-      if (indexMap == m_shaderIndexMap.end()) {
-        index = new ShaderIndex;
+      ShaderIndexMap &indexMap = getIndexShard(header->key).indexMap;
+      if (indexMap.find(header->key) == indexMap.end()) {
+        index = new ShaderIndex();
         index->header = (*header);
         index->dataBlob = header;
+        index->allocation = allocation;
         index->state = ShaderEntryState::Ready;
-        m_shaderIndexMap[header->key] = index;
+        indexMap[header->key] = index;
+        m_cacheDataSize += header->size;
+        ++entryCount;
       }
     } else
       result = Result::ErrorUnknown;
@@ -778,22 +1773,48 @@ Result ShaderCache::populateIndexMap(void *dataStart, size_t dataSize) {
     header = static_cast<ShaderHeader *>(voidPtrInc(header, header->size));
   }
 
+  // The memory is released once all of the shaders in it have been evicted.
+  allocation->entryCount = entryCount;
+
   return result;
 }
 
 // =====================================================================================================================
-// Caclulates a 64-bit CRC of the data provided
+// Caclulates a 64-bit CRC of the data provided. Eight bytes are processed per step using the slice-by-8 tables.
 //
 // @param data : Data need generate CRC
 // @param numBytes : Data size in bytes
 uint64_t ShaderCache::calculateCrc(const uint8_t *data, size_t numBytes) {
+  const auto &lookup = getCrcTables().lookup;
   uint64_t crc = CrcInitialValue;
-  for (unsigned byte = 0; byte < numBytes; ++byte) {
-    uint8_t tableIndex = static_cast<uint8_t>(crc >> (CrcWidth - 8)) & 0xFF;
-    crc = (crc << 8) ^ CrcLookup[tableIndex] ^ data[byte];
+
+  for (; numBytes >= 8; numBytes -= 8, data += 8) {
+    crc ^= support::endian::read64le(data);
+    crc = lookup[7][crc & 0xFF] ^ lookup[6][(crc >> 8) & 0xFF] ^ lookup[5][(crc >> 16) & 0xFF] ^
+          lookup[4][(crc >> 24) & 0xFF] ^ lookup[3][(crc >> 32) & 0xFF] ^ lookup[2][(crc >> 40) & 0xFF] ^
+          lookup[1][(crc >> 48) & 0xFF] ^ lookup[0][crc >> 56];
   }
 
-  return crc;
+  for (; numBytes > 0; --numBytes, ++data)
+    crc = lookup[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+
+  return crc ^ CrcInitialValue;
+}
+
+// =====================================================================================================================
+// Checks whether the provided header was written with the data layout, the build of LLPC, the graphics IP and the
+// compilation options of this shader cache.
+//
+// @param header : Cache file header
+bool ShaderCache::isHeaderCompatible(const ShaderCacheSerializedHeader *header) {
+  BuildUniqueId buildId;
+  getBuildTime(&buildId);
+
+  return header->headerSize == sizeof(ShaderCacheSerializedHeader) && header->version == ShaderCacheVersion &&
+         memcmp(header->buildId.buildDate, buildId.buildDate, sizeof(buildId.buildDate)) == 0 &&
+         memcmp(header->buildId.buildTime, buildId.buildTime, sizeof(buildId.buildTime)) == 0 &&
+         memcmp(&header->buildId.gfxIp, &buildId.gfxIp, sizeof(buildId.gfxIp)) == 0 &&
+         memcmp(&header->buildId.hash, &buildId.hash, sizeof(buildId.hash)) == 0;
 }
 
 // =====================================================================================================================
@@ -804,16 +1825,9 @@ uint64_t ShaderCache::calculateCrc(const uint8_t *data, size_t numBytes) {
 Result ShaderCache::validateAndLoadHeader(const ShaderCacheSerializedHeader *header, size_t dataSourceSize) {
   assert(header);
 
-  BuildUniqueId buildId;
-  getBuildTime(&buildId);
-
   Result result = Result::Success;
 
-  if (header->headerSize == sizeof(ShaderCacheSerializedHeader) &&
-      memcmp(header->buildId.buildDate, buildId.buildDate, sizeof(buildId.buildDate)) == 0 &&
-      memcmp(header->buildId.buildTime, buildId.buildTime, sizeof(buildId.buildTime)) == 0 &&
-      memcmp(&header->buildId.gfxIp, &buildId.gfxIp, sizeof(buildId.gfxIp)) == 0 &&
-      memcmp(&header->buildId.hash, &buildId.hash, sizeof(buildId.hash)) == 0) {
+  if (isHeaderCompatible(header)) {
     // The header appears valid so copy the header data to the runtime cache
     m_totalShaders = header->shaderCount;
     m_shaderDataEnd = header->shaderDataEnd;
@@ -829,17 +1843,249 @@ Result ShaderCache::validateAndLoadHeader(const ShaderCacheSerializedHeader *hea
 }
 
 // =====================================================================================================================
-// Allocates memory from the shader cache's linear allocator. This function assumes that a write lock has been taken by
-// the calling function.
+// Allocates memory from the shader cache's linear allocator. This function assumes that m_lock has been taken by the
+// calling function.
+//
+// The allocation starts out holding one shader cache entry; callers that put several entries in it must update its
+// entry count.
 //
 // @param numBytes : Allocation size in bytes
-void *ShaderCache::getCacheSpace(size_t numBytes) {
+// @param [out] allocation : The allocation, which is needed to release the memory
+void *ShaderCache::getCacheSpace(size_t numBytes, ShaderCacheAllocation **allocation) {
   auto p = new uint8_t[numBytes];
-  m_allocationList.push_back(std::pair<uint8_t *, size_t>(p, numBytes));
-  m_serializedSize += numBytes;
+  m_allocationList.push_back({p, numBytes, 1});
+  *allocation = &m_allocationList.back();
   return p;
 }
 
+// =====================================================================================================================
+// Releases a shader cache entry held in an allocation. The memory is freed by the next call to freeUnusedCacheSpace
+// once no entry is held in it any more. This function assumes that m_lock has been taken by the calling function.
+//
+// @param allocation : Allocation holding the entry
+void ShaderCache::releaseCacheSpace(ShaderCacheAllocation *allocation) {
+  assert(allocation->entryCount > 0);
+  --allocation->entryCount;
+}
+
+// =====================================================================================================================
+// Frees the allocations that hold no shader cache entries. This function assumes that m_lock has been taken by the
+// calling function.
+void ShaderCache::freeUnusedCacheSpace() {
+  for (auto it = m_allocationList.begin(); it != m_allocationList.end();) {
+    if (it->entryCount == 0) {
+      delete[] it->mem;
+      it = m_allocationList.erase(it);
+    } else
+      ++it;
+  }
+}
+
+// =====================================================================================================================
+// Checks whether the shader data held in memory or in the on-disk file exceeds its budget.
+//
+// @param forEviction : Whether to check against the size eviction reduces the data to, rather than the budget. Eviction
+//                      goes below the budget so that it does not have to run again for every new shader.
+bool ShaderCache::isOverBudget(bool forEviction) {
+  const size_t memoryBudget = static_cast<size_t>(ShaderCacheMaxMemorySize) << 20;
+  const size_t fileBudget = static_cast<size_t>(ShaderCacheMaxFileSize) << 20;
+
+  if (memoryBudget != 0 && m_cacheDataSize > (forEviction ? memoryBudget - memoryBudget / 8 : memoryBudget))
+    return true;
+
+  if (fileBudget != 0) {
+    std::lock_guard<sys::Mutex> lock(m_lock);
+    if (m_onDiskFile.isOpen() && !m_sharedFile) {
+      // The file may hold the data of evicted shaders until it is compacted, which eviction cannot do anything about.
+      if (forEviction)
+        return sizeof(ShaderCacheSerializedHeader) + m_liveFileDataSize > fileBudget - fileBudget / 8;
+      return m_shaderDataEnd > fileBudget;
+    }
+  }
+
+  return false;
+}
+
+// =====================================================================================================================
+// Evicts the least recently used shaders until the shader data in memory and in the on-disk file is well within the
+// budgets again, then frees the memory that no longer holds any shaders and compacts the on-disk file if it is still
+// too large. Shaders that are being compiled, waited for or used cannot be evicted.
+void ShaderCache::evictShaders() {
+  // Only one thread needs to do this, the others can carry on without waiting for it.
+  std::unique_lock<std::mutex> evictionLock(m_evictionLock, std::try_to_lock);
+  if (!evictionLock.owns_lock())
+    return;
+
+  // Collect the entries that can be evicted, ordered from the least recently used one.
+  std::vector<std::pair<uint64_t, uint64_t>> candidates; // Pairs of the last use and the key of an entry
+  for (auto &shard : m_shaderIndexShards) {
+    lockIndexShard(shard, true);
+    for (auto it : shard.indexMap) {
+      if (it.second->state == ShaderEntryState::Ready && it.second->refCount == 0)
+        candidates.push_back({it.second->lastUse.load(std::memory_order_relaxed), it.first});
+    }
+    unlockIndexShard(shard, true);
+  }
+  std::sort(candidates.begin(), candidates.end());
+
+  for (auto candidate : candidates) {
+    if (!isOverBudget(true))
+      break;
+
+    ShaderIndexShard &shard = getIndexShard(candidate.second);
+    lockIndexShard(shard, false);
+
+    // The entry may have been used since it was collected, and then it is not one of the least recently used any more.
+    auto it = shard.indexMap.find(candidate.second);
+    if (it != shard.indexMap.end()) {
+      ShaderIndex *index = it->second;
+      if (index->state == ShaderEntryState::Ready && index->refCount == 0 && index->waiterCount == 0 &&
+          index->lastUse.load(std::memory_order_relaxed) == candidate.first) {
+        shard.indexMap.erase(it);
+        removeEvictedShader(index);
+      }
+    }
+
+    unlockIndexShard(shard, false);
+  }
+
+  std::lock_guard<sys::Mutex> lock(m_lock);
+  freeUnusedCacheSpace();
+
+  const size_t fileBudget = static_cast<size_t>(ShaderCacheMaxFileSize) << 20;
+  if (m_onDiskFile.isOpen() && !m_sharedFile && fileBudget != 0 && m_shaderDataEnd > fileBudget)
+    compactCacheFile();
+}
+
+// =====================================================================================================================
+// Releases the memory and the on-disk file data of a shader that has been removed from the index map, and deletes its
+// index. This function assumes that the writer lock of the shard that held the shader has been taken by the calling
+// function.
+//
+// @param index : Index of the evicted shader
+void ShaderCache::removeEvictedShader(ShaderIndex *index) {
+  std::lock_guard<sys::Mutex> lock(m_lock);
+
+  if (index->allocation) {
+    m_cacheDataSize -= index->header.size;
+    releaseCacheSpace(index->allocation);
+  }
+  m_evictedBytes.fetch_add(index->header.size, std::memory_order_relaxed);
+
+  // The data stays in the on-disk file until it is compacted.
+  auto tocIndex = m_fileTocIndex.find(index->header.key);
+  if (tocIndex != m_fileTocIndex.end()) {
+    m_liveFileDataSize -= m_fileToc[tocIndex->second].header.size;
+    m_fileTocIndex.erase(tocIndex);
+  }
+
+  delete index;
+}
+
+// =====================================================================================================================
+// Rewrites the on-disk file with only the shaders that are still in the cache, which drops evicted and duplicated
+// shaders. The new file is written next to the old one and then renamed over it, so the old file stays intact if
+// anything goes wrong.
+//
+// NOTE: This function assumes that m_lock has already been taken by the calling function. It takes m_fileLock itself.
+Result ShaderCache::compactCacheFile() {
+  assert(m_onDiskFile.isOpen());
+
+  // The shaders queued for the file writer have to be in the file before it can be compacted.
+  std::lock_guard<std::mutex> fileLock(m_fileLock);
+  writePendingShaders();
+  if (!m_onDiskFile.isOpen() || m_committedDataEnd != m_shaderDataEnd)
+    return Result::ErrorUnknown;
+
+  std::string tempFilePath;
+  Result result = createTempCacheFile(m_fileFullPath, tempFilePath);
+  File tempFile;
+  if (result == Result::Success)
+    result = tempFile.open(tempFilePath.c_str(), (FileAccessWrite | FileAccessBinary));
+
+  ShaderCacheSerializedHeader header = {};
+  header.headerSize = sizeof(ShaderCacheSerializedHeader);
+  header.version = ShaderCacheVersion;
+  getBuildTime(&header.buildId);
+  if (result == Result::Success)
+    result = tempFile.write(&header, header.headerSize);
+
+  // Copy the data of the shaders that are still in the cache from the old file.
+  std::vector<ShaderCacheTocEntry> fileToc;
+  std::unordered_map<uint64_t, size_t> fileTocIndex;
+  std::vector<uint8_t> shaderData;
+  size_t shaderDataEnd = header.headerSize;
+  for (size_t i = 0; (i < m_fileToc.size() && result == Result::Success); ++i) {
+    ShaderCacheTocEntry tocEntry = m_fileToc[i];
+    auto tocIndex = m_fileTocIndex.find(tocEntry.header.key);
+    if (tocIndex == m_fileTocIndex.end() || tocIndex->second != i)
+      continue;
+
+    shaderData.resize(tocEntry.header.size);
+    size_t bytesRead = 0;
+    m_onDiskFile.seek(static_cast<unsigned>(tocEntry.offset), true);
+    result = m_onDiskFile.read(shaderData.data(), shaderData.size(), &bytesRead);
+    if (result == Result::Success && bytesRead != shaderData.size())
+      result = Result::ErrorUnknown;
+    if (result == Result::Success)
+      result = tempFile.write(shaderData.data(), shaderData.size());
+
+    tocEntry.offset = shaderDataEnd;
+    fileTocIndex[tocEntry.header.key] = fileToc.size();
+    fileToc.push_back(tocEntry);
+    shaderDataEnd += tocEntry.header.size;
+  }
+
+  if (result == Result::Success) {
+    header.shaderCount = fileToc.size();
+    header.shaderDataEnd = shaderDataEnd;
+    tempFile.seek(0, true);
+    result = tempFile.write(&header, header.headerSize);
+  }
+  if (result == Result::Success)
+    result = tempFile.flush();
+  tempFile.close();
+
+  if (result == Result::Success) {
+    m_onDiskFile.close();
+    if (!sys::fs::rename(tempFilePath, m_fileFullPath)) {
+      m_fileToc = std::move(fileToc);
+      m_fileTocIndex = std::move(fileTocIndex);
+      m_totalShaders = m_fileToc.size();
+      m_shaderDataEnd = shaderDataEnd;
+      m_committedShaderCount = m_totalShaders;
+      m_committedDataEnd = m_shaderDataEnd;
+      m_fileTocValid = false;
+    } else {
+      sys::fs::remove(tempFilePath);
+      result = Result::ErrorUnknown;
+    }
+
+    // Reopen whichever file is now in place. If that fails, the cache carries on without the file.
+    if (m_onDiskFile.open(m_fileFullPath, (FileAccessReadUpdate | FileAccessBinary)) != Result::Success)
+      result = Result::ErrorUnknown;
+  } else
+    sys::fs::remove(tempFilePath);
+
+  return result;
+}
+
+// =====================================================================================================================
+// Gets the statistics of the cache, accumulated since it was created.
+//
+// @param [out] statistics : Statistics of the cache
+void ShaderCache::getStatistics(CacheStatistics *statistics) const {
+  statistics->hitCount = m_hitCount.load(std::memory_order_relaxed);
+  statistics->missCount = m_missCount.load(std::memory_order_relaxed);
+  statistics->waitCount = m_waitCount.load(std::memory_order_relaxed);
+  statistics->waitTime = m_waitTime.load(std::memory_order_relaxed);
+  statistics->storedBytes = m_storedBytes.load(std::memory_order_relaxed);
+  statistics->evictedBytes = m_evictedBytes.load(std::memory_order_relaxed);
+  statistics->residentBytes = m_cacheDataSize.load(std::memory_order_relaxed);
+  statistics->loadTime = m_loadTime;
+  statistics->lockContentionCount = m_lockContentionCount.load(std::memory_order_relaxed);
+}
+
 // =====================================================================================================================
 // Returns the time & date that pipeline.cpp was compiled.
 //
@@ -31,22 +31,32 @@
 #pragma once
 
 #include "llpc.h"
+#include "llpcCompression.h"
 #include "llpcFile.h"
 #include "llpcUtil.h"
 #include "vkgcMetroHash.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Mutex.h"
+#include <atomic>
 #include <condition_variable>
 #include <list>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 namespace Llpc {
 
 // Header data that is stored with each shader in the cache.
 struct ShaderHeader {
-  uint64_t key; // Compacted hash key used to identify shaders
-  uint64_t crc; // CRC of the shader cache entry, used to detect data corruption.
-  size_t size;  // Total size of the shader data in the storage file
+  uint64_t key;           // Compacted hash key used to identify shaders
+  uint64_t crc;           // CRC of the shader cache entry, used to detect data corruption.
+  size_t size;            // Total size of the shader data in the storage file
+  CompressionCodec codec; // Codec the shader data is stored with
+  uint32_t rawSize;       // Size of the shader data after decompression
 };
 
 // Enum defining the states a shader cache entry can be in
@@ -66,17 +76,41 @@ enum ShaderCacheMode {
   ShaderCacheEnableOnDiskReadOnly = 4,     // Only read on-disk file with write-protection
 };
 
+// A block of memory allocated by the shader cache to hold shader data.
+struct ShaderCacheAllocation {
+  uint8_t *mem;        // Start of the memory
+  size_t size;         // Size of the memory in bytes
+  unsigned entryCount; // Number of shader cache entries whose data is held in this memory
+};
+
 // Stores data in the hash map of cached shaders and helps correlated a shader in the hash to a location in the
 // cache's linear allocators where the shader is actually stored.
 struct ShaderIndex {
-  ShaderHeader header;             // Shader header data (key, crc, size)
-  volatile ShaderEntryState state; // Shader entry state
-  void *dataBlob;                  // Serialized data blob representing a cached RelocatableShader object.
+  ShaderHeader header;                // Shader header data (key, crc, size)
+  volatile ShaderEntryState state;    // Shader entry state
+  void *dataBlob;                     // Serialized data blob representing a cached RelocatableShader object.
+  ShaderCacheAllocation *allocation;  // Memory holding the data blob, or null if it is not owned by the cache
+  std::atomic<unsigned> waiterCount;  // Number of threads waiting for this entry to leave the Compiling state
+  std::atomic<bool> needsCrcCheck;    // Whether the CRC of the data blob still has to be checked before it is used
+  std::atomic<unsigned> refCount;     // Number of users of the data blob, the entry cannot be evicted while it is used
+  std::atomic<uint64_t> lastUse;      // Value of the cache's use counter when the entry was last used
+  std::unique_ptr<uint8_t[]> rawData; // Decompressed data of a compressed data blob, kept while the entry is used
 };
 
 // The key in hash map is a 64-bit compacted Shader Hash
 typedef std::unordered_map<uint64_t, ShaderIndex *> ShaderIndexMap;
 
+// Number of shards the shader index map is split into. Must be a power of two.
+static constexpr unsigned ShaderIndexShardCount = 32;
+
+// One shard of the shader index map. Each shard has its own reader/writer lock so that lookups of different keys,
+// and concurrent lookups of the same key, do not serialize on a single cache-wide lock.
+struct ShaderIndexShard {
+  std::shared_timed_mutex lock;            // Reader/writer lock for access to this shard
+  std::condition_variable_any entryReady; // Signaled when an entry of this shard that has waiters leaves Compiling
+  ShaderIndexMap indexMap;                 // Shader index entries whose key maps to this shard
+};
+
 // Specifies auxiliary info necessary to create a shader cache object.
 struct ShaderCacheAuxCreateInfo {
   ShaderCacheMode shaderCacheMode; // Mode of shader cache
@@ -103,13 +137,31 @@ struct BuildUniqueId {
   MetroHash::Hash hash;          // Hash code of compilation options
 };
 
+// Version of the layout of the serialized shader cache data. It must be increased whenever the layout, or the way the
+// data is checked, changes.
+//  2: Slice-by-8 CRC-64/XZ of the shader data instead of the byte-wise CRC
+//  3: Shader data may be compressed, ShaderHeader records the codec and the uncompressed size
+//  4: The key of a shader in the client's external cache depends on this version
+static constexpr unsigned ShaderCacheVersion = 4;
+
 // This the header for the shader cache data when the cache is serialized/written to disk
 struct ShaderCacheSerializedHeader {
   size_t headerSize;     // Size of the header structure. This member must always be first
                          // since it is used to validate the serialized data.
+  unsigned version;      // Version of the serialized data layout (ShaderCacheVersion)
   BuildUniqueId buildId; // Build time/date of the PAL version that created the cache file
-  size_t shaderCount;    // Number of shaders in the shaderIndex array
-  size_t shaderDataEnd;  // Offset to the end of shader data
+  // NOTE: The following members form the commit record of the on-disk file. They must stay next to each other, so
+  // that they can be updated together with a single write.
+  size_t shaderCount;   // Number of shaders in the shaderIndex array
+  size_t shaderDataEnd; // Offset to the end of shader data
+  size_t tocOffset;     // Offset to the table of contents, only valid if it is equal to shaderDataEnd
+};
+
+// Entry of the table of contents that is written after the shader data when an on-disk cache file is closed. It
+// allows the shader index to be built without touching the shader data.
+struct ShaderCacheTocEntry {
+  ShaderHeader header; // Copy of the header stored with the shader data
+  size_t offset;       // Offset of the shader data (including its header) from the start of the file
 };
 
 constexpr unsigned MaxFilePathLen = 512;
@@ -139,43 +191,126 @@ public:
 
   Result retrieveShader(CacheEntryHandle hEntry, const void **ppBlob, size_t *size);
 
+  void releaseShader(CacheEntryHandle hEntry);
+
   bool isCompatible(const ShaderCacheCreateInfo *createInfo, const ShaderCacheAuxCreateInfo *auxCreateInfo);
 
+  void getStatistics(CacheStatistics *statistics) const;
+
 private:
   ShaderCache(const ShaderCache &) = delete;
   ShaderCache &operator=(const ShaderCache &) = delete;
 
   Result buildFileName(const char *executableName, const char *cacheFilePath, GfxIpVersion gfxIp,
                        bool *cacheFileExists);
+  bool isHeaderCompatible(const ShaderCacheSerializedHeader *header);
   Result validateAndLoadHeader(const ShaderCacheSerializedHeader *header, size_t dataSourceSize);
   Result loadCacheFromBlob(const void *initialData, size_t initialDataSize);
-  Result populateIndexMap(void *dataStart, size_t dataSize);
+  Result populateIndexMap(void *dataStart, size_t dataSize, ShaderCacheAllocation *allocation);
   uint64_t calculateCrc(const uint8_t *data, size_t numBytes);
 
   Result loadCacheFromFile();
+  Result loadCacheFromMappedFile();
   void resetCacheFile();
   void addShaderToFile(const ShaderIndex *index);
-
-  void *getCacheSpace(size_t numBytes);
-
-  // Lock cache map
-  void lockCacheMap(bool readOnly) { m_lock.lock(); }
-
-  // Unlock cache map
-  void unlockCacheMap(bool readOnly) { m_lock.unlock(); }
+  void addEntriesToToc(const void *dataStart, size_t dataSize);
+  void writeTocToFile();
+  Result compactCacheFile();
+
+  void startFileWriter();
+  void stopFileWriter();
+  void runFileWriter();
+  void writePendingShaders();
+  Result writeFileCommitRecord(size_t shaderCount, size_t shaderDataEnd, size_t tocOffset);
+
+  Result lockSharedFile();
+  void unlockSharedFile();
+  Result readSharedFileHeader(ShaderCacheSerializedHeader *header);
+  void appendToSharedFile(const std::vector<uint8_t> &fileData, size_t shaderCount);
+  bool importSharedShaders(ShaderIndex *claimedIndex);
+  bool waitForSharedShader(ShaderIndex *index);
+  bool markShaderInFlight(uint64_t hashKey);
+  void releaseInFlightMarker(uint64_t hashKey);
+  std::string getInFlightMarkerPath(uint64_t hashKey) const;
+
+  void *getCacheSpace(size_t numBytes, ShaderCacheAllocation **allocation);
+  void releaseCacheSpace(ShaderCacheAllocation *allocation);
+  void freeUnusedCacheSpace();
+
+  bool isOverBudget(bool forEviction);
+  void evictShaders();
+  void removeEvictedShader(ShaderIndex *index);
+
+  // Gets the shard of the shader index map that holds the specified key
+  ShaderIndexShard &getIndexShard(uint64_t hashKey) {
+    return m_shaderIndexShards[hashKey & (ShaderIndexShardCount - 1)];
+  }
+
+  void lockIndexShard(ShaderIndexShard &shard, bool readOnly);
+  void unlockIndexShard(ShaderIndexShard &shard, bool readOnly);
+  void waitForEntry(ShaderIndexShard &shard, ShaderIndex *index, bool readOnly);
+  void completeEntry(ShaderIndexShard &shard, ShaderIndex *index, ShaderEntryState state);
 
   bool useExternalCache() { return m_getValueFunc && m_storeValueFunc; }
 
   void resetRuntimeCache();
   void getBuildTime(BuildUniqueId *buildId);
 
-  llvm::sys::Mutex m_lock; // Read/Write lock for access to the shader cache hash map
-  File m_onDiskFile;       // File for on-disk storage of the cache
-  bool m_disableCache;     // Whether disable cache completely
-
-  // Map of shader index data which detail the hash, crc, size and CPU memory location for each shader
+  llvm::sys::Mutex m_lock;           // Lock for the linear allocator, the on-disk file and the shader counters
+  File m_onDiskFile;                 // File for on-disk storage of the cache
+  bool m_disableCache;               // Whether disable cache completely
+  ShaderCacheMode m_shaderCacheMode; // Mode of shader cache
+
+  // Read-only mapping of the on-disk file, which holds the data of all shaders loaded from it
+  std::unique_ptr<llvm::sys::fs::mapped_file_region> m_mappedFile;
+
+  // Table of contents of the shaders in the on-disk file, written out when the file is closed
+  std::vector<ShaderCacheTocEntry> m_fileToc;
+  // Map from the key of each shader in the cache to the entry of the table of contents that holds its data. Entries of
+  // the table of contents that are not in the map hold evicted or duplicated shaders, which are removed by compaction.
+  std::unordered_map<uint64_t, size_t> m_fileTocIndex;
+  size_t m_liveFileDataSize; // Size of the data in the on-disk file of the shaders that are still in the cache
+
+  // New shaders are written to the on-disk file in batches by a background thread, so compiling threads do not wait for
+  // the file I/O.
+  std::mutex m_fileLock;                  // Lock for the I/O of the on-disk file, taken after m_lock
+  std::mutex m_journalLock;               // Lock for the shader data waiting to be written, taken after m_fileLock
+  std::condition_variable m_journalCond;  // Signaled when there is shader data to write or the writer has to stop
+  std::vector<uint8_t> m_pendingFileData; // Data of the shaders waiting to be written to the on-disk file
+  size_t m_pendingShaderCount;            // Number of shaders in m_pendingFileData
+  bool m_stopFileWriter;                  // Whether the file writer has to stop once all shaders are written
+  std::thread m_fileWriter;               // Thread that writes new shaders to the on-disk file
+  size_t m_committedShaderCount;          // Number of shaders recorded in the header of the on-disk file
+  size_t m_committedDataEnd;              // End of the shader data recorded in the header of the on-disk file
+  bool m_fileTocValid;                    // Whether the header of the on-disk file points to a valid table of contents
+
+  // The on-disk file may be shared with other processes. Access to it is then serialized with a lock file next to it,
+  // and a shader that is being compiled is marked with a locked marker file, so that other processes wait for it to
+  // appear in the file instead of compiling it as well.
+  bool m_sharedFile;                                   // Whether the on-disk file is shared with other processes
+  int m_sharedFileLockFd;                              // Descriptor of the lock file of the shared on-disk file, or -1
+  size_t m_importedDataEnd;                            // End of the shader data of the shared on-disk file in the cache
+  std::vector<uint64_t> m_pendingInFlightKeys;         // Keys of the shaders in m_pendingFileData marked as in flight
+  std::mutex m_inFlightLock;                           // Lock for m_inFlightMarkers, taken after any other lock
+  std::unordered_map<uint64_t, int> m_inFlightMarkers; // Descriptors of the locked marker files of this process
+
+  std::mutex m_evictionLock;           // Lock that serializes eviction and compaction
+  std::atomic<size_t> m_cacheDataSize; // Size of the shader data held in memory owned by the cache
+  std::atomic<uint64_t> m_useCounter;  // Counter that orders the uses of cache entries, used for LRU eviction
+
+  // Sharded map of shader index data which detail the hash, crc, size and CPU memory location for each shader
   // in the cache.
-  ShaderIndexMap m_shaderIndexMap;
+  ShaderIndexShard m_shaderIndexShards[ShaderIndexShardCount];
+  std::atomic<uint64_t> m_lockContentionCount; // Number of times a shard lock could not be taken without blocking
+
+  // Statistics of the cache, see CacheStatistics
+  std::atomic<uint64_t> m_hitCount;     // Number of lookups that found a ready entry
+  std::atomic<uint64_t> m_missCount;    // Number of lookups that did not find a ready entry
+  std::atomic<uint64_t> m_waitCount;    // Number of lookups that waited for an entry being compiled
+  std::atomic<uint64_t> m_waitTime;     // Total time of these waits in microseconds
+  std::atomic<uint64_t> m_storedBytes;  // Total size of the shader data inserted into the cache
+  std::atomic<uint64_t> m_evictedBytes; // Total size of the shader data evicted from the cache
+  uint64_t m_loadTime;                  // Time spent loading the cache in init in microseconds
 
   // In memory copy of the shaderDataEnd and totalShaders stored in the on-disk file. We keep a copy to avoid having
   //  to do a read/modify/write of the value when adding a new shader.
@@ -184,15 +319,12 @@ private:
 
   char m_fileFullPath[MaxFilePathLen]; // Full path/filename of the shader cache on-disk file
 
-  std::list<std::pair<uint8_t *, size_t>> m_allocationList; // Memory allcoated by GetCacheSpace
-  unsigned m_serializedSize;                                // Serialized byte size of whole shader cache
-  std::mutex m_conditionMutex;                              // Mutex that will be used with the condition variable
-  std::condition_variable m_conditionVariable; // Condition variable that will be used to wait compile finish
-  const void *m_clientData;                    // Client data that will be used by function GetValue and StoreValue
-  ShaderCacheGetValue m_getValueFunc;          // GetValue function used to query an external cache for shader data
-  ShaderCacheStoreValue m_storeValueFunc;      // StoreValue function used to store shader data in an external cache
-  GfxIpVersion m_gfxIp;                        // Graphics IP version info
-  MetroHash::Hash m_hash;                      // Hash code of compilation options
+  std::list<ShaderCacheAllocation> m_allocationList; // Memory allcoated by GetCacheSpace
+  const void *m_clientData;               // Client data that will be used by function GetValue and StoreValue
+  ShaderCacheGetValue m_getValueFunc;     // GetValue function used to query an external cache for shader data
+  ShaderCacheStoreValue m_storeValueFunc; // StoreValue function used to store shader data in an external cache
+  GfxIpVersion m_gfxIp;                   // Graphics IP version info
+  MetroHash::Hash m_hash;                 // Hash code of compilation options
 };
 
 } // namespace Llpc
@@ -116,6 +116,9 @@ enum CacheAccessInfo : uint8_t {
   InternalCacheHit,    ///< cache hit using internal cache.
 };
 
+/// Count of CacheAccessInfo values
+static const unsigned CacheAccessInfoCount = InternalCacheHit + 1;
+
 /// Represents output of building a graphics pipeline.
 struct GraphicsPipelineBuildOut {
   BinaryData pipelineBin; ///< Output pipeline binary data
@@ -130,6 +133,99 @@ struct ComputePipelineBuildOut {
   CacheAccessInfo stageCacheAccess;    ///< Shader cache access status i.e., hit, miss, or not checked
 };
 
+/// Represents one pipeline of a batch built by ICompiler::BuildPipelines. Exactly one of pGraphicsInfo and
+/// pComputeInfo must be non-null, and the output of the same kind must be non-null too.
+struct PipelineBuildItem {
+  const GraphicsPipelineBuildInfo *pGraphicsInfo; ///< Info to build a graphics pipeline, or nullptr
+  const ComputePipelineBuildInfo *pComputeInfo;   ///< Info to build a compute pipeline, or nullptr
+  GraphicsPipelineBuildOut *pGraphicsOut;         ///< Output of building the graphics pipeline
+  ComputePipelineBuildOut *pComputeOut;           ///< Output of building the compute pipeline
+  Result result;                                  ///< Result of building the pipeline, set once it has been built
+};
+
+/// Defines callback function called by ICompiler::BuildPipelines when a pipeline of the batch has been built. It is
+/// called on the thread that built the pipeline, so it may be called concurrently for different pipelines. Pipelines
+/// that get a copy of the output of a pipeline have their copies made before it is called for any of them.
+typedef void (*PipelineBuildCallback)(void *pUserData, unsigned itemIndex, const PipelineBuildItem *pItem);
+
+/// Enumerates the priorities of pipeline builds started by ICompiler::BuildPipelineAsync.
+enum class PipelineBuildPriority : unsigned {
+  Background = 0, ///< Speculative build, paused while foreground builds are running
+  Foreground,     ///< Build the application is waiting for
+};
+
+/// Represents a pipeline build started by ICompiler::BuildPipelineAsync.
+class IPipelineBuildTask {
+public:
+  /// Changes the priority of the build. A queued build is started in priority order, and a running background build
+  /// stops being paused for foreground builds once it is raised to Foreground.
+  ///
+  /// @param [in]  priority  New priority of the build
+  virtual void SetPriority(PipelineBuildPriority priority) = 0;
+
+  /// Requests cancellation of the build. A queued build is not started; a running one stops at its next cancellation
+  /// point (between compiler passes or phases). The result of a cancelled build is Result::Aborted, unless it
+  /// completed before it could be stopped.
+  virtual void Cancel() = 0;
+
+  /// Checks whether the build has completed, without waiting.
+  ///
+  /// @returns : True if the build has completed, and its result and output are set in the build item.
+  virtual bool IsDone() const = 0;
+
+  /// Waits for the build to complete. A build that has not been started yet is built on the calling thread, with
+  /// foreground priority.
+  ///
+  /// @returns : Result of the build, which is also set in the build item.
+  virtual Result Wait() = 0;
+
+  /// Cancels the build if it has not completed, waits for it, and destroys the task. Every task must be destroyed,
+  /// before the compiler that created it is destroyed.
+  virtual void Destroy() = 0;
+
+protected:
+  /// Destructor
+  virtual ~IPipelineBuildTask() {}
+};
+
+/// Represents the statistics of a shader cache, accumulated since it was created.
+struct CacheStatistics {
+  uint64_t hitCount;            ///< Number of lookups that found a ready entry
+  uint64_t missCount;           ///< Number of lookups that did not, so the entry had to be compiled
+  uint64_t waitCount;           ///< Number of lookups that waited for an entry compiled by another thread or process
+  uint64_t waitTime;            ///< Total time spent in these waits, in microseconds
+  uint64_t storedBytes;         ///< Total size of the data stored into the cache
+  uint64_t evictedBytes;        ///< Total size of the data evicted from the cache
+  uint64_t residentBytes;       ///< Size of the data currently held in memory by the cache
+  uint64_t loadTime;            ///< Time spent loading the initial data or the on-disk file of the cache, in
+                                ///  microseconds
+  uint64_t lockContentionCount; ///< Number of times a thread had to block to lock a shard of the cache index
+};
+
+/// Represents the statistics of the pool of LLVM contexts shared by all pipeline compilers.
+struct ContextPoolStatistics {
+  uint64_t acquireCount;     ///< Number of contexts acquired from the pool
+  uint64_t affinityHitCount; ///< Number of acquired contexts that the acquiring thread had released last
+  uint64_t createCount;      ///< Number of contexts created because no free context could be reused
+  uint64_t residentCount;    ///< Number of contexts currently held by the pool, in use or free
+  uint64_t inUseCount;       ///< Number of contexts currently in use
+  uint64_t peakInUseCount;   ///< Maximum number of contexts in use at the same time
+  uint64_t retainedBytes;    ///< Estimated size of the memory retained by the contexts held by the pool
+  uint64_t recycleCount;     ///< Number of contexts deleted because of the memory they retained
+};
+
+/// Represents the statistics of the caches used by a pipeline compiler, accumulated since it was created.
+struct CompilerCacheStatistics {
+  /// Internal shader cache of the compiler, which is shared by compilers with the same options
+  CacheStatistics shaderCache;
+  /// Pool of LLVM contexts, which is shared by all compilers and accumulated since the first compiler was created
+  ContextPoolStatistics contextPool;
+  /// Count of pipeline builds per pipeline cache access status
+  uint64_t pipelineCacheAccesses[CacheAccessInfoCount];
+  /// Count of shader stages built with relocatable shader ELF per stage and shader cache access status
+  uint64_t stageCacheAccesses[ShaderStageCount][CacheAccessInfoCount];
+};
+
 /// Defines callback function used to lookup shader cache info in an external cache
 typedef Result (*ShaderCacheGetValue)(const void *pClientData, uint64_t hash, void *pValue, size_t *pValueLen);
 
@@ -252,6 +348,41 @@ public:
   virtual Result BuildComputePipeline(const ComputePipelineBuildInfo *pPipelineInfo,
                                       ComputePipelineBuildOut *pPipelineOut, void *pPipelineDumpFile = nullptr) = 0;
 
+  /// Build a batch of graphics and compute pipelines, on a pool of threads of the compiler. Pipelines of the batch
+  /// with the same cache hash are built only once, and the others get a copy of the output (allocated with their own
+  /// output allocator). This returns once all the pipelines have been built.
+  ///
+  /// @param [in]      itemCount    Count of pipelines in the batch
+  /// @param [in,out]  pItems       Array of pipelines to build; the result of each is set in it
+  /// @param [in]      threadCount  Maximum count of threads to build the pipelines on, 0 for the count of hardware
+  ///                               threads of the machine
+  /// @param [in]      pfnCallback  [Optional] Function called once each pipeline has been built
+  /// @param [in]      pUserData    User data passed to pfnCallback
+  ///
+  /// @returns : Result::Success if all the pipelines were built successfully, otherwise the result of the first
+  ///            pipeline in the batch that failed.
+  virtual Result BuildPipelines(unsigned itemCount, PipelineBuildItem *pItems, unsigned threadCount,
+                                PipelineBuildCallback pfnCallback, void *pUserData) = 0;
+
+  /// Starts building a graphics or compute pipeline on a background thread of the compiler, and returns a task to
+  /// wait for it, reprioritize it or cancel it. Background builds pause between compiler passes while foreground
+  /// builds (synchronous ones or asynchronous ones with foreground priority) are running, so speculative builds do
+  /// not delay the pipelines the application is waiting for.
+  ///
+  /// @param [in,out]  pItem     Pipeline to build, as for BuildPipelines. It must stay valid until the task has been
+  ///                            destroyed; the result is set in it when the build completes
+  /// @param [in]      priority  Initial priority of the build
+  /// @param [out]     ppTask    Task of the build, to be destroyed with IPipelineBuildTask::Destroy
+  ///
+  /// @returns : Result::Success if the build was started, otherwise an error code and no task is created.
+  virtual Result BuildPipelineAsync(PipelineBuildItem *pItem, PipelineBuildPriority priority,
+                                    IPipelineBuildTask **ppTask) = 0;
+
+  /// Gets the statistics of the caches used by this pipeline compiler.
+  ///
+  /// @param [out] pStatistics : Cache statistics, accumulated since the compiler was created
+  virtual void GetCacheStatistics(CompilerCacheStatistics *pStatistics) const = 0;
+
 #if LLPC_ENABLE_SHADER_CACHE
   /// Creates a shader cache object with the requested properties.
   ///
@@ -190,6 +190,20 @@ bool SpirvLowerGlobal::runOnModule(Module &module) {
 
   SpirvLower::init(&module);
 
+  // Reset the state left by a previous run, as the pass may be reused from a cached pass manager.
+  m_globalVarProxyMap.clear();
+  m_inputProxyMap.clear();
+  m_outputProxyMap.clear();
+  m_retBlock = nullptr;
+  m_lowerInputInPlace = false;
+  m_lowerOutputInPlace = false;
+  m_instVisitFlags.u32All = 0;
+  m_retInsts.clear();
+  m_emitCalls.clear();
+  m_loadInsts.clear();
+  m_storeInsts.clear();
+  m_interpCalls.clear();
+
   // Map globals to proxy variables
   for (auto global = m_module->global_begin(), end = m_module->global_end(); global != end; ++global) {
     if (global->getType()->getAddressSpace() == SPIRAS_Private)
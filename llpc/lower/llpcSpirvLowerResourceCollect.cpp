@@ -148,6 +148,12 @@ bool SpirvLowerResourceCollect::runOnModule(Module &module) {
 
   SpirvLower::init(&module);
 
+  // Reset the state left by a previous run, as the pass may be reused from a cached pass manager.
+  m_resNodeDatas.clear();
+  m_pushConstSize = 0;
+  m_fsOutInfos.clear();
+  m_detailUsageValid = false;
+
   // Collect unused globals and remove them
   std::unordered_set<GlobalVariable *> removedGlobals;
   for (auto global = m_module->global_begin(), end = m_module->global_end(); global != end; ++global) {
@@ -30,17 +30,83 @@
  */
 #include "llpcSpirvLowerTranslator.h"
 #include "LLVMSPIRVLib.h"
+#include "SPIRVModule.h"
 #include "llpcCompiler.h"
 #include "llpcContext.h"
+#include "vkgcMetroHash.h"
 #include "lgc/Builder.h"
-#include <sstream>
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+#include <list>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #define DEBUG_TYPE "llpc-spirv-lower-translator"
 
 using namespace llvm;
 using namespace Llpc;
 
+namespace llvm {
+
+namespace cl {
+
+// -spirv-module-cache-size: count of decoded SPIR-V modules kept for the pipelines that use the same shader
+opt<unsigned> SpirvModuleCacheSize("spirv-module-cache-size",
+                                   desc("Count of decoded SPIR-V modules kept for the pipelines that use the same "
+                                        "shader with the same specialization (0 to disable)"),
+                                   init(64));
+
+} // namespace cl
+
+} // namespace llvm
+
+namespace {
+// Decoded SPIR-V modules shared by the pipelines of the process, most recently used first. A module is only decoded
+// and specialized once. Translations only read it, and keep their own state and errors in SPIRVToLLVM, so it is used by
+// all of them without a lock.
+// Modules are indexed by the 64-bit compaction of their key, and the full 128-bit key is compared on a hit.
+struct DecodedSpirvModuleCache {
+  typedef std::list<std::pair<MetroHash::Hash, std::shared_ptr<SPIRV::SPIRVModule>>> ModuleList;
+
+  std::mutex lock;                                      // Lock of the cache
+  ModuleList modules;                                   // Decoded modules with their keys, most recently used first
+  DenseMap<uint64_t, ModuleList::iterator> moduleIndex; // Map from the compacted key of a module to its place in the
+                                                        // list
+};
+} // anonymous namespace
+
+static ManagedStatic<DecodedSpirvModuleCache> DecodedSpirvModules;
+
+// =====================================================================================================================
+// Gets the key of a decoded SPIR-V module. The decoded module depends on the SPIR-V binary, which is identified by
+// the cache hash of the shader module, and on the entry point and the specialization applied to it.
+//
+// @param moduleData : Shader module data
+// @param shaderInfo : Shader info with the entry point and specialization
+static MetroHash::Hash getDecodedSpirvModuleKey(const ShaderModuleData *moduleData,
+                                                const PipelineShaderInfo *shaderInfo) {
+  Util::MetroHash64 hasher;
+  hasher.Update(moduleData->cacheHash);
+  hasher.Update(shaderInfo->entryStage);
+  if (shaderInfo->pEntryTarget) {
+    hasher.Update(reinterpret_cast<const uint8_t *>(shaderInfo->pEntryTarget), strlen(shaderInfo->pEntryTarget));
+  }
+  if (const VkSpecializationInfo *specInfo = shaderInfo->pSpecializationInfo) {
+    for (unsigned i = 0; i < specInfo->mapEntryCount; ++i) {
+      const VkSpecializationMapEntry &mapEntry = specInfo->pMapEntries[i];
+      hasher.Update(mapEntry.constantID);
+      hasher.Update(static_cast<uint32_t>(mapEntry.size));
+      hasher.Update(static_cast<const uint8_t *>(voidPtrInc(specInfo->pData, mapEntry.offset)), mapEntry.size);
+    }
+  }
+  MetroHash::Hash hash = {};
+  hasher.Finalize(hash.bytes);
+  return hash;
+}
+
 char SpirvLowerTranslator::ID = 0;
 
 // =====================================================================================================================
@@ -85,8 +151,14 @@ void SpirvLowerTranslator::translateSpirvToLlvm(const PipelineShaderInfo *shader
   if (ShaderModuleHelper::optimizeSpirv(spirvBin, &optimizedSpirvBin) == Result::Success)
     spirvBin = &optimizedSpirvBin;
 
-  std::string spirvCode(static_cast<const char *>(spirvBin->pCode), spirvBin->codeSize);
-  std::istringstream spirvStream(spirvCode);
+  // The SPIR-V words are decoded in place. They are only copied if the binary is not aligned to words.
+  ArrayRef<uint32_t> spirvCode(static_cast<const uint32_t *>(spirvBin->pCode), spirvBin->codeSize / sizeof(uint32_t));
+  std::vector<uint32_t> alignedSpirvCode;
+  if (reinterpret_cast<uintptr_t>(spirvBin->pCode) % alignof(uint32_t) != 0) {
+    alignedSpirvCode.resize(spirvCode.size());
+    memcpy(alignedSpirvCode.data(), spirvBin->pCode, alignedSpirvCode.size() * sizeof(uint32_t));
+    spirvCode = alignedSpirvCode;
+  }
   std::string errMsg;
   SPIRV::SPIRVSpecConstMap specConstMap;
   ShaderStage entryStage = shaderInfo->entryStage;
@@ -116,9 +188,48 @@ void SpirvLowerTranslator::translateSpirvToLlvm(const PipelineShaderInfo *shader
     }
   }
 
-  if (!readSpirv(context->getBuilder(), &(moduleData->usage), &(shaderInfo->options), spirvStream,
-                 convertToExecModel(entryStage), shaderInfo->pEntryTarget, specConstMap, convertingSamplers, module,
-                 errMsg)) {
+  // Look up the decoded module shared by the pipelines using this shader, unless the SPIR-V has been optimized for
+  // this pipeline.
+  std::shared_ptr<SPIRV::SPIRVModule> spirvModule;
+  MetroHash::Hash spirvModuleKey = {};
+  uint64_t spirvModuleIndexKey = 0;
+  bool useSpirvModuleCache = cl::SpirvModuleCacheSize != 0 && spirvBin == &moduleData->binCode;
+  if (useSpirvModuleCache) {
+    spirvModuleKey = getDecodedSpirvModuleKey(moduleData, shaderInfo);
+    spirvModuleIndexKey = MetroHash::compact64(&spirvModuleKey);
+    std::lock_guard<std::mutex> lock(DecodedSpirvModules->lock);
+    auto &modules = DecodedSpirvModules->modules;
+    auto it = DecodedSpirvModules->moduleIndex.find(spirvModuleIndexKey);
+    // A module whose key only has the same compaction is not used.
+    if (it != DecodedSpirvModules->moduleIndex.end() &&
+        memcmp(&it->second->first, &spirvModuleKey, sizeof(spirvModuleKey)) == 0) {
+      modules.splice(modules.begin(), modules, it->second);
+      spirvModule = it->second->second;
+    }
+  }
+
+  if (!spirvModule) {
+    spirvModule.reset(decodeSpirv(spirvCode, convertToExecModel(entryStage), shaderInfo->pEntryTarget, specConstMap));
+    // A module that failed to decode is not cached; readSpirv reports its error.
+    if (useSpirvModuleCache && spirvModule->getError(errMsg) == SPIRV::SPIRVEC_Success) {
+      // Another thread may have decoded the same module meanwhile; the module decoded first is kept.
+      std::lock_guard<std::mutex> lock(DecodedSpirvModules->lock);
+      auto &modules = DecodedSpirvModules->modules;
+      auto &moduleIndex = DecodedSpirvModules->moduleIndex;
+      if (moduleIndex.find(spirvModuleIndexKey) == moduleIndex.end()) {
+        modules.emplace_front(spirvModuleKey, spirvModule);
+        moduleIndex[spirvModuleIndexKey] = modules.begin();
+        while (modules.size() > cl::SpirvModuleCacheSize) {
+          // A module in use by a translation is kept alive by its shared pointer.
+          moduleIndex.erase(MetroHash::compact64(&modules.back().first));
+          modules.pop_back();
+        }
+      }
+    }
+  }
+
+  if (!readSpirv(context->getBuilder(), &(moduleData->usage), &(shaderInfo->options), spirvModule.get(),
+                 convertToExecModel(entryStage), shaderInfo->pEntryTarget, convertingSamplers, module, errMsg)) {
     report_fatal_error(Twine("Failed to translate SPIR-V to LLVM (") +
                            getShaderStageName(static_cast<ShaderStage>(entryStage)) + " shader): " + errMsg,
                        false);
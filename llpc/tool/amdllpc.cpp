@@ -61,8 +61,10 @@
 #endif
 #endif
 
+#include <chrono>
 #include <sstream>
 #include <stdlib.h> // getenv
+#include <thread>
 
 // NOTE: To enable VLD, please add option BUILD_WIN_VLD=1 in build option.To run amdllpc with VLD enabled,
 // please copy vld.ini and all files in.\winVisualMemDetector\bin\Win64 to current directory of amdllpc.
@@ -237,6 +239,29 @@ static cl::opt<bool> CheckAutoLayoutCompatible(
     "check-auto-layout-compatible",
     cl::desc("check if auto descriptor layout got from spv file is commpatible with real layout"));
 
+// -print-cache-stats: print the statistics of the compiler caches once all pipelines are built
+static cl::opt<bool>
+    PrintCacheStats("print-cache-stats",
+                    cl::desc("Print the statistics of the compiler caches once all pipelines are built"),
+                    cl::init(false));
+
+// -j: count of threads to build pipeline files on concurrently
+static cl::opt<unsigned> Jobs("j",
+                              cl::desc("Count of threads to build pipeline files on concurrently (0 for the count "
+                                       "of hardware threads)"),
+                              cl::value_desc("N"), cl::init(1));
+
+// -async-build: build the pipelines of each batch of -j through BuildPipelineAsync
+static cl::opt<bool> AsyncBuild("async-build",
+                                cl::desc("Build the pipelines of each batch of -j through BuildPipelineAsync"),
+                                cl::init(false));
+
+// -cancel-async-builds: indices of the input files whose asynchronous builds are cancelled once started
+static cl::list<unsigned> CancelAsyncBuilds("cancel-async-builds",
+                                            cl::desc("Indices of the input files whose builds are cancelled right "
+                                                     "after they are started with -async-build"),
+                                            cl::value_desc("indices"), cl::CommaSeparated);
+
 namespace llvm {
 
 namespace cl {
@@ -973,18 +998,20 @@ static Result checkAutoLayoutCompatibleFunc(const ICompiler *compiler, CompileIn
 }
 
 // =====================================================================================================================
-// Builds pipeline and do linking.
+// Checks whether the pipeline to build is a graphics pipeline.
 //
-// @param compiler : LLPC compiler object
-// @param [in/out] compileInfo : Compilation info of LLPC standalone tool
-static Result buildPipeline(ICompiler *compiler, CompileInfo *compileInfo) {
-  Result result = Result::Success;
+// @param compileInfo : Compilation info of LLPC standalone tool
+static bool isGraphicsPipeline(const CompileInfo *compileInfo) {
+  return (compileInfo->stageMask & (shaderStageToMask(ShaderStageCompute) - 1)) != 0;
+}
 
-  bool isGraphics = (compileInfo->stageMask & (shaderStageToMask(ShaderStageCompute) - 1)) != 0;
-  if (isGraphics) {
-    // Build graphics pipeline
+// =====================================================================================================================
+// Fills the info to build the pipeline from the built shader modules, laying out the descriptors if needed.
+//
+// @param [in/out] compileInfo : Compilation info of LLPC standalone tool
+static void initPipelineBuildInfo(CompileInfo *compileInfo) {
+  if (isGraphicsPipeline(compileInfo)) {
     GraphicsPipelineBuildInfo *pipelineInfo = &compileInfo->gfxPipelineInfo;
-    GraphicsPipelineBuildOut *pipelineOut = &compileInfo->gfxPipelineOut;
 
     // Fill pipeline shader info
     PipelineShaderInfo *shaderInfos[ShaderStageGfxCount] = {
@@ -1042,6 +1069,61 @@ static Result buildPipeline(ICompiler *compiler, CompileInfo *compileInfo) {
 
     pipelineInfo->options.robustBufferAccess = RobustBufferAccess;
     pipelineInfo->options.enableRelocatableShaderElf = EnableRelocatableShaderElf;
+  } else {
+    assert(compileInfo->shaderModuleDatas.size() == 1);
+    assert(compileInfo->shaderModuleDatas[0].shaderStage == ShaderStageCompute);
+
+    ComputePipelineBuildInfo *pipelineInfo = &compileInfo->compPipelineInfo;
+
+    PipelineShaderInfo *shaderInfo = &pipelineInfo->cs;
+    const ShaderModuleBuildOut *shaderOut = &compileInfo->shaderModuleDatas[0].shaderOut;
+
+    if (!shaderInfo->pEntryTarget) {
+      // If entry target is not specified, use the one from command line option
+      shaderInfo->pEntryTarget = EntryTarget.c_str();
+    }
+
+    shaderInfo->entryStage = ShaderStageCompute;
+    shaderInfo->pModuleData = shaderOut->pModuleData;
+
+    // If not compiling from pipeline, lay out user data now.
+    if (compileInfo->doAutoLayout) {
+      ResourceMappingNodeMap nodeSets;
+      unsigned pushConstSize = 0;
+      doAutoLayoutDesc(ShaderStageCompute, compileInfo->shaderModuleDatas[0].spirvBin, nullptr, shaderInfo, nodeSets,
+                       pushConstSize, false);
+
+#if LLPC_CLIENT_INTERFACE_MAJOR_VERSION >= 41
+      buildTopLevelMapping(ShaderStageComputeBit, nodeSets, pushConstSize, &pipelineInfo->resourceMapping);
+#else
+      unsigned userDataOffset = 0;
+      buildTopLevelMapping(ShaderStageCompute, nodeSets, pushConstSize, shaderInfo, userDataOffset);
+#endif
+    }
+
+    pipelineInfo->pInstance = nullptr; // Dummy, unused
+    pipelineInfo->pUserData = &compileInfo->pipelineBuf;
+    pipelineInfo->pfnOutputAlloc = allocateBuffer;
+    pipelineInfo->unlinked = compileInfo->unlinked;
+    pipelineInfo->options.robustBufferAccess = RobustBufferAccess;
+    pipelineInfo->options.enableRelocatableShaderElf = EnableRelocatableShaderElf;
+  }
+}
+
+// =====================================================================================================================
+// Builds pipeline and do linking.
+//
+// @param compiler : LLPC compiler object
+// @param [in/out] compileInfo : Compilation info of LLPC standalone tool
+static Result buildPipeline(ICompiler *compiler, CompileInfo *compileInfo) {
+  Result result = Result::Success;
+
+  initPipelineBuildInfo(compileInfo);
+
+  if (isGraphicsPipeline(compileInfo)) {
+    // Build graphics pipeline
+    GraphicsPipelineBuildInfo *pipelineInfo = &compileInfo->gfxPipelineInfo;
+    GraphicsPipelineBuildOut *pipelineOut = &compileInfo->gfxPipelineOut;
 
     void *pipelineDumpHandle = nullptr;
     if (cl::EnablePipelineDump) {
@@ -1079,45 +1161,9 @@ static Result buildPipeline(ICompiler *compiler, CompileInfo *compileInfo) {
   }
   else {
     // Build compute pipeline
-    assert(compileInfo->shaderModuleDatas.size() == 1);
-    assert(compileInfo->shaderModuleDatas[0].shaderStage == ShaderStageCompute);
-
     ComputePipelineBuildInfo *pipelineInfo = &compileInfo->compPipelineInfo;
     ComputePipelineBuildOut *pipelineOut = &compileInfo->compPipelineOut;
 
-    PipelineShaderInfo *shaderInfo = &pipelineInfo->cs;
-    const ShaderModuleBuildOut *shaderOut = &compileInfo->shaderModuleDatas[0].shaderOut;
-
-    if (!shaderInfo->pEntryTarget) {
-      // If entry target is not specified, use the one from command line option
-      shaderInfo->pEntryTarget = EntryTarget.c_str();
-    }
-
-    shaderInfo->entryStage = ShaderStageCompute;
-    shaderInfo->pModuleData = shaderOut->pModuleData;
-
-    // If not compiling from pipeline, lay out user data now.
-    if (compileInfo->doAutoLayout) {
-      ResourceMappingNodeMap nodeSets;
-      unsigned pushConstSize = 0;
-      doAutoLayoutDesc(ShaderStageCompute, compileInfo->shaderModuleDatas[0].spirvBin, nullptr, shaderInfo, nodeSets,
-                       pushConstSize, false);
-
-#if LLPC_CLIENT_INTERFACE_MAJOR_VERSION >= 41
-      buildTopLevelMapping(ShaderStageComputeBit, nodeSets, pushConstSize, &pipelineInfo->resourceMapping);
-#else
-      unsigned userDataOffset = 0;
-      buildTopLevelMapping(ShaderStageCompute, nodeSets, pushConstSize, shaderInfo, userDataOffset);
-#endif
-    }
-
-    pipelineInfo->pInstance = nullptr; // Dummy, unused
-    pipelineInfo->pUserData = &compileInfo->pipelineBuf;
-    pipelineInfo->pfnOutputAlloc = allocateBuffer;
-    pipelineInfo->unlinked = compileInfo->unlinked;
-    pipelineInfo->options.robustBufferAccess = RobustBufferAccess;
-    pipelineInfo->options.enableRelocatableShaderElf = EnableRelocatableShaderElf;
-
     void *pipelineDumpHandle = nullptr;
     if (cl::EnablePipelineDump) {
       PipelineDumpOptions dumpOptions = {};
@@ -1252,26 +1298,17 @@ static void enableMemoryLeakDetection() {
 #endif
 
 // =====================================================================================================================
-// Process one pipeline.
+// Reads the input files of one pipeline, translating shader sources to SPIR-V binary.
 //
-// @param compiler : LLPC context
 // @param inFiles : Input filename(s)
 // @param startFile : Index of the starting file name being processed in the file name array
 // @param [out] nextFile : Index of next file name being processed in the file name array
-static Result processPipeline(ICompiler *compiler, ArrayRef<std::string> inFiles, unsigned startFile,
-                              unsigned *nextFile) {
+// @param [in/out] compileInfo : Compilation info of LLPC standalone tool
+// @param [out] fileNames : Names of the input files read, separated by spaces
+static Result readPipelineFiles(ArrayRef<std::string> inFiles, unsigned startFile, unsigned *nextFile,
+                                CompileInfo *compileInfo, std::string &fileNames) {
   Result result = Result::Success;
-  CompileInfo compileInfo = {};
-  std::string fileNames;
-  compileInfo.unlinked = true;
-  compileInfo.doAutoLayout = true;
-  compileInfo.checkAutoLayoutCompatible = CheckAutoLayoutCompatible;
-
-  result = initCompileInfo(&compileInfo);
 
-  //
-  // Translate sources to SPIR-V binary
-  //
   for (unsigned i = startFile; i < inFiles.size() && result == Result::Success; ++i) {
     const std::string &inFile = inFiles[i];
     std::string spvBinFile;
@@ -1326,7 +1363,7 @@ static Result processPipeline(ICompiler *compiler, ArrayRef<std::string> inFiles
 
         unsigned stageMask = ShaderModuleHelper::getStageMaskFromSpirvBinary(&spvBin, EntryTarget.c_str());
 
-        if ((stageMask & compileInfo.stageMask) != 0)
+        if ((stageMask & compileInfo->stageMask) != 0)
           break;
         else if (stageMask != 0) {
           for (unsigned stage = ShaderStageVertex; stage < ShaderStageCount; ++stage) {
@@ -1334,8 +1371,8 @@ static Result processPipeline(ICompiler *compiler, ArrayRef<std::string> inFiles
               ::ShaderModuleData shaderModuleData = {};
               shaderModuleData.shaderStage = static_cast<ShaderStage>(stage);
               shaderModuleData.spirvBin = spvBin;
-              compileInfo.shaderModuleDatas.push_back(shaderModuleData);
-              compileInfo.stageMask |= shaderStageToMask(static_cast<ShaderStage>(stage));
+              compileInfo->shaderModuleDatas.push_back(shaderModuleData);
+              compileInfo->stageMask |= shaderStageToMask(static_cast<ShaderStage>(stage));
               break;
             }
           }
@@ -1348,10 +1385,10 @@ static Result processPipeline(ICompiler *compiler, ArrayRef<std::string> inFiles
     } else if (isPipelineInfoFile(inFile)) {
       const char *log = nullptr;
       bool vfxResult =
-          Vfx::vfxParseFile(inFile.c_str(), 0, nullptr, VfxDocTypePipeline, &compileInfo.pipelineInfoFile, &log);
+          Vfx::vfxParseFile(inFile.c_str(), 0, nullptr, VfxDocTypePipeline, &compileInfo->pipelineInfoFile, &log);
       if (vfxResult) {
         VfxPipelineStatePtr pipelineState = nullptr;
-        Vfx::vfxGetPipelineDoc(compileInfo.pipelineInfoFile, &pipelineState);
+        Vfx::vfxGetPipelineDoc(compileInfo->pipelineInfoFile, &pipelineState);
 
         if (pipelineState->version != Vkgc::Version) {
           LLPC_ERRS("Version incompatible, SPVGEN::Version = " << pipelineState->version
@@ -1365,15 +1402,15 @@ static Result processPipeline(ICompiler *compiler, ArrayRef<std::string> inFiles
             LLPC_OUTS("Pipeline file parse warning:\n" << log << "\n");
           }
 
-          compileInfo.compPipelineInfo = pipelineState->compPipelineInfo;
-          compileInfo.gfxPipelineInfo = pipelineState->gfxPipelineInfo;
+          compileInfo->compPipelineInfo = pipelineState->compPipelineInfo;
+          compileInfo->gfxPipelineInfo = pipelineState->gfxPipelineInfo;
           if (IgnoreColorAttachmentFormats) {
             // NOTE: When this option is enabled, we set color attachment format to
             // R8G8B8A8_SRGB for color target 0. Also, for other color targets, if the
             // formats are not UNDEFINED, we set them to R8G8B8A8_SRGB as well.
             for (unsigned target = 0; target < MaxColorTargets; ++target) {
-              if (target == 0 || compileInfo.gfxPipelineInfo.cbState.target[target].format != VK_FORMAT_UNDEFINED)
-                compileInfo.gfxPipelineInfo.cbState.target[target].format = VK_FORMAT_R8G8B8A8_SRGB;
+              if (target == 0 || compileInfo->gfxPipelineInfo.cbState.target[target].format != VK_FORMAT_UNDEFINED)
+                compileInfo->gfxPipelineInfo.cbState.target[target].format = VK_FORMAT_R8G8B8A8_SRGB;
             }
           }
 
@@ -1388,8 +1425,8 @@ static Result processPipeline(ICompiler *compiler, ArrayRef<std::string> inFiles
               shaderModuleData.spirvBin.pCode = pipelineState->stages[stage].pData;
               shaderModuleData.shaderStage = pipelineState->stages[stage].stage;
 
-              compileInfo.shaderModuleDatas.push_back(shaderModuleData);
-              compileInfo.stageMask |= shaderStageToMask(pipelineState->stages[stage].stage);
+              compileInfo->shaderModuleDatas.push_back(shaderModuleData);
+              compileInfo->stageMask |= shaderStageToMask(pipelineState->stages[stage].stage);
 
               if (spvDisassembleSpirv) {
                 unsigned binSize = pipelineState->stages[stage].dataSize;
@@ -1406,18 +1443,18 @@ static Result processPipeline(ICompiler *compiler, ArrayRef<std::string> inFiles
             }
           }
 
-          bool isGraphics = (compileInfo.stageMask & shaderStageToMask(ShaderStageCompute)) == 0;
-          for (unsigned i = 0; i < compileInfo.shaderModuleDatas.size(); ++i) {
-            compileInfo.shaderModuleDatas[i].shaderInfo.options.pipelineOptions =
-                isGraphics ? compileInfo.gfxPipelineInfo.options : compileInfo.compPipelineInfo.options;
+          bool isGraphics = (compileInfo->stageMask & shaderStageToMask(ShaderStageCompute)) == 0;
+          for (unsigned i = 0; i < compileInfo->shaderModuleDatas.size(); ++i) {
+            compileInfo->shaderModuleDatas[i].shaderInfo.options.pipelineOptions =
+                isGraphics ? compileInfo->gfxPipelineInfo.options : compileInfo->compPipelineInfo.options;
           }
 
           fileNames += inFile;
           fileNames += " ";
           *nextFile = i + 1;
           // For a .pipe, build an "unlinked" half-pipeline ELF if -unlinked is on.
-          compileInfo.unlinked = Unlinked;
-          compileInfo.doAutoLayout = false;
+          compileInfo->unlinked = Unlinked;
+          compileInfo->doAutoLayout = false;
           break;
         }
       } else {
@@ -1455,7 +1492,7 @@ static Result processPipeline(ICompiler *compiler, ArrayRef<std::string> inFiles
           result = Result::ErrorInvalidShader;
         }
 
-        if (compileInfo.stageMask & shaderStageToMask(static_cast<ShaderStage>(shaderStage)))
+        if (compileInfo->stageMask & shaderStageToMask(static_cast<ShaderStage>(shaderStage)))
           break;
       }
 
@@ -1471,9 +1508,9 @@ static Result processPipeline(ICompiler *compiler, ArrayRef<std::string> inFiles
         shaderModuledata.spirvBin.codeSize = bitcodeBuf.size();
         shaderModuledata.spirvBin.pCode = code;
         shaderModuledata.shaderStage = shaderStage;
-        compileInfo.shaderModuleDatas.push_back(shaderModuledata);
-        compileInfo.stageMask |= shaderStageToMask(static_cast<ShaderStage>(shaderStage));
-        compileInfo.doAutoLayout = false;
+        compileInfo->shaderModuleDatas.push_back(shaderModuledata);
+        compileInfo->stageMask |= shaderStageToMask(static_cast<ShaderStage>(shaderStage));
+        compileInfo->doAutoLayout = false;
       }
     } else {
       // GLSL source text
@@ -1485,14 +1522,14 @@ static Result processPipeline(ICompiler *compiler, ArrayRef<std::string> inFiles
       ShaderStage stage = ShaderStageInvalid;
       result = compileGlsl(inFile, &stage, spvBinFile);
       if (result == Result::Success) {
-        if (compileInfo.stageMask & shaderStageToMask(static_cast<ShaderStage>(stage)))
+        if (compileInfo->stageMask & shaderStageToMask(static_cast<ShaderStage>(stage)))
           break;
 
-        compileInfo.stageMask |= shaderStageToMask(stage);
+        compileInfo->stageMask |= shaderStageToMask(stage);
         ::ShaderModuleData shaderModuleData = {};
         result = getSpirvBinaryFromFile(spvBinFile, &shaderModuleData.spirvBin);
         shaderModuleData.shaderStage = stage;
-        compileInfo.shaderModuleDatas.push_back(shaderModuleData);
+        compileInfo->shaderModuleDatas.push_back(shaderModuleData);
       }
     }
 
@@ -1506,6 +1543,33 @@ static Result processPipeline(ICompiler *compiler, ArrayRef<std::string> inFiles
     }
   }
 
+  return result;
+}
+
+// =====================================================================================================================
+// Process one pipeline.
+//
+// @param compiler : LLPC context
+// @param inFiles : Input filename(s)
+// @param startFile : Index of the starting file name being processed in the file name array
+// @param [out] nextFile : Index of next file name being processed in the file name array
+static Result processPipeline(ICompiler *compiler, ArrayRef<std::string> inFiles, unsigned startFile,
+                              unsigned *nextFile) {
+  Result result = Result::Success;
+  CompileInfo compileInfo = {};
+  std::string fileNames;
+  compileInfo.unlinked = true;
+  compileInfo.doAutoLayout = true;
+  compileInfo.checkAutoLayoutCompatible = CheckAutoLayoutCompatible;
+
+  result = initCompileInfo(&compileInfo);
+
+  //
+  // Translate sources to SPIR-V binary
+  //
+  if (result == Result::Success)
+    result = readPipelineFiles(inFiles, startFile, nextFile, &compileInfo, fileNames);
+
   if (result == Result::Success && compileInfo.checkAutoLayoutCompatible) {
     compileInfo.fileNames = fileNames.c_str();
     result = checkAutoLayoutCompatibleFunc(compiler, &compileInfo);
@@ -1534,6 +1598,171 @@ static Result processPipeline(ICompiler *compiler, ArrayRef<std::string> inFiles
   return result;
 }
 
+// =====================================================================================================================
+// Builds the pipelines of a batch through BuildPipelineAsync, and waits for them. The builds of the input files listed
+// by -cancel-async-builds are cancelled right after they are started.
+//
+// @param compiler : LLPC compiler object
+// @param [in/out] buildItems : Pipelines to build, their results are set once they are built
+// @param fileIndices : Index of the input file of each pipeline
+static void buildPipelinesAsync(ICompiler *compiler, MutableArrayRef<PipelineBuildItem> buildItems,
+                                ArrayRef<unsigned> fileIndices) {
+  std::vector<IPipelineBuildTask *> tasks(buildItems.size(), nullptr);
+  for (unsigned itemIdx = 0; itemIdx < buildItems.size(); ++itemIdx) {
+    PipelineBuildItem &buildItem = buildItems[itemIdx];
+    Result result = compiler->BuildPipelineAsync(&buildItem, PipelineBuildPriority::Foreground, &tasks[itemIdx]);
+    if (result != Result::Success) {
+      buildItem.result = result;
+      continue;
+    }
+    if (is_contained(CancelAsyncBuilds, fileIndices[itemIdx]))
+      tasks[itemIdx]->Cancel();
+  }
+
+  for (IPipelineBuildTask *task : tasks) {
+    if (task) {
+      task->Wait();
+      task->Destroy();
+    }
+  }
+}
+
+// =====================================================================================================================
+// Process pipeline files in batches, building the pipelines of each batch concurrently. The files are read and the
+// output files are written in the order of the input files, so the output is the same as processing them one by one.
+// Prints the time spent in each phase once all pipelines are processed.
+//
+// @param compiler : LLPC compiler object
+// @param inFiles : Input pipeline files, each of them is built separately
+// @param threadCount : Count of threads to build the pipelines on, 0 for the count of hardware threads
+static Result processPipelinesInParallel(ICompiler *compiler, ArrayRef<std::string> inFiles, unsigned threadCount) {
+  using Clock = std::chrono::steady_clock;
+
+  if (threadCount == 0)
+    threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+  // Batches are a few times larger than the count of threads, so that the threads don't run out of work because of a
+  // slow pipeline, while memory use doesn't grow with the count of input files.
+  const unsigned batchSize = threadCount * 4;
+
+  Result result = Result::Success;
+  unsigned builtCount = 0;
+  Clock::duration readTime = {};
+  Clock::duration buildTime = {};
+  Clock::duration writeTime = {};
+  Clock::time_point startTime = Clock::now();
+
+  for (unsigned batchStart = 0; batchStart < inFiles.size() && result == Result::Success; batchStart += batchSize) {
+    unsigned batchCount = std::min(batchSize, static_cast<unsigned>(inFiles.size()) - batchStart);
+    std::vector<CompileInfo> compileInfos(batchCount);
+    std::vector<std::string> fileNames(batchCount);
+    std::vector<Result> results(batchCount, Result::Success);
+    std::vector<PipelineBuildItem> buildItems;
+    std::vector<unsigned> buildItemFiles;
+
+    //
+    // Read the pipeline files and build their shader modules, stopping at the first file that fails
+    //
+    Clock::time_point readStartTime = Clock::now();
+    for (unsigned i = 0; i < batchCount; ++i) {
+      CompileInfo &compileInfo = compileInfos[i];
+      compileInfo.unlinked = true;
+      compileInfo.doAutoLayout = true;
+
+      Result &fileResult = results[i];
+      fileResult = initCompileInfo(&compileInfo);
+
+      unsigned nextFile = 0;
+      if (fileResult == Result::Success)
+        fileResult = readPipelineFiles({inFiles[batchStart + i]}, 0, &nextFile, &compileInfo, fileNames[i]);
+      if (fileResult == Result::Success && compileInfo.stageMask != 0)
+        fileResult = buildShaderModules(compiler, &compileInfo);
+
+      if (fileResult != Result::Success) {
+        batchCount = i + 1;
+        break;
+      }
+
+      if (ToLink) {
+        compileInfo.fileNames = fileNames[i].c_str();
+        initPipelineBuildInfo(&compileInfo);
+
+        PipelineBuildItem buildItem = {};
+        if (isGraphicsPipeline(&compileInfo)) {
+          buildItem.pGraphicsInfo = &compileInfo.gfxPipelineInfo;
+          buildItem.pGraphicsOut = &compileInfo.gfxPipelineOut;
+        } else {
+          buildItem.pComputeInfo = &compileInfo.compPipelineInfo;
+          buildItem.pComputeOut = &compileInfo.compPipelineOut;
+        }
+        buildItems.push_back(buildItem);
+        buildItemFiles.push_back(i);
+      }
+    }
+
+    //
+    // Build the pipelines
+    //
+    Clock::time_point buildStartTime = Clock::now();
+    readTime += buildStartTime - readStartTime;
+
+    if (!buildItems.empty()) {
+      if (AsyncBuild) {
+        std::vector<unsigned> fileIndices;
+        for (unsigned fileIdx : buildItemFiles)
+          fileIndices.push_back(batchStart + fileIdx);
+        buildPipelinesAsync(compiler, buildItems, fileIndices);
+      } else
+        compiler->BuildPipelines(buildItems.size(), buildItems.data(), threadCount, nullptr, nullptr);
+    }
+    for (unsigned itemIdx = 0; itemIdx < buildItems.size(); ++itemIdx)
+      results[buildItemFiles[itemIdx]] = buildItems[itemIdx].result;
+
+    //
+    // Write the output files in the order of the input files, stopping at the first pipeline that failed
+    //
+    Clock::time_point writeStartTime = Clock::now();
+    buildTime += writeStartTime - buildStartTime;
+
+    for (unsigned i = 0; i < batchCount; ++i) {
+      CompileInfo &compileInfo = compileInfos[i];
+      if (result == Result::Success && results[i] == Result::Aborted) {
+        // A cancelled build is not a failure, the file is skipped.
+        outs() << "Cancelled the build of " << inFiles[batchStart + i] << "\n";
+      } else if (result == Result::Success) {
+        result = results[i];
+        if (result == Result::Success && ToLink) {
+          bool isGraphics = isGraphicsPipeline(&compileInfo);
+          const BinaryData &pipelineBin =
+              isGraphics ? compileInfo.gfxPipelineOut.pipelineBin : compileInfo.compPipelineOut.pipelineBin;
+          result = decodePipelineBinary(&pipelineBin, &compileInfo, isGraphics);
+          if (result == Result::Success)
+            result = outputElf(&compileInfo, OutFile, inFiles[batchStart + i]);
+        }
+        if (result == Result::Success)
+          ++builtCount;
+      }
+      cleanupCompileInfo(&compileInfo);
+    }
+    writeTime += Clock::now() - writeStartTime;
+  }
+
+  auto toMilliseconds = [](Clock::duration duration) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
+  };
+  Clock::duration totalTime = Clock::now() - startTime;
+  outs() << "===============================================================================\n";
+  outs() << "// AMDLLPC batch summary\n\n";
+  outs() << "Pipelines: " << builtCount << " of " << inFiles.size() << " built on " << threadCount << " threads\n";
+  outs() << "Time: total = " << toMilliseconds(totalTime) << " ms, read = " << toMilliseconds(readTime)
+         << " ms, build = " << toMilliseconds(buildTime) << " ms, write = " << toMilliseconds(writeTime) << " ms\n";
+  if (toMilliseconds(totalTime) > 0)
+    outs() << format("Throughput: %.1f pipelines/s\n", builtCount * 1000.0 / toMilliseconds(totalTime));
+  outs() << "\n";
+
+  return result;
+}
+
 #ifdef WIN_OS
 // =====================================================================================================================
 // Finds all filenames which can match input file name
@@ -1565,6 +1794,46 @@ static void findAllMatchFiles(const std::string &inFile, std::vector<std::string
 }
 #endif
 
+// =====================================================================================================================
+// Prints the statistics of the caches used by the compiler. They are printed even if LLPC output is disabled.
+//
+// @param compiler : LLPC compiler object
+static void printCacheStatistics(const ICompiler *compiler) {
+  CompilerCacheStatistics statistics = {};
+  compiler->GetCacheStatistics(&statistics);
+
+  const CacheStatistics &shaderCache = statistics.shaderCache;
+  outs() << "===============================================================================\n";
+  outs() << "// LLPC cache statistics\n\n";
+  outs() << "Shader cache: hits = " << shaderCache.hitCount << ", misses = " << shaderCache.missCount
+         << ", waits = " << shaderCache.waitCount << " (" << shaderCache.waitTime
+         << " us), stored = " << shaderCache.storedBytes << " bytes, evicted = " << shaderCache.evictedBytes
+         << " bytes, resident = " << shaderCache.residentBytes << " bytes, load time = " << shaderCache.loadTime
+         << " us, lock contentions = " << shaderCache.lockContentionCount << "\n";
+
+  auto printAccesses = [](const uint64_t(&accesses)[CacheAccessInfoCount]) {
+    outs() << "not checked = " << accesses[CacheNotChecked] << ", misses = " << accesses[CacheMiss]
+           << ", hits = " << accesses[CacheHit] << ", internal hits = " << accesses[InternalCacheHit] << "\n";
+  };
+  const ContextPoolStatistics &contextPool = statistics.contextPool;
+  outs() << "Context pool: acquired = " << contextPool.acquireCount
+         << ", affinity hits = " << contextPool.affinityHitCount << ", created = " << contextPool.createCount
+         << ", resident = " << contextPool.residentCount << ", in use = " << contextPool.inUseCount
+         << " (peak " << contextPool.peakInUseCount << "), retained = " << contextPool.retainedBytes
+         << " bytes, recycled = " << contextPool.recycleCount << "\n";
+
+  outs() << "Pipeline cache: ";
+  printAccesses(statistics.pipelineCacheAccesses);
+  for (unsigned stage = 0; stage < ShaderStageCount; ++stage) {
+    const uint64_t(&accesses)[CacheAccessInfoCount] = statistics.stageCacheAccesses[stage];
+    if (accesses[CacheMiss] + accesses[CacheHit] + accesses[InternalCacheHit] == 0)
+      continue;
+    outs() << "Relocatable " << getShaderStageName(static_cast<ShaderStage>(stage)) << " cache: ";
+    printAccesses(accesses);
+  }
+  outs() << "\n";
+}
+
 // =====================================================================================================================
 // Expands all input files in a platform-specific way.
 //
@@ -1653,12 +1922,22 @@ int main(int argc, char *argv[]) {
   if (isPipelineInfoFile(expandedInputFiles[0]) || isLlvmIrFile(expandedInputFiles[0])) {
     // The first input file is a pipeline file or LLVM IR file. Assume they all are, and compile each one
     // separately but in the same context.
-    unsigned nextFile = 0;
-
-    for (const std::string &file : expandedInputFiles) {
-      result = processPipeline(compiler, {file}, 0, &nextFile);
+    // NOTE: Pipelines are built concurrently only if nothing is output while they are built, because the output of
+    // different pipelines would be interleaved.
+    bool buildInParallel = Jobs != 1 && expandedInputFiles.size() > 1 && !CheckAutoLayoutCompatible && !EnableOuts() &&
+                           !cl::EnablePipelineDump && !TimePassesIsEnabled && !cl::EnableTimerProfile;
+    if (buildInParallel) {
+      result = processPipelinesInParallel(compiler, expandedInputFiles, Jobs);
       if (isFailure())
         return onFailure();
+    } else {
+      unsigned nextFile = 0;
+
+      for (const std::string &file : expandedInputFiles) {
+        result = processPipeline(compiler, {file}, 0, &nextFile);
+        if (isFailure())
+          return onFailure();
+      }
     }
   } else {
     // Otherwise, join all input files into the same pipeline.
@@ -1670,6 +1949,8 @@ int main(int argc, char *argv[]) {
   }
 
   assert(!isFailure());
+  if (PrintCacheStats)
+    printCacheStatistics(compiler);
   compiler->Destroy();
   LLPC_OUTS("\n=====  AMDLLPC SUCCESS  =====\n");
   return 0;
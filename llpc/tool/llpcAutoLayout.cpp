@@ -413,8 +413,8 @@ void doAutoLayoutDesc(ShaderStage shaderStage, BinaryData spirvBin, GraphicsPipe
                       PipelineShaderInfo *shaderInfo, ResourceMappingNodeMap &resNodeSets, unsigned &pushConstSize,
                       bool checkAutoLayoutCompatible) {
   // Read the SPIR-V.
-  std::string spirvCode(static_cast<const char *>(spirvBin.pCode), spirvBin.codeSize);
-  std::istringstream spirvStream(spirvCode);
+  assert(reinterpret_cast<uintptr_t>(spirvBin.pCode) % alignof(uint32_t) == 0);
+  SPIRVInputStream spirvStream(static_cast<const uint32_t *>(spirvBin.pCode), spirvBin.codeSize / sizeof(uint32_t));
   std::unique_ptr<SPIRVModule> module(SPIRVModule::createSPIRVModule());
   spirvStream >> *module;
 
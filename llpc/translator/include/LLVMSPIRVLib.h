@@ -111,10 +111,29 @@ class raw_pwrite_stream;
 /// @returns : True if succeeds.
 bool writeSpirv(llvm::Module *M, llvm::raw_ostream &OS, std::string &ErrMsg);
 
-/// \brief Load SPIRV from istream and translate to LLVM module.
+/// \brief Decode SPIRV from the words of a binary in memory, which are read in
+/// place, and apply the specialization constants to it as seen by the given
+/// entry point. The returned module is not modified by readSpirv, so it can be
+/// translated by several calls, concurrently too. A binary that fails to
+/// decode leaves the error in the module, and readSpirv reports it.
+/// @returns : The decoded module, which is owned by the caller.
+SPIRV::SPIRVModule *decodeSpirv(llvm::ArrayRef<uint32_t> SpirvCode, spv::ExecutionModel EntryExecModel,
+                                const char *EntryName, const SPIRV::SPIRVSpecConstMap &SpecConstMap);
+
+/// \brief Translate a SPIRV module returned by decodeSpirv for the same entry
+/// point to LLVM module.
 /// @returns : True if succeeds.
 bool readSpirv(lgc::Builder *Builder, const Vkgc::ShaderModuleUsage *ModuleData,
-               const Vkgc::PipelineShaderOptions *ShaderOptions, std::istream &IS, spv::ExecutionModel EntryExecModel,
+               const Vkgc::PipelineShaderOptions *ShaderOptions, SPIRV::SPIRVModule *SpirvModule,
+               spv::ExecutionModel EntryExecModel, const char *EntryName,
+               llvm::ArrayRef<SPIRV::ConvertingSampler> ConvertingSamplers, llvm::Module *M, std::string &ErrMsg);
+
+/// \brief Decode SPIRV from the words of a binary in memory, which are read in
+/// place, and translate it to LLVM module.
+/// @returns : True if succeeds.
+bool readSpirv(lgc::Builder *Builder, const Vkgc::ShaderModuleUsage *ModuleData,
+               const Vkgc::PipelineShaderOptions *ShaderOptions, llvm::ArrayRef<uint32_t> SpirvCode,
+               spv::ExecutionModel EntryExecModel,
                const char *EntryName, const SPIRV::SPIRVSpecConstMap &SpecConstMap,
                llvm::ArrayRef<SPIRV::ConvertingSampler> ConvertingSamplers, llvm::Module *M, std::string &ErrMsg);
 
@@ -50,6 +50,7 @@
 #include "llpcPipelineContext.h"
 #include "lgc/Pipeline.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/StringSwitch.h"
 #include "llvm/BinaryFormat/Dwarf.h"
 #include "llvm/IR/CFG.h"
@@ -131,11 +132,11 @@ static void dumpLLVM(Module *m, const std::string &fName) {
   }
 }
 
-SPIRVToLLVM::SPIRVToLLVM(Module *llvmModule, SPIRVModule *theSpirvModule, const SPIRVSpecConstMap &theSpecConstMap,
+SPIRVToLLVM::SPIRVToLLVM(Module *llvmModule, SPIRVModule *theSpirvModule,
                          ArrayRef<ConvertingSampler> convertingSamplers, lgc::Builder *builder,
                          const Vkgc::ShaderModuleUsage *moduleUsage, const Vkgc::PipelineShaderOptions *shaderOptions)
     : m_m(llvmModule), m_builder(builder), m_bm(theSpirvModule), m_enableXfb(false), m_entryTarget(nullptr),
-      m_specConstMap(theSpecConstMap), m_convertingSamplers(convertingSamplers), m_dbgTran(m_bm, m_m, this),
+      m_convertingSamplers(convertingSamplers), m_dbgTran(m_bm, m_m, this),
       m_moduleUsage(reinterpret_cast<const Vkgc::ShaderModuleUsage *>(moduleUsage)),
       m_shaderOptions(reinterpret_cast<const Vkgc::PipelineShaderOptions *>(shaderOptions)) {
   assert(m_m);
@@ -4116,8 +4117,8 @@ Value *SPIRVToLLVM::transValueWithoutDecoration(SPIRVValue *bv, Function *f, Bas
     auto lm = static_cast<SPIRVLoopMerge *>(br->getPrevious());
     if (lm && lm->getOpCode() == OpLoopMerge)
       setLLVMLoopMetadata(lm, bi);
-    else if (br->getBasicBlock()->getLoopMerge())
-      setLLVMLoopMetadata(br->getBasicBlock()->getLoopMerge(), bi);
+    else if (SPIRVLoopMerge *continueLm = m_loopMerges.lookup(br->getBasicBlock()))
+      setLLVMLoopMetadata(continueLm, bi);
 
     recordBlockPredecessor(successor, bb);
     return mapValue(bv, bi);
@@ -4142,8 +4143,8 @@ Value *SPIRVToLLVM::transValueWithoutDecoration(SPIRVValue *bv, Function *f, Bas
     auto lm = static_cast<SPIRVLoopMerge *>(br->getPrevious());
     if (lm && lm->getOpCode() == OpLoopMerge)
       setLLVMLoopMetadata(lm, bc);
-    else if (br->getBasicBlock()->getLoopMerge())
-      setLLVMLoopMetadata(br->getBasicBlock()->getLoopMerge(), bc);
+    else if (SPIRVLoopMerge *continueLm = m_loopMerges.lookup(br->getBasicBlock()))
+      setLLVMLoopMetadata(continueLm, bc);
 
     recordBlockPredecessor(trueSuccessor, bb);
     recordBlockPredecessor(falseSuccessor, bb);
@@ -4201,8 +4202,8 @@ Value *SPIRVToLLVM::transValueWithoutDecoration(SPIRVValue *bv, Function *f, Bas
     return nullptr;
   case OpLoopMerge: { // Should be translated at OpBranch or OpBranchConditional cases
     SPIRVLoopMerge *lm = static_cast<SPIRVLoopMerge *>(bv);
-    auto label = m_bm->get<SPIRVBasicBlock>(lm->getContinueTarget());
-    label->setLoopMerge(lm);
+    // The decoded module is not modified, as it may be translated on several threads at once.
+    m_loopMerges[m_bm->get<SPIRVBasicBlock>(lm->getContinueTarget())] = lm;
     return nullptr;
   }
   case OpSwitch: {
@@ -6166,6 +6167,27 @@ Instruction *SPIRVToLLVM::transSPIRVBuiltinFromInst(SPIRVInstruction *bi, BasicB
   return transBuiltinFromInst(getName(bi->getOpCode()), bi, bb);
 }
 
+// Collects the functions reachable from the entry function through OpFunctionCall, including the entry function.
+static void collectReachableFunctions(SPIRVFunction *entryFunc, SmallPtrSetImpl<SPIRVFunction *> &reachableFuncs) {
+  SmallVector<SPIRVFunction *, 8> worklist;
+  reachableFuncs.insert(entryFunc);
+  worklist.push_back(entryFunc);
+  while (!worklist.empty()) {
+    SPIRVFunction *func = worklist.pop_back_val();
+    for (size_t i = 0, e = func->getNumBasicBlock(); i != e; ++i) {
+      SPIRVBasicBlock *block = func->getBasicBlock(i);
+      for (size_t j = 0, instCount = block->getNumInst(); j != instCount; ++j) {
+        SPIRVInstruction *inst = block->getInst(j);
+        if (inst->getOpCode() != OpFunctionCall)
+          continue;
+        SPIRVFunction *callee = static_cast<SPIRVFunctionCall *>(inst)->getFunction();
+        if (reachableFuncs.insert(callee).second)
+          worklist.push_back(callee);
+      }
+    }
+  }
+}
+
 bool SPIRVToLLVM::translate(ExecutionModel entryExecModel, const char *entryName) {
   if (!transAddressingModel())
     return false;
@@ -6267,49 +6289,28 @@ bool SPIRVToLLVM::translate(ExecutionModel entryExecModel, const char *entryName
     m_dbgTran.createCompilationUnit();
   }
 
-  for (unsigned i = 0, e = m_bm->getNumConstants(); i != e; ++i) {
-    auto bv = m_bm->getConstant(i);
-    auto oc = bv->getOpCode();
-    if (oc == OpSpecConstant || oc == OpSpecConstantTrue || oc == OpSpecConstantFalse) {
-      unsigned specId = SPIRVID_INVALID;
-      bv->hasDecorate(DecorationSpecId, 0, &specId);
-      // assert(SpecId != SPIRVID_INVALID);
-      if (m_specConstMap.find(specId) != m_specConstMap.end()) {
-        auto specConstEntry = m_specConstMap.at(specId);
-        assert(specConstEntry.DataSize <= sizeof(uint64_t));
-        uint64_t data = 0;
-        memcpy(&data, specConstEntry.Data, specConstEntry.DataSize);
-
-        if (oc == OpSpecConstant)
-          static_cast<SPIRVConstant *>(bv)->setZExtIntValue(data);
-        else if (oc == OpSpecConstantTrue)
-          static_cast<SPIRVSpecConstantTrue *>(bv)->setBoolValue(data != 0);
-        else if (oc == OpSpecConstantFalse)
-          static_cast<SPIRVSpecConstantFalse *>(bv)->setBoolValue(data != 0);
-        else
-          llvm_unreachable("Invalid op code");
-      }
-    } else if (oc == OpSpecConstantOp) {
-      // NOTE: Constant folding is applied to OpSpecConstantOp because at this
-      // time, specialization info is obtained and all specialization constants
-      // get their own finalized specialization values.
-      auto bi = static_cast<SPIRVSpecConstantOp *>(bv);
-      bv = createValueFromSpecConstantOp(bi, m_fpControlFlags.RoundingModeRTE);
-      bi->mapToConstant(bv);
-    }
-  }
-
+  // NOTE: The specialization constants have been applied to the SPIR-V module when it was decoded, so the module is
+  // not modified here. That lets the module be translated by several pipelines, concurrently too.
   for (unsigned i = 0, e = m_bm->getNumVariables(); i != e; ++i) {
     auto bv = m_bm->getVariable(i);
     if (bv->getStorageClass() != StorageClassFunction)
       transValue(bv, nullptr, nullptr);
   }
 
+  // Only the functions reachable from the targeted entry-point are translated, so the functions used only by the other
+  // entry-points of the module are skipped. All the non entry-points are translated if the unused functions are kept
+  // or there is no targeted entry-point.
+  bool translateAllFuncs = !m_entryTarget || m_moduleUsage->keepUnusedFunctions;
+  SmallPtrSet<SPIRVFunction *, 16> reachableFuncs;
+  if (!translateAllFuncs)
+    collectReachableFunctions(m_entryTarget, reachableFuncs);
+
   for (unsigned i = 0, e = m_bm->getNumFunctions(); i != e; ++i) {
     auto bf = m_bm->getFunction(i);
-    // Non entry-points and targeted entry-point should be translated.
     // Set DLLExport on targeted entry-point so we can find it later.
-    if (!m_bm->getEntryPoint(bf->getId()) || bf == m_entryTarget) {
+    bool needTranslate = translateAllFuncs ? !m_bm->getEntryPoint(bf->getId()) || bf == m_entryTarget
+                                           : reachableFuncs.count(bf) != 0;
+    if (needTranslate) {
       auto f = transFunction(bf);
       if (bf == m_entryTarget)
         f->setDLLStorageClass(GlobalValue::DLLExportStorageClass);
@@ -8175,20 +8176,91 @@ llvm::Function *SPIRVToLLVM::createLibraryEntryFunc() {
 
 } // namespace SPIRV
 
+// =====================================================================================================================
+// Applies the specialization constants to the SPIR-V module. The OpSpecConstantOp instructions are folded to constants
+// with the rounding mode the entry point sets for them.
+//
+// @param bm : SPIR-V module
+// @param entryExecModel : Execution model of the entry point
+// @param entryName : Name of the entry point
+// @param specConstMap : Specialization constants
+static void applySpecConstants(SPIRVModule *bm, spv::ExecutionModel entryExecModel, const char *entryName,
+                               const SPIRVSpecConstMap &specConstMap) {
+  unsigned roundingModeRte = 0;
+  if (auto entryPoint = bm->getEntryPoint(entryExecModel, entryName)) {
+    auto entryTarget = bm->get<SPIRVFunction>(entryPoint->getTargetId());
+    if (auto em = entryTarget->getExecutionMode(ExecutionModeRoundingModeRTE))
+      roundingModeRte = em->getLiterals()[0] >> 3;
+  }
+
+  for (unsigned i = 0, e = bm->getNumConstants(); i != e; ++i) {
+    auto bv = bm->getConstant(i);
+    auto oc = bv->getOpCode();
+    if (oc == OpSpecConstant || oc == OpSpecConstantTrue || oc == OpSpecConstantFalse) {
+      unsigned specId = SPIRVID_INVALID;
+      bv->hasDecorate(DecorationSpecId, 0, &specId);
+      // assert(SpecId != SPIRVID_INVALID);
+      if (specConstMap.find(specId) != specConstMap.end()) {
+        auto specConstEntry = specConstMap.at(specId);
+        assert(specConstEntry.DataSize <= sizeof(uint64_t));
+        uint64_t data = 0;
+        memcpy(&data, specConstEntry.Data, specConstEntry.DataSize);
+
+        if (oc == OpSpecConstant)
+          static_cast<SPIRVConstant *>(bv)->setZExtIntValue(data);
+        else if (oc == OpSpecConstantTrue)
+          static_cast<SPIRVSpecConstantTrue *>(bv)->setBoolValue(data != 0);
+        else if (oc == OpSpecConstantFalse)
+          static_cast<SPIRVSpecConstantFalse *>(bv)->setBoolValue(data != 0);
+        else
+          llvm_unreachable("Invalid op code");
+      }
+    } else if (oc == OpSpecConstantOp) {
+      // NOTE: Constant folding is applied to OpSpecConstantOp because at this
+      // time, specialization info is obtained and all specialization constants
+      // get their own finalized specialization values.
+      auto bi = static_cast<SPIRVSpecConstantOp *>(bv);
+      bv = createValueFromSpecConstantOp(bi, roundingModeRte);
+      bi->mapToConstant(bv);
+    }
+  }
+}
+
+SPIRVModule *llvm::decodeSpirv(ArrayRef<uint32_t> spirvCode, spv::ExecutionModel entryExecModel, const char *entryName,
+                               const SPIRVSpecConstMap &specConstMap) {
+  SPIRVModule *bm = SPIRVModule::createSPIRVModule();
+
+  SPIRVInputStream is(spirvCode.data(), spirvCode.size());
+  is >> *bm;
+
+  // A module that fails to decode keeps its error for readSpirv to report.
+  if (!is.fail())
+    applySpecConstants(bm, entryExecModel, entryName, specConstMap);
+  return bm;
+}
+
 bool llvm::readSpirv(Builder *builder, const ShaderModuleUsage *shaderInfo, const PipelineShaderOptions *shaderOptions,
-                     std::istream &is, spv::ExecutionModel entryExecModel, const char *entryName,
+                     ArrayRef<uint32_t> spirvCode, spv::ExecutionModel entryExecModel, const char *entryName,
                      const SPIRVSpecConstMap &specConstMap, ArrayRef<ConvertingSampler> convertingSamplers, Module *m,
                      std::string &errMsg) {
-  assert(entryExecModel != ExecutionModelKernel && "Not support ExecutionModelKernel");
+  std::unique_ptr<SPIRVModule> bm(decodeSpirv(spirvCode, entryExecModel, entryName, specConstMap));
+  return readSpirv(builder, shaderInfo, shaderOptions, bm.get(), entryExecModel, entryName, convertingSamplers, m,
+                   errMsg);
+}
 
-  std::unique_ptr<SPIRVModule> bm(SPIRVModule::createSPIRVModule());
+bool llvm::readSpirv(Builder *builder, const ShaderModuleUsage *shaderInfo, const PipelineShaderOptions *shaderOptions,
+                     SPIRVModule *bm, spv::ExecutionModel entryExecModel, const char *entryName,
+                     ArrayRef<ConvertingSampler> convertingSamplers, Module *m, std::string &errMsg) {
+  assert(entryExecModel != ExecutionModelKernel && "Not support ExecutionModelKernel");
 
-  is >> *bm;
+  // Report the error of a module that failed to decode.
+  if (bm->getError(errMsg) != SPIRVEC_Success)
+    return false;
 
-  SPIRVToLLVM btl(m, bm.get(), specConstMap, convertingSamplers, builder, shaderInfo, shaderOptions);
+  SPIRVToLLVM btl(m, bm, convertingSamplers, builder, shaderInfo, shaderOptions);
   bool succeed = true;
   if (!btl.translate(entryExecModel, entryName)) {
-    bm->getError(errMsg);
+    btl.getError(errMsg);
     succeed = false;
   }
 
@@ -68,9 +68,12 @@ class SPIRVToLLVMDbgTran;
 
 class SPIRVToLLVM {
 public:
-  SPIRVToLLVM(Module *llvmModule, SPIRVModule *theSpirvModule, const SPIRVSpecConstMap &theSpecConstMap,
-              llvm::ArrayRef<ConvertingSampler> convertingSamplers, lgc::Builder *builder,
-              const Vkgc::ShaderModuleUsage *moduleUsage, const Vkgc::PipelineShaderOptions *shaderOptions);
+  SPIRVToLLVM(Module *llvmModule, SPIRVModule *theSpirvModule, llvm::ArrayRef<ConvertingSampler> convertingSamplers,
+              lgc::Builder *builder, const Vkgc::ShaderModuleUsage *moduleUsage,
+              const Vkgc::PipelineShaderOptions *shaderOptions);
+
+  // Gets the error of a failed translation.
+  SPIRVErrorCode getError(std::string &errMsg) { return m_errorLog.getError(errMsg); }
 
   DebugLoc getDebugLoc(SPIRVInstruction *bi, Function *f);
 
@@ -202,7 +205,6 @@ private:
   bool m_enableGatherLodNz;
   ShaderFloatControlFlags m_fpControlFlags;
   SPIRVFunction *m_entryTarget;
-  const SPIRVSpecConstMap &m_specConstMap;
   llvm::ArrayRef<ConvertingSampler> m_convertingSamplers;
   SPIRVToLLVMTypeMap m_typeMap;
   SPIRVToLLVMValueMap m_valueMap;
@@ -216,6 +218,8 @@ private:
   DenseMap<Type *, uint64_t> m_typeToStoreSize;
   DenseMap<std::pair<SPIRVType *, unsigned>, Type *> m_overlappingStructTypeWorkaroundMap;
   DenseMap<std::pair<BasicBlock *, BasicBlock *>, unsigned> m_blockPredecessorToCount;
+  DenseMap<SPIRVBasicBlock *, SPIRVLoopMerge *> m_loopMerges; // Loop merge of each translated loop by continue target
+  SPIRVErrorLog m_errorLog;
   const Vkgc::ShaderModuleUsage *m_moduleUsage;
   const Vkgc::PipelineShaderOptions *m_shaderOptions;
   unsigned m_spirvOpMetaKindId;
@@ -280,7 +284,8 @@ private:
 
   Value *getTranslatedValue(SPIRVValue *bv);
 
-  SPIRVErrorLog &getErrorLog() { return m_bm->getErrorLog(); }
+  // Errors of the translation are kept apart from the module, which may be shared by concurrent translations.
+  SPIRVErrorLog &getErrorLog() { return m_errorLog; }
 
   void setCallingConv(CallInst *call) {
     Function *f = call->getCalledFunction();
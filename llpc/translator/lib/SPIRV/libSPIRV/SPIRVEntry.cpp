@@ -47,6 +47,7 @@
 #include "SPIRVType.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <map>
 #include <set>
 #include <sstream>
@@ -57,6 +58,43 @@ using namespace SPIRV;
 
 namespace SPIRV {
 
+namespace {
+// Header in front of each entry, which records where it was allocated.
+struct alignas(alignof(std::max_align_t)) SPIRVEntryHeader {
+  bool FromArena;
+};
+} // namespace
+
+// Arena of the module being decoded by this thread.
+static thread_local llvm::BumpPtrAllocator *DecodeAllocator = nullptr;
+
+void *SPIRVEntry::operator new(size_t Size) {
+  size_t FullSize = sizeof(SPIRVEntryHeader) + Size;
+  void *Mem = nullptr;
+  if (DecodeAllocator)
+    Mem = DecodeAllocator->Allocate(FullSize, alignof(SPIRVEntryHeader));
+  else
+    Mem = ::operator new(FullSize);
+  SPIRVEntryHeader *Header = static_cast<SPIRVEntryHeader *>(Mem);
+  Header->FromArena = DecodeAllocator != nullptr;
+  return Header + 1;
+}
+
+void SPIRVEntry::operator delete(void *Ptr) {
+  if (!Ptr)
+    return;
+  SPIRVEntryHeader *Header = static_cast<SPIRVEntryHeader *>(Ptr) - 1;
+  if (!Header->FromArena)
+    ::operator delete(Header);
+}
+
+llvm::BumpPtrAllocator *
+SPIRVEntry::setDecodeAllocator(llvm::BumpPtrAllocator *Allocator) {
+  llvm::BumpPtrAllocator *Prev = DecodeAllocator;
+  DecodeAllocator = Allocator;
+  return Prev;
+}
+
 template <typename T> SPIRVEntry *create() { return new T(); }
 
 SPIRVEntry *SPIRVEntry::create(Op OpCode) {
@@ -116,7 +154,7 @@ SPIRVType *SPIRVEntry::getValueType(SPIRVId TheId) const {
   return get<SPIRVValue>(TheId)->getType();
 }
 
-SPIRVDecoder SPIRVEntry::getDecoder(std::istream &I) {
+SPIRVDecoder SPIRVEntry::getDecoder(SPIRVInputStream &I) {
   return SPIRVDecoder(I, *Module);
 }
 
@@ -155,7 +193,7 @@ bool SPIRVEntry::isEndOfBlock() const {
 // The word count and op code has already been read before calling this
 // function for creating the SPIRVEntry. Therefore the input stream only
 // contains the remaining part of the words for the SPIRVEntry.
-void SPIRVEntry::decode(std::istream &I) { assert(0 && "Not implemented"); }
+void SPIRVEntry::decode(SPIRVInputStream &I) { assert(0 && "Not implemented"); }
 
 std::vector<SPIRVValue *>
 SPIRVEntry::getValues(const std::vector<SPIRVId> &IdVec) const {
@@ -337,7 +375,7 @@ void SPIRVEntry::updateModuleVersion() const {
   Module->setMinSPIRVVersion(getRequiredSPIRVVersion());
 }
 
-std::istream &operator>>(std::istream &I, SPIRVEntry &E) {
+SPIRVInputStream &operator>>(SPIRVInputStream &I, SPIRVEntry &E) {
   E.decode(I);
   return I;
 }
@@ -349,18 +387,18 @@ SPIRVEntryPoint::SPIRVEntryPoint(SPIRVModule *TheModule,
                       getSizeInWords(TheName) + 3),
       ExecModel(TheExecModel), Name(TheName) {}
 
-void SPIRVEntryPoint::decode(std::istream &I) {
-  uint32_t Start = I.tellg();
+void SPIRVEntryPoint::decode(SPIRVInputStream &I) {
+  size_t Start = I.tell();
   getDecoder(I) >> ExecModel >> Target >> Name;
-  uint32_t Curr = I.tellg();
-  uint32_t NumInOuts = WordCount - (Curr - Start) / sizeof(uint32_t) - 1;
+  size_t Curr = I.tell();
+  uint32_t NumInOuts = WordCount - (Curr - Start) - 1;
   InOuts.resize(NumInOuts);
   getDecoder(I) >> InOuts;
   Module->setName(getOrCreateTarget(), Name);
   Module->addEntryPoint(this);
 }
 
-void SPIRVExecutionMode::decode(std::istream &I) {
+void SPIRVExecutionMode::decode(SPIRVInputStream &I) {
   getDecoder(I) >> Target >> ExecMode;
   bool MergeEM = false;
   switch (ExecMode) {
@@ -403,7 +441,7 @@ SPIRVForward *SPIRVAnnotationGeneric::getOrCreateTarget() const {
 SPIRVName::SPIRVName(const SPIRVEntry *TheTarget, const std::string &TheStr)
     : SPIRVAnnotation(TheTarget, getSizeInWords(TheStr) + 2), Str(TheStr) {}
 
-void SPIRVName::decode(std::istream &I) {
+void SPIRVName::decode(SPIRVInputStream &I) {
   getDecoder(I) >> Target >> Str;
   Module->setName(getOrCreateTarget(), Str);
 }
@@ -415,7 +453,7 @@ void SPIRVName::validate() const {
 _SPIRV_IMP_ENCDEC2(SPIRVString, Id, Str)
 _SPIRV_IMP_DECODE3(SPIRVMemberName, Target, MemberNumber, Str)
 
-void SPIRVLine::decode(std::istream &I) {
+void SPIRVLine::decode(SPIRVInputStream &I) {
   getDecoder(I) >> FileName >> Line >> Column;
   std::shared_ptr<const SPIRVLine> L(this);
   Module->setCurrentLine(L);
@@ -444,7 +482,7 @@ SPIRVExtInstImport::SPIRVExtInstImport(SPIRVModule *TheModule, SPIRVId TheId,
   validate();
 }
 
-void SPIRVExtInstImport::decode(std::istream &I) {
+void SPIRVExtInstImport::decode(SPIRVInputStream &I) {
   getDecoder(I) >> Id >> Str;
   Module->importBuiltinSetWithId(Str, Id);
 }
@@ -454,7 +492,7 @@ void SPIRVExtInstImport::validate() const {
   assert(!Str.empty() && "Invalid builtin set");
 }
 
-void SPIRVMemoryModel::decode(std::istream &I) {
+void SPIRVMemoryModel::decode(SPIRVInputStream &I) {
   SPIRVAddressingModelKind AddrModel;
   SPIRVMemoryModelKind MemModel;
   getDecoder(I) >> AddrModel >> MemModel;
@@ -470,7 +508,7 @@ void SPIRVMemoryModel::validate() const {
   SPIRVCK(isValid(MM), InvalidMemoryModel, "Actual is " + std::to_string(MM));
 }
 
-void SPIRVSource::decode(std::istream &I) {
+void SPIRVSource::decode(SPIRVInputStream &I) {
   SourceLanguage Lang = SourceLanguageUnknown;
   SPIRVWord Ver = SPIRVWORD_MAX;
   getDecoder(I) >> Lang >> Ver;
@@ -485,7 +523,7 @@ SPIRVSourceContinued::SPIRVSourceContinued(SPIRVModule *M,
     const std::string &SS)
   :SPIRVEntryNoId(M, 1 + getSizeInWords(SS)), Str(SS){}
 
-void SPIRVSourceContinued::decode(std::istream &I) {
+void SPIRVSourceContinued::decode(SPIRVInputStream &I) {
   getDecoder(I) >> Str;
 }
 
@@ -493,7 +531,7 @@ SPIRVSourceExtension::SPIRVSourceExtension(SPIRVModule *M,
                                            const std::string &SS)
     : SPIRVEntryNoId(M, 1 + getSizeInWords(SS)), S(SS) {}
 
-void SPIRVSourceExtension::decode(std::istream &I) {
+void SPIRVSourceExtension::decode(SPIRVInputStream &I) {
   getDecoder(I) >> S;
   Module->getSourceExtension().insert(S);
 }
@@ -501,7 +539,7 @@ void SPIRVSourceExtension::decode(std::istream &I) {
 SPIRVExtension::SPIRVExtension(SPIRVModule *M, const std::string &SS)
     : SPIRVEntryNoId(M, 1 + getSizeInWords(SS)), S(SS) {}
 
-void SPIRVExtension::decode(std::istream &I) {
+void SPIRVExtension::decode(SPIRVInputStream &I) {
   getDecoder(I) >> S;
   Module->getExtension().insert(S);
 }
@@ -511,7 +549,7 @@ SPIRVCapability::SPIRVCapability(SPIRVModule *M, SPIRVCapabilityKind K)
   updateModuleVersion();
 }
 
-void SPIRVCapability::decode(std::istream &I) {
+void SPIRVCapability::decode(SPIRVInputStream &I) {
   getDecoder(I) >> Kind;
   Module->addCapability(Kind);
 }
@@ -520,7 +558,7 @@ SPIRVModuleProcessed::SPIRVModuleProcessed(SPIRVModule *M,
     const std::string &SS)
   :SPIRVEntryNoId(M, 1 + getSizeInWords(SS)), Str(SS){}
 
-void SPIRVModuleProcessed::decode(std::istream &I) {
+void SPIRVModuleProcessed::decode(SPIRVInputStream &I) {
   getDecoder(I) >> Str;
 }
 
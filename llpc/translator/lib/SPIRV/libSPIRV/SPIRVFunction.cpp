@@ -56,17 +56,17 @@ SPIRVFunctionParameter::SPIRVFunctionParameter(SPIRVType *TheType,
   validate();
 }
 
-SPIRVDecoder SPIRVFunction::getDecoder(std::istream &IS) {
+SPIRVDecoder SPIRVFunction::getDecoder(SPIRVInputStream &IS) {
   return SPIRVDecoder(IS, *this);
 }
 
-void SPIRVFunction::decode(std::istream &I) {
+void SPIRVFunction::decode(SPIRVInputStream &I) {
   SPIRVDecoder Decoder = getDecoder(I);
   Decoder >> Type >> Id >> FCtrlMask >> FuncType;
   Module->addFunction(this);
 
   Decoder.getWordCountAndOpCode();
-  while (!I.eof()) {
+  while (!I.eof() && !I.fail()) {
     if (Decoder.OpCode == OpFunctionEnd)
       break;
 
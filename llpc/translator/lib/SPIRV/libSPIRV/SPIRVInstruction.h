@@ -338,7 +338,7 @@ public:
   void setHasVariableWordCount(bool VariWC) { HasVariWC = VariWC; }
 
 protected:
-  void decode(std::istream &I) override {
+  void decode(SPIRVInputStream &I) override {
     auto D = getDecoder(I);
     if (hasType())
       D >> Type;
@@ -621,7 +621,7 @@ protected:
     MemoryAccess.resize(TheWordCount - FixedWords);
   }
 
-  void decode(std::istream &I) override {
+  void decode(SPIRVInputStream &I) override {
     getDecoder(I) >> PtrId >> ValId >> MemoryAccess;
     memoryAccessUpdate(MemoryAccess);
   }
@@ -674,7 +674,7 @@ protected:
     MemoryAccess.resize(TheWordCount - FixedWords);
   }
 
-  void decode(std::istream &I) override {
+  void decode(SPIRVInputStream &I) override {
     getDecoder(I) >> Type >> Id >> PtrId >> MemoryAccess;
     memoryAccessUpdate(MemoryAccess);
   }
@@ -1690,7 +1690,7 @@ public:
             ExtSetKind == SPIRVEIS_Debug) &&
            "not supported");
   }
-  void decode(std::istream &I) override {
+  void decode(SPIRVInputStream &I) override {
     getDecoder(I) >> Type >> Id >> ExtSetId;
     setExtSetKindById();
     switch (ExtSetKind) {
@@ -2021,7 +2021,7 @@ protected:
     MemoryAccess.resize(TheWordCount - FixedWords);
   }
 
-  void decode(std::istream &I) override {
+  void decode(SPIRVInputStream &I) override {
     getDecoder(I) >> Target >> Source >> MemoryAccess;
     memoryAccessUpdate(MemoryAccess);
   }
@@ -2075,7 +2075,7 @@ protected:
     MemoryAccess.resize(TheWordCount - FixedWords);
   }
 
-  void decode(std::istream &I) override {
+  void decode(SPIRVInputStream &I) override {
     getDecoder(I) >> Target >> Source >> Size >> MemoryAccess;
     memoryAccessUpdate(MemoryAccess);
   }
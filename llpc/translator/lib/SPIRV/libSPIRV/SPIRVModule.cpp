@@ -47,6 +47,7 @@
 #include "SPIRVType.h"
 #include "SPIRVValue.h"
 
+#include <map>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
@@ -58,6 +59,56 @@ SPIRVModule::SPIRVModule()
 
 SPIRVModule::~SPIRVModule() {}
 
+// Table from ids to entries. The ids of a module are dense below the bound in
+// its header, so the ids below the size of the dense table are looked up by
+// index. Other ids, beyond a pathological bound or created after decoding, are
+// kept in a map.
+class SPIRVIdEntryTable {
+public:
+  void reserve(size_t DenseSize) {
+    assert(Sparse.empty() || Sparse.begin()->first >= DenseSize);
+    if (DenseSize > Dense.size())
+      Dense.resize(DenseSize, nullptr);
+  }
+
+  SPIRVEntry *lookup(SPIRVId Id) const {
+    if (Id < Dense.size())
+      return Dense[Id];
+    auto Loc = Sparse.find(Id);
+    return Loc == Sparse.end() ? nullptr : Loc->second;
+  }
+
+  void set(SPIRVId Id, SPIRVEntry *Entry) {
+    assert(Entry);
+    if (Id < Dense.size())
+      Dense[Id] = Entry;
+    else
+      Sparse[Id] = Entry;
+  }
+
+  void erase(SPIRVId Id) {
+    assert(lookup(Id));
+    if (Id < Dense.size())
+      Dense[Id] = nullptr;
+    else
+      Sparse.erase(Id);
+  }
+
+  // Calls the callback on each entry in the order of the ids.
+  template <typename CallbackTy> void forEach(CallbackTy Callback) const {
+    for (SPIRVEntry *Entry : Dense) {
+      if (Entry)
+        Callback(Entry);
+    }
+    for (auto &I : Sparse)
+      Callback(I.second);
+  }
+
+private:
+  std::vector<SPIRVEntry *> Dense;
+  std::map<SPIRVId, SPIRVEntry *> Sparse;
+};
+
 class SPIRVModuleImpl : public SPIRVModule {
 public:
   SPIRVModuleImpl()
@@ -340,9 +391,12 @@ public:
                                                SPIRVBasicBlock *) override;
 
   // Input functions
-  friend std::istream &operator>>(std::istream &I, SPIRVModule &M);
+  friend SPIRVInputStream &operator>>(SPIRVInputStream &I, SPIRVModule &M);
 
 private:
+  // Arena of the entries decoded into the module. It is declared first so that
+  // it outlives the entries the other members may still delete.
+  llvm::BumpPtrAllocator EntryAllocator;
   SPIRVErrorLog ErrLog;
   SPIRVId NextId;
   SPIRVWord SPIRVVersion;
@@ -356,7 +410,6 @@ private:
   SPIRVAddressingModelKind AddrModel;
   SPIRVMemoryModelKind MemoryModel;
 
-  typedef std::map<SPIRVId, SPIRVEntry *> SPIRVIdToEntryMap;
   typedef std::vector<SPIRVEntry *> SPIRVEntryVector;
   typedef std::set<SPIRVId> SPIRVIdSet;
   typedef std::vector<SPIRVId> SPIRVIdVec;
@@ -377,7 +430,7 @@ private:
 
   SPIRVForwardPointerVec ForwardPointerVec;
   SPIRVTypeVec TypeVec;
-  SPIRVIdToEntryMap IdEntryMap;
+  SPIRVIdEntryTable IdEntryMap;
   SPIRVFunctionVector FuncVec;
   SPIRVConstantVector ConstVec;
   SPIRVVariableVec VariableVec;
@@ -403,8 +456,7 @@ private:
 
 SPIRVModuleImpl::~SPIRVModuleImpl() {
 
-  for (auto I : IdEntryMap)
-    delete I.second;
+  IdEntryMap.forEach([](SPIRVEntry *Entry) { delete Entry; });
 
   for (auto I : EntryNoId) {
     if (I->getOpCode() == OpLine)
@@ -557,7 +609,7 @@ SPIRVEntry *SPIRVModuleImpl::addEntry(SPIRVEntry *Entry) {
         assert(Mapped == Entry && "Id used twice");
       }
     } else
-      IdEntryMap[Id] = Entry;
+      IdEntryMap.set(Id, Entry);
   } else {
     if (EntryNoId.empty() || Entry !=  EntryNoId.back())
       EntryNoId.push_back(Entry);
@@ -584,11 +636,11 @@ bool SPIRVModuleImpl::exist(SPIRVId Id) const { return exist(Id, nullptr); }
 
 bool SPIRVModuleImpl::exist(SPIRVId Id, SPIRVEntry **Entry) const {
   assert(Id != SPIRVID_INVALID && "Invalid Id");
-  SPIRVIdToEntryMap::const_iterator Loc = IdEntryMap.find(Id);
-  if (Loc == IdEntryMap.end())
+  SPIRVEntry *Mapped = IdEntryMap.lookup(Id);
+  if (!Mapped)
     return false;
   if (Entry)
-    *Entry = Loc->second;
+    *Entry = Mapped;
   return true;
 }
 
@@ -605,9 +657,9 @@ SPIRVId SPIRVModuleImpl::getId(SPIRVId Id, unsigned Increment) {
 
 SPIRVEntry *SPIRVModuleImpl::getEntry(SPIRVId Id) const {
   assert(Id != SPIRVID_INVALID && "Invalid Id");
-  SPIRVIdToEntryMap::const_iterator Loc = IdEntryMap.find(Id);
-  assert(Loc != IdEntryMap.end() && "Id is not in map");
-  return Loc->second;
+  SPIRVEntry *Entry = IdEntryMap.lookup(Id);
+  assert(Entry && "Id is not in map");
+  return Entry;
 }
 
 SPIRVExtInstSetKind SPIRVModuleImpl::getBuiltinSet(SPIRVId SetId) const {
@@ -838,13 +890,11 @@ SPIRVEntry *SPIRVModuleImpl::replaceForward(SPIRVForward *Forward,
   SPIRVId Id = Entry->getId();
   SPIRVId ForwardId = Forward->getId();
   if (ForwardId == Id)
-    IdEntryMap[Id] = Entry;
+    IdEntryMap.set(Id, Entry);
   else {
-    auto Loc = IdEntryMap.find(Id);
-    assert(Loc != IdEntryMap.end());
-    IdEntryMap.erase(Loc);
+    IdEntryMap.erase(Id);
     Entry->setId(ForwardId);
-    IdEntryMap[ForwardId] = Entry;
+    IdEntryMap.set(ForwardId, Entry);
   }
   // Annotations include name, decorations, execution modes
   Entry->takeAnnotations(Forward);
@@ -863,9 +913,7 @@ void SPIRVModuleImpl::eraseInstruction(SPIRVInstruction *I,
                                        SPIRVBasicBlock *BB) {
   SPIRVId Id = I->getId();
   BB->eraseInstruction(I);
-  auto Loc = IdEntryMap.find(Id);
-  assert(Loc != IdEntryMap.end());
-  IdEntryMap.erase(Loc);
+  IdEntryMap.erase(Id);
   delete I;
 }
 
@@ -1257,7 +1305,7 @@ void SPIRVModuleImpl::addUnknownStructField(SPIRVTypeStruct *Struct, unsigned I,
   UnknownStructFieldMap[Struct].push_back(std::make_pair(I, ID));
 }
 
-std::istream &operator>>(std::istream &I, SPIRVModule &M) {
+SPIRVInputStream &operator>>(SPIRVInputStream &I, SPIRVModule &M) {
   SPIRVDecoder Decoder(I, M);
   SPIRVModuleImpl &MI = *static_cast<SPIRVModuleImpl *>(&M);
   // Disable automatic capability filling.
@@ -1275,19 +1323,26 @@ std::istream &operator>>(std::istream &I, SPIRVModule &M) {
   MI.GeneratorId = Generator >> 16;
   MI.GeneratorVer = Generator & 0xFFFF;
 
-  // Bound for Id
+  // Bound for Id. The ids below it are looked up in a dense table, but a
+  // module can't define more ids than it has words, so a bound beyond that is
+  // not trusted for the size of the table.
   Decoder >> MI.NextId;
+  MI.IdEntryMap.reserve(std::min<size_t>(MI.NextId, I.remaining()));
 
   Decoder >> MI.InstSchema;
   assert(MI.InstSchema == SPIRVISCH_Default &&
          "Unsupported instruction schema");
 
+  // Entries decoded from the binary are allocated from the arena of the module.
+  llvm::BumpPtrAllocator *PrevAllocator =
+      SPIRVEntry::setDecodeAllocator(&MI.EntryAllocator);
   while(Decoder.getWordCountAndOpCode())
     Decoder.getEntry();
 
   MI.optimizeDecorates();
   MI.resolveUnknownStructFields();
   MI.createForwardPointers();
+  SPIRVEntry::setDecodeAllocator(PrevAllocator);
   return I;
 }
 
@@ -343,7 +343,7 @@ public:
                                                        SPIRVValue *,
                                                        SPIRVBasicBlock *) = 0;
   // Input functions
-  friend std::istream &operator>>(std::istream &I, SPIRVModule &M);
+  friend SPIRVInputStream &operator>>(SPIRVInputStream &I, SPIRVModule &M);
 
 protected:
   bool AutoAddCapability;
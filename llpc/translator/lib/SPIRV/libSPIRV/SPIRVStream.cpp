@@ -41,14 +41,33 @@
 #include "SPIRVFunction.h"
 #include "SPIRVNameMapEnum.h"
 #include "SPIRVOpCode.h"
+#include <cstring>
 
 namespace SPIRV {
 
-SPIRVDecoder::SPIRVDecoder(std::istream &InputStream, SPIRVFunction &F)
+// Read a string with padded 0's at the end so that they form a stream of
+// words. The string must be terminated within the stream.
+bool SPIRVInputStream::readString(std::string &Str) {
+  const char *Chars = reinterpret_cast<const char *>(Cur);
+  size_t MaxLength = remaining() * sizeof(uint32_t);
+  const char *Terminator =
+      static_cast<const char *>(memchr(Chars, '\0', MaxLength));
+  if (!Terminator) {
+    Cur = End;
+    Failed = true;
+    return false;
+  }
+  size_t Length = Terminator - Chars;
+  Str.append(Chars, Length);
+  Cur += Length / sizeof(uint32_t) + 1;
+  return true;
+}
+
+SPIRVDecoder::SPIRVDecoder(SPIRVInputStream &InputStream, SPIRVFunction &F)
     : IS(InputStream), M(*F.getModule()), WordCount(0), OpCode(OpNop),
       Scope(&F) {}
 
-SPIRVDecoder::SPIRVDecoder(std::istream &InputStream, SPIRVBasicBlock &BB)
+SPIRVDecoder::SPIRVDecoder(SPIRVInputStream &InputStream, SPIRVBasicBlock &BB)
     : IS(InputStream), M(*BB.getModule()), WordCount(0), OpCode(OpNop),
       Scope(&BB) {}
 
@@ -74,21 +93,8 @@ SPIRV_DEF_ENCDEC(GLSLExtOpKind)
 SPIRV_DEF_ENCDEC(SPIRVDebugExtOpKind)
 SPIRV_DEF_ENCDEC(LinkageType)
 
-// Read a string with padded 0's at the end so that they form a stream of
-// words.
 const SPIRVDecoder &operator>>(const SPIRVDecoder &I, std::string &Str) {
-  uint64_t Count = 0;
-  char Ch;
-  while (I.IS.get(Ch) && Ch != '\0') {
-    Str += Ch;
-    ++Count;
-  }
-  Count = (Count + 1) % 4;
-  Count = Count ? 4 - Count : 0;
-  for (; Count; --Count) {
-    I.IS >> Ch;
-    assert(Ch == '\0' && "Invalid string in SPIRV");
-  }
+  I.IS.readString(Str);
   return I;
 }
 
@@ -102,7 +108,9 @@ bool SPIRVDecoder::getWordCountAndOpCode() {
   *this >> WordCountAndOpCode;
   WordCount = WordCountAndOpCode >> 16;
   OpCode = static_cast<Op>(WordCountAndOpCode & 0xFFFF);
-  assert(!IS.bad() && "SPIRV stream is bad");
+  // The operands of the instruction must be within the stream.
+  if (!IS.fail() && (WordCount == 0 || WordCount > IS.remaining() + 1))
+    setWordCountError(IS.tell() - 1);
   if (IS.fail()) {
     WordCount = 0;
     OpCode = OpNop;
@@ -122,18 +130,35 @@ SPIRVEntry *SPIRVDecoder::getEntry() {
     Entry->setScope(Scope);
   Entry->setWordCount(WordCount);
   Entry->setLine(M.getCurrentLine());
+  size_t InstStart = IS.tell() - 1;
   IS >> *Entry;
   if(Entry->isEndOfBlock() || OpCode == OpNoLine)
     M.setCurrentLine(nullptr);
-  assert(!IS.bad() && !IS.fail() && "SPIRV stream fails");
+  // The operands must be within the word count. A function decodes its body
+  // along with it, and the decoders of the body report their own errors.
+  if (OpCode != OpFunction &&
+      (IS.fail() || IS.tell() > InstStart + WordCount))
+    setWordCountError(InstStart);
   M.add(Entry);
   return Entry;
 }
 
+// Report an instruction whose operands are not within its word count or the
+// binary, and stop decoding.
+void SPIRVDecoder::setWordCountError(size_t InstStart) {
+  M.getErrorLog().setError(SPIRVEC_InvalidWordCount,
+                           SPIRVErrorMap::map(SPIRVEC_InvalidWordCount) +
+                               " Opcode " + std::to_string(OpCode) +
+                               " with word count " +
+                               std::to_string(WordCount) + " at word " +
+                               std::to_string(InstStart));
+  IS.setFailed();
+}
+
 void SPIRVDecoder::validate() const {
   assert(OpCode != OpNop && "Invalid op code");
   assert(WordCount && "Invalid word count");
-  assert(!IS.bad() && "Bad iInput stream");
+  assert(!IS.fail() && "Bad input stream");
 }
 
 } // namespace SPIRV
@@ -55,19 +55,54 @@ namespace SPIRV {
 class SPIRVFunction;
 class SPIRVBasicBlock;
 
+/// Bounds-checked input stream over the words of a SPIR-V binary in memory.
+/// The words are read in place, so the binary must outlive the stream. A read
+/// past the end yields zeros and puts the stream in the failed state.
+class SPIRVInputStream {
+public:
+  SPIRVInputStream(const uint32_t *Words, size_t WordCount)
+      : Begin(Words), Cur(Words), End(Words + WordCount), Failed(false) {}
+
+  bool read(uint32_t &Word) {
+    if (Cur == End) {
+      Failed = true;
+      Word = 0;
+      return false;
+    }
+    Word = *Cur++;
+    return true;
+  }
+  bool readString(std::string &Str);
+
+  /// Returns the position of the stream in words.
+  size_t tell() const { return Cur - Begin; }
+  /// Returns the count of words left in the stream.
+  size_t remaining() const { return End - Cur; }
+  bool eof() const { return Cur == End; }
+  bool fail() const { return Failed; }
+  void setFailed() { Failed = true; }
+
+private:
+  const uint32_t *Begin;
+  const uint32_t *Cur;
+  const uint32_t *End;
+  bool Failed;
+};
+
 class SPIRVDecoder {
 public:
-  SPIRVDecoder(std::istream &InputStream, SPIRVModule &Module)
+  SPIRVDecoder(SPIRVInputStream &InputStream, SPIRVModule &Module)
       : IS(InputStream), M(Module), WordCount(0), OpCode(OpNop), Scope(NULL) {}
-  SPIRVDecoder(std::istream &InputStream, SPIRVFunction &F);
-  SPIRVDecoder(std::istream &InputStream, SPIRVBasicBlock &BB);
+  SPIRVDecoder(SPIRVInputStream &InputStream, SPIRVFunction &F);
+  SPIRVDecoder(SPIRVInputStream &InputStream, SPIRVBasicBlock &BB);
 
   void setScope(SPIRVEntry *);
   bool getWordCountAndOpCode();
   SPIRVEntry *getEntry();
   void validate() const;
+  void setWordCountError(size_t InstStart);
 
-  std::istream &IS;
+  SPIRVInputStream &IS;
   SPIRVModule &M;
   SPIRVWord WordCount;
   Op OpCode;
@@ -77,7 +112,7 @@ public:
 template <typename T>
 const SPIRVDecoder &decodeBinary(const SPIRVDecoder &I, T &V) {
   uint32_t W;
-  I.IS.read(reinterpret_cast<char *>(&W), sizeof(W));
+  I.IS.read(W);
   V = static_cast<T>(W);
   return I;
 }
@@ -171,7 +171,7 @@ protected:
     SPIRVValue::setWordCount(WordCount);
     NumWords = WordCount - 3;
   }
-  void decode(std::istream &I) override {
+  void decode(SPIRVInputStream &I) override {
     getDecoder(I) >> Type >> Id;
     for (unsigned J = 0; J < NumWords; ++J)
       getDecoder(I) >> Union.Words[J];
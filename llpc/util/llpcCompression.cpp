@@ -0,0 +1,316 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2021 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  llpcCompression.cpp
+ * @brief LLPC source file: contains implementation of the codec used to compress the data stored in shader caches.
+ ***********************************************************************************************************************
+ */
+#include "llpcCompression.h"
+#include <algorithm>
+#include <cassert>
+#include <string.h>
+
+#define DEBUG_TYPE "llpc-compression"
+
+namespace Llpc {
+
+// Parameters of the LZ4 block format
+static constexpr size_t Lz4MinMatch = 4;       // Minimum length of a match
+static constexpr size_t Lz4LastLiterals = 5;   // The last bytes of the data are always stored as literals
+static constexpr size_t Lz4MatchFindLimit = 12; // A match cannot start within this many bytes of the end of the data
+static constexpr size_t Lz4MaxOffset = 65535;  // Maximum distance of a match from the data it copies
+static constexpr unsigned Lz4HashLog = 12;     // Log2 of the number of entries of the match finder's hash table
+
+// Data smaller than this is not worth compressing for a cache blob
+static constexpr size_t MinCacheBlobCompressSize = 64;
+
+// Header of a compressed cache blob
+struct CacheBlobHeader {
+  uint32_t magic;         // Always CacheBlobMagic
+  uint32_t version;       // Version of the blob layout (CacheBlobVersion)
+  CompressionCodec codec; // Codec the data following the header is compressed with
+  uint64_t rawSize;       // Size of the data after decompression
+};
+
+static constexpr uint32_t CacheBlobMagic = 0x5A43504C; // "LPCZ"
+
+// =====================================================================================================================
+// Reads 4 bytes from a possibly unaligned address.
+//
+// @param data : Data to read
+static uint32_t read32(const uint8_t *data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+// =====================================================================================================================
+// Writes a length that does not fit in the 4 bits of a sequence token as a series of bytes, each adding up to 255.
+//
+// @param length : Length minus the 15 stored in the token
+// @param [in/out] out : Output pointer
+static void writeLz4Length(size_t length, uint8_t *&out) {
+  for (; length >= 255; length -= 255)
+    *out++ = 255;
+  *out++ = static_cast<uint8_t>(length);
+}
+
+// =====================================================================================================================
+// Writes one sequence of the LZ4 block format: a token, the literals, and the offset and the length of the match that
+// follows them. The last sequence has no match.
+//
+// @param literals : Literals of the sequence
+// @param literalLength : Number of literals
+// @param offset : Distance of the match from the data it copies
+// @param matchLength : Length of the match, or 0 for the last sequence
+// @param [in/out] out : Output pointer
+// @param outEnd : End of the output buffer
+// @returns : False if the sequence does not fit in the output buffer
+static bool writeLz4Sequence(const uint8_t *literals, size_t literalLength, size_t offset, size_t matchLength,
+                             uint8_t *&out, uint8_t *outEnd) {
+  const size_t maxSize = 1 + literalLength / 255 + 1 + literalLength + 2 + matchLength / 255 + 1;
+  if (static_cast<size_t>(outEnd - out) < maxSize)
+    return false;
+
+  uint8_t *token = out++;
+  *token = static_cast<uint8_t>(std::min<size_t>(literalLength, 15) << 4);
+  if (literalLength >= 15)
+    writeLz4Length(literalLength - 15, out);
+  memcpy(out, literals, literalLength);
+  out += literalLength;
+
+  if (matchLength > 0) {
+    assert(matchLength >= Lz4MinMatch && offset > 0 && offset <= Lz4MaxOffset);
+    *out++ = static_cast<uint8_t>(offset);
+    *out++ = static_cast<uint8_t>(offset >> 8);
+    *token |= static_cast<uint8_t>(std::min<size_t>(matchLength - Lz4MinMatch, 15));
+    if (matchLength - Lz4MinMatch >= 15)
+      writeLz4Length(matchLength - Lz4MinMatch - 15, out);
+  }
+  return true;
+}
+
+// =====================================================================================================================
+// Compresses data in the LZ4 block format, using a greedy match finder with a single-entry hash table. The search
+// skips ahead faster the longer it goes without a match, so incompressible data is not slow to go through.
+//
+// @param data : Data to compress
+// @param dataSize : Size of the data in bytes
+// @param [out] compressedData : Buffer to store the compressed data
+// @param compressedCapacity : Size of the output buffer in bytes
+// @returns : Size of the compressed data, or 0 if it does not fit in the output buffer
+size_t compressLz4(const void *data, size_t dataSize, void *compressedData, size_t compressedCapacity) {
+  const uint8_t *const in = static_cast<const uint8_t *>(data);
+  const uint8_t *const inEnd = in + dataSize;
+  uint8_t *const outStart = static_cast<uint8_t *>(compressedData);
+  uint8_t *const outEnd = outStart + compressedCapacity;
+  uint8_t *out = outStart;
+  const uint8_t *anchor = in;
+
+  if (dataSize > Lz4MatchFindLimit) {
+    // Offsets from the start of the data of the last position seen with each hash value
+    std::vector<uint32_t> hashTable(1u << Lz4HashLog, 0);
+    const uint8_t *const matchLimit = inEnd - Lz4LastLiterals;
+    const uint8_t *const searchLimit = inEnd - Lz4MatchFindLimit;
+    const uint8_t *pos = in;
+    unsigned missCount = 0;
+
+    while (pos <= searchLimit) {
+      const uint32_t sequence = read32(pos);
+      const uint32_t hash = (sequence * 2654435761u) >> (32 - Lz4HashLog);
+      const uint8_t *match = in + hashTable[hash];
+      hashTable[hash] = static_cast<uint32_t>(pos - in);
+
+      if (match >= pos || static_cast<size_t>(pos - match) > Lz4MaxOffset || read32(match) != sequence) {
+        pos += 1 + (missCount++ >> 6);
+        continue;
+      }
+
+      // Extend the match forward as far as possible.
+      const uint8_t *matchEnd = pos + Lz4MinMatch;
+      const uint8_t *copyEnd = match + Lz4MinMatch;
+      while (matchEnd < matchLimit && *matchEnd == *copyEnd) {
+        ++matchEnd;
+        ++copyEnd;
+      }
+
+      if (!writeLz4Sequence(anchor, pos - anchor, pos - match, matchEnd - pos, out, outEnd))
+        return 0;
+
+      pos = matchEnd;
+      anchor = pos;
+      missCount = 0;
+    }
+  }
+
+  // The remaining data is stored as literals.
+  if (!writeLz4Sequence(anchor, inEnd - anchor, 0, 0, out, outEnd))
+    return 0;
+
+  return out - outStart;
+}
+
+// =====================================================================================================================
+// Reads a length that did not fit in the 4 bits of a sequence token.
+//
+// @param [in/out] in : Input pointer
+// @param inEnd : End of the input data
+// @param [in/out] length : Length to add to
+// @returns : False if the input data ends before the length does
+static bool readLz4Length(const uint8_t *&in, const uint8_t *inEnd, size_t &length) {
+  uint8_t byte = 0;
+  do {
+    if (in == inEnd)
+      return false;
+    byte = *in++;
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+// =====================================================================================================================
+// Decompresses data in the LZ4 block format. All reads and writes are bounds checked, so malformed data (for example
+// from a corrupted cache file) is reported as an error rather than overrunning a buffer.
+//
+// @param compressedData : Compressed data
+// @param compressedSize : Size of the compressed data in bytes
+// @param [out] rawData : Buffer to store the decompressed data
+// @param rawSize : Expected size of the decompressed data in bytes
+// @returns : False if the data is malformed or does not decompress to exactly rawSize bytes
+bool decompressLz4(const void *compressedData, size_t compressedSize, void *rawData, size_t rawSize) {
+  const uint8_t *in = static_cast<const uint8_t *>(compressedData);
+  const uint8_t *const inEnd = in + compressedSize;
+  uint8_t *const outStart = static_cast<uint8_t *>(rawData);
+  uint8_t *const outEnd = outStart + rawSize;
+  uint8_t *out = outStart;
+
+  while (in < inEnd) {
+    const unsigned token = *in++;
+
+    // Copy the literals.
+    size_t literalLength = token >> 4;
+    if (literalLength == 15 && !readLz4Length(in, inEnd, literalLength))
+      return false;
+    if (literalLength > static_cast<size_t>(inEnd - in) || literalLength > static_cast<size_t>(outEnd - out))
+      return false;
+    memcpy(out, in, literalLength);
+    in += literalLength;
+    out += literalLength;
+
+    // The last sequence has no match.
+    if (in == inEnd)
+      break;
+
+    // Copy the match. It may overlap the data it produces, in which case it has to be copied byte by byte.
+    if (inEnd - in < 2)
+      return false;
+    const size_t offset = in[0] | (in[1] << 8);
+    in += 2;
+    size_t matchLength = token & 0xF;
+    if (matchLength == 15 && !readLz4Length(in, inEnd, matchLength))
+      return false;
+    matchLength += Lz4MinMatch;
+
+    if (offset == 0 || offset > static_cast<size_t>(out - outStart) ||
+        matchLength > static_cast<size_t>(outEnd - out))
+      return false;
+
+    const uint8_t *match = out - offset;
+    if (offset >= matchLength)
+      memcpy(out, match, matchLength);
+    else {
+      for (size_t i = 0; i < matchLength; ++i)
+        out[i] = match[i];
+    }
+    out += matchLength;
+  }
+
+  return out == outEnd;
+}
+
+// =====================================================================================================================
+// Compresses data into a self-describing blob for a cache that stores opaque values.
+//
+// @param data : Data to compress
+// @param dataSize : Size of the data in bytes
+// @param [out] blob : Compressed blob, starting with a CacheBlobHeader
+// @returns : False if compression doesn't make the data smaller, blob is left empty then
+bool compressCacheBlob(const void *data, size_t dataSize, std::vector<uint8_t> *blob) {
+  blob->clear();
+  if (dataSize < MinCacheBlobCompressSize)
+    return false;
+
+  // Compression only pays off if the blob, including its header, is smaller than the data.
+  blob->resize(dataSize - 1);
+  const size_t compressedSize = compressLz4(data, dataSize, blob->data() + sizeof(CacheBlobHeader),
+                                            blob->size() - sizeof(CacheBlobHeader));
+  if (compressedSize == 0) {
+    blob->clear();
+    return false;
+  }
+
+  CacheBlobHeader header = {};
+  header.magic = CacheBlobMagic;
+  header.version = CacheBlobVersion;
+  header.codec = CompressionCodec::Lz4;
+  header.rawSize = dataSize;
+  memcpy(blob->data(), &header, sizeof(header));
+  blob->resize(sizeof(CacheBlobHeader) + compressedSize);
+  return true;
+}
+
+// =====================================================================================================================
+// Decompresses a blob created by compressCacheBlob.
+//
+// @param blob : Blob to decompress
+// @param blobSize : Size of the blob in bytes
+// @param [out] data : Decompressed data
+// @returns : NotFound if the blob was not created by compressCacheBlob, ErrorInvalidValue if it was created with
+//            another version of the blob layout or is malformed
+Result decompressCacheBlob(const void *blob, size_t blobSize, std::vector<uint8_t> *data) {
+  CacheBlobHeader header = {};
+  if (blobSize < sizeof(header.magic) || memcmp(blob, &CacheBlobMagic, sizeof(header.magic)) != 0)
+    return Result::NotFound;
+  if (blobSize < sizeof(header))
+    return Result::ErrorInvalidValue;
+  memcpy(&header, blob, sizeof(header));
+  if (header.version != CacheBlobVersion || header.codec != CompressionCodec::Lz4)
+    return Result::ErrorInvalidValue;
+
+  // Each byte of LZ4 compressed data decompresses to at most 255 bytes, anything larger is not a valid blob.
+  const size_t compressedSize = blobSize - sizeof(header);
+  if (header.rawSize > compressedSize * 255)
+    return Result::ErrorInvalidValue;
+
+  data->resize(header.rawSize);
+  if (!decompressLz4(static_cast<const uint8_t *>(blob) + sizeof(header), compressedSize, data->data(), data->size())) {
+    data->clear();
+    return Result::ErrorInvalidValue;
+  }
+  return Result::Success;
+}
+
+} // namespace Llpc
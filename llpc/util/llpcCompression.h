@@ -0,0 +1,69 @@
+/*
+ ***********************************************************************************************************************
+ *
+ *  Copyright (c) 2021 Advanced Micro Devices, Inc. All Rights Reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ **********************************************************************************************************************/
+/**
+ ***********************************************************************************************************************
+ * @file  llpcCompression.h
+ * @brief LLPC header file: contains declaration of the codec used to compress the data stored in shader caches.
+ ***********************************************************************************************************************
+ */
+#pragma once
+
+#include "llpc.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Llpc {
+
+// Enumerates the codecs shader cache data can be stored with.
+enum class CompressionCodec : uint32_t {
+  None = 0, // Data is stored as it is
+  Lz4 = 1,  // Data is compressed in the LZ4 block format
+};
+
+// Gets the size of the buffer compressLz4 needs to never fail, for data of the specified size.
+inline size_t getLz4CompressBound(size_t dataSize) {
+  return dataSize + dataSize / 255 + 16;
+}
+
+// Compresses data in the LZ4 block format. Returns the compressed size, or 0 if it does not fit in the output buffer.
+size_t compressLz4(const void *data, size_t dataSize, void *compressedData, size_t compressedCapacity);
+
+// Decompresses data in the LZ4 block format. Returns false if the data is malformed or does not decompress to exactly
+// rawSize bytes.
+bool decompressLz4(const void *compressedData, size_t compressedSize, void *rawData, size_t rawSize);
+
+// Version of the layout of the blobs created by compressCacheBlob. It must be increased whenever the layout changes.
+static constexpr uint32_t CacheBlobVersion = 1;
+
+// Compresses data into a self-describing blob for a cache that stores opaque values (such as Vkgc::ICache). Returns
+// false if compression doesn't make the data smaller, in which case the data should be stored as it is.
+bool compressCacheBlob(const void *data, size_t dataSize, std::vector<uint8_t> *blob);
+
+// Decompresses a blob created by compressCacheBlob. Returns NotFound if the blob was not created by compressCacheBlob
+// (it holds uncompressed data then), and ErrorInvalidValue if it was created with another version or is malformed.
+Result decompressCacheBlob(const void *blob, size_t blobSize, std::vector<uint8_t> *data);
+
+} // namespace Llpc
@@ -751,6 +751,50 @@ template <class Elf> void ElfWriter<Elf>::updateMetaNote(Context *pContext, cons
   pNewNote->data = data;
 }
 
+// =====================================================================================================================
+// Reduces the PAL metadata note to the fragment shader part or the non-fragment shader part of the pipeline.
+//
+// The fragment shader part only keeps the .ps hardware stage and the .pixel API shader, as those are the only stage
+// entries mergeMetaNote copies from the fragment ELF. The non-fragment shader part drops both, as they are always
+// replaced when the fragment ELF is merged in. Pipeline level entries and registers are kept in both parts.
+//
+// @param fragmentPart : Whether to keep the fragment shader part (otherwise keep the non-fragment shader part)
+// @param pNote : Note section of the full pipeline
+// @param [out] pNewNote : Note section of the selected part
+template <class Elf> void ElfWriter<Elf>::extractMetaNote(bool fragmentPart, const ElfNote *pNote, ElfNote *pNewNote) {
+  msgpack::Document document;
+
+  auto success =
+      document.readFromBlob(StringRef(reinterpret_cast<const char *>(pNote->data), pNote->hdr.descSize), false);
+  assert(success);
+  (void(success)); // unused
+
+  auto pipeline = document.getRoot().getMap(true)[Util::Abi::PalCodeObjectMetadataKey::Pipelines].getArray(true)[0];
+  auto hwPsStageName = HwStageNames[static_cast<unsigned>(Util::Abi::HardwareStage::Ps)];
+  auto psStageName = ApiStageNames[ShaderStageFragment];
+
+  // Rebuild .hardware_stages and .shaders with the entries that belong to the selected part only.
+  auto extractStages = [&](StringRef mapKey, StringRef psKey) {
+    auto stages = pipeline.getMap(true)[mapKey].getMap(true);
+    auto newStages = document.getMapNode();
+    for (auto &stage : stages) {
+      if ((stage.first.getString() == psKey) == fragmentPart)
+        newStages[stage.first] = stage.second;
+    }
+    pipeline.getMap(true)[mapKey] = newStages;
+  };
+  extractStages(Util::Abi::PipelineMetadataKey::HardwareStages, hwPsStageName);
+  extractStages(Util::Abi::PipelineMetadataKey::Shaders, psStageName);
+
+  std::string blob;
+  document.writeToBlob(blob);
+  *pNewNote = *pNote;
+  auto data = new uint8_t[blob.size()];
+  memcpy(data, blob.data(), blob.size());
+  pNewNote->hdr.descSize = blob.size();
+  pNewNote->data = data;
+}
+
 // =====================================================================================================================
 // Retrieves the section data for the specified section name, if it exists.
 //
@@ -1022,6 +1066,92 @@ void ElfWriter<Elf>::mergeElfBinary(Context *pContext, const BinaryData *pFragme
   writeToBuffer(pPipelineElf);
 }
 
+// =====================================================================================================================
+// Reduce the pipeline ELF to either its fragment shader part or its non-fragment shader part, and write the result out.
+//
+// The split is done at _amdgpu_ps_main: the fragment shader part keeps the ISA code, disassembly and LLVM IR from that
+// symbol onward, and the non-fragment shader part keeps everything before it. Symbols in the code of the other part
+// are dropped.
+// Either part can later be passed to mergeElfBinary in place of the full pipeline ELF. If the pipeline does not
+// contain a fragment shader, the ELF is written out unchanged.
+//
+// @param fragmentPart : Whether to keep the fragment shader part (otherwise keep the non-fragment shader part)
+// @param [out] pPartElf : ELF binary of the selected part
+template <class Elf> void ElfWriter<Elf>::extractElfBinary(bool fragmentPart, ElfPackage *pPartElf) {
+  auto fragmentIsaSymbolName =
+      Util::Abi::PipelineAbiSymbolNameStrings[static_cast<unsigned>(Util::Abi::PipelineSymbolType::PsMainEntry)];
+
+  const SectionBuffer *textSection = nullptr;
+  std::vector<ElfSymbol *> textSymbols;
+  auto textSecIndex = GetSectionIndex(TextName);
+  getSectionDataBySectionIndex(textSecIndex, &textSection);
+  GetSymbolsBySectionIndex(textSecIndex, textSymbols);
+
+  ElfSymbol *fragmentIsaSymbol = nullptr;
+  for (auto symbol : textSymbols) {
+    if (strcmp(symbol->pSymName, fragmentIsaSymbolName) == 0) {
+      fragmentIsaSymbol = symbol;
+      break;
+    }
+  }
+
+  if (!fragmentIsaSymbol) {
+    writeToBuffer(pPartElf);
+    return;
+  }
+
+  // Split GPU ISA code. The symbols at or after the offset of _amdgpu_ps_main belong to the fragment shader. They are
+  // assigned by their offsets rather than by their order in the symbol table, which need not be sorted by offset.
+  size_t isaOffset = fragmentIsaSymbol->value;
+  for (auto symbol : textSymbols) {
+    bool isFragmentSymbol = symbol->value >= isaOffset;
+    if (isFragmentSymbol != fragmentPart)
+      symbol->secIdx = InvalidValue;
+    else if (fragmentPart)
+      symbol->value -= isaOffset;
+  }
+
+  SectionBuffer newTextSection = {};
+  if (fragmentPart)
+    mergeSection(textSection, 0, nullptr, textSection, isaOffset, nullptr, &newTextSection);
+  else
+    mergeSection(textSection, isaOffset, nullptr, textSection, textSection->secHead.sh_size, nullptr, &newTextSection);
+  setSection(textSecIndex, &newTextSection);
+
+  // Split ISA disassembly and LLVM IR disassembly. Both are left untouched if the fragment shader's entry name can't
+  // be found, in which case mergeElfBinary also uses them as a whole.
+  const char *disassemblySectionNames[] = {Util::Abi::AmdGpuDisassemblyName, Util::Abi::AmdGpuCommentLlvmIrName};
+  for (auto sectionName : disassemblySectionNames) {
+    const SectionBuffer *section = nullptr;
+    auto secIndex = GetSectionIndex(sectionName);
+    getSectionDataBySectionIndex(secIndex, &section);
+    if (!section)
+      continue;
+
+    auto fragmentStart = strstr(reinterpret_cast<const char *>(section->data), fragmentIsaSymbolName);
+    if (!fragmentStart)
+      continue;
+
+    size_t fragmentOffset = fragmentStart - reinterpret_cast<const char *>(section->data);
+    SectionBuffer newSection = {};
+    if (fragmentPart)
+      mergeSection(section, 0, nullptr, section, fragmentOffset, nullptr, &newSection);
+    else
+      mergeSection(section, fragmentOffset, nullptr, section, section->secHead.sh_size, nullptr, &newSection);
+    setSection(secIndex, &newSection);
+  }
+
+  // Split PAL metadata
+  ElfNote metaNote = getNote(Util::Abi::MetadataNoteType);
+  if (metaNote.data) {
+    ElfNote newMetaNote = {};
+    extractMetaNote(fragmentPart, &metaNote, &newMetaNote);
+    setNote(&newMetaNote);
+  }
+
+  writeToBuffer(pPartElf);
+}
+
 // =====================================================================================================================
 // Reset the contents to an empty ELF file.
 template <class Elf> void ElfWriter<Elf>::reinitialize() {
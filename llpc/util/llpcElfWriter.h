@@ -74,6 +74,8 @@ public:
 
   static void updateMetaNote(Context *context, const ElfNote *note, ElfNote *newNote);
 
+  static void extractMetaNote(bool fragmentPart, const ElfNote *note, ElfNote *newNote);
+
   Result ReadFromBuffer(const void *buffer, size_t bufSize);
   Result copyFromReader(const ElfReader<Elf> &reader);
 
@@ -81,6 +83,8 @@ public:
 
   void mergeElfBinary(Context *context, const BinaryData *fragmentElf, ElfPackage *pipelineElf);
 
+  void extractElfBinary(bool fragmentPart, ElfPackage *partElf);
+
   // Gets the section index for the specified section name.
   int GetSectionIndex(const char *name) const {
     auto entry = m_map.find(name);
@@ -34,8 +34,8 @@
 #include "spirvExt.h"
 #include "vkgcUtil.h"
 #include "llvm/Support/raw_ostream.h"
-#include <set>
-#include <unordered_set>
+#include <algorithm>
+#include <iterator>
 using namespace llvm;
 
 using namespace spv;
@@ -44,32 +44,98 @@ using Vkgc::SpirvHeader;
 
 namespace Llpc {
 // =====================================================================================================================
-// Collect information from SPIR-V binary
+// Checks whether the opcode is that of a debug instruction, which is removed when trimming debug info.
 //
-// @param spvBinCode : SPIR-V binary data
+// @param opCode : Opcode of the instruction
+static bool isDebugInstruction(unsigned opCode) {
+  switch (opCode) {
+  case OpString:
+  case OpSource:
+  case OpSourceContinued:
+  case OpSourceExtension:
+  case OpName:
+  case OpMemberName:
+  case OpLine:
+  case OpNop:
+  case OpNoLine:
+  case OpModuleProcessed:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// =====================================================================================================================
+// Checks whether the opcode is supported, by looking it up in a table indexed by the opcodes.
+//
+// @param opCode : Opcode of the instruction
+static bool isSupportedOpCode(unsigned opCode) {
+  static const std::vector<bool> SupportedOpCodes = []() {
+#define _SPIRV_OP(x, ...) Op##x,
+    static const Op OpCodes[] = {
+#include "SPIRVOpCodeEnum.h"
+    };
+#undef _SPIRV_OP
+    std::vector<bool> supportedOpCodes(*std::max_element(std::begin(OpCodes), std::end(OpCodes)) + 1);
+    for (Op opCode : OpCodes)
+      supportedOpCodes[opCode] = true;
+    return supportedOpCodes;
+  }();
+  return opCode < SupportedOpCodes.size() && SupportedOpCodes[opCode];
+}
+
+// =====================================================================================================================
+// Scans the SPIR-V binary in a single pass: verifies that its instructions are valid and supported, collects the
+// shader module usage and the entry names, copies the binary without the debug instructions if requested, and
+// computes the hash of the binary and that of the trimmed binary. The hashes are the same as hashing each binary as a
+// whole.
+//
+// @param spvBin : SPIR-V binary
 // @param [out] shaderModuleUsage : Shader module usage info
-// @param [out] shaderEntryNames : Entry names for this shader module
-// @param debugInfoSize : Debug info size
-Result ShaderModuleHelper::collectInfoFromSpirvBinary(const BinaryData *spvBinCode,
-                                                      ShaderModuleUsage *shaderModuleUsage,
-                                                      std::vector<ShaderEntryName> &shaderEntryNames,
-                                                      unsigned *debugInfoSize) {
+// @param [out] shaderEntryNames : Entry names for this shader module, which point into the SPIR-V binary
+// @param [out] trimSpvBin : Buffer of the size of the SPIR-V binary for the trimmed binary, or nullptr not to trim the
+//                           debug instructions
+// @param [out] trimSpvBinSize : Size in bytes of the trimmed binary, or of the binary if it is not trimmed
+// @param [out] hash : Hash of the SPIR-V binary
+// @param [out] trimHash : Hash of the trimmed binary, or of the binary if it is not trimmed
+Result ShaderModuleHelper::scanSpirvBinary(const BinaryData *spvBin, ShaderModuleUsage *shaderModuleUsage,
+                                           std::vector<ShaderEntryName> &shaderEntryNames, void *trimSpvBin,
+                                           size_t *trimSpvBinSize, MetroHash::Hash *hash,
+                                           MetroHash::Hash *trimHash) {
+  // Count of words hashed and copied at once, so that they are still in the cache when they are scanned
+  static const size_t ChunkWordCount = 1024;
+
   Result result = Result::Success;
 
-  const unsigned *code = reinterpret_cast<const unsigned *>(spvBinCode->pCode);
-  const unsigned *end = code + spvBinCode->codeSize / sizeof(unsigned);
+  const unsigned *code = reinterpret_cast<const unsigned *>(spvBin->pCode);
+  const unsigned *end = code + spvBin->codeSize / sizeof(unsigned);
+  unsigned *trimCodePos = reinterpret_cast<unsigned *>(trimSpvBin);
+
+  Util::MetroHash64 hasher;
+  Util::MetroHash64 trimHasher;
+
+  // The instructions from runStart are kept in the trimmed binary, and have not been hashed and copied yet.
+  const unsigned *runStart = code;
+  auto flushRun = [&](const unsigned *runEnd) {
+    size_t runSize = (runEnd - runStart) * sizeof(unsigned);
+    hasher.Update(reinterpret_cast<const uint8_t *>(runStart), runSize);
+    if (trimSpvBin) {
+      trimHasher.Update(reinterpret_cast<const uint8_t *>(runStart), runSize);
+      memcpy(trimCodePos, runStart, runSize);
+      trimCodePos += runEnd - runStart;
+    }
+    runStart = runEnd;
+  };
 
+  // Parse SPIR-V instructions, after the header
+  bool useVarPtrStorageBuf = false;
+  bool useVarPtr = false;
   const unsigned *codePos = code + sizeof(SpirvHeader) / sizeof(unsigned);
-
-  // Parse SPIR-V instructions
-  std::unordered_set<unsigned> capabilities;
-
   while (codePos < end) {
     unsigned opCode = (codePos[0] & OpCodeMask);
     unsigned wordCount = (codePos[0] >> WordCountShift);
 
-    if (wordCount == 0 || codePos + wordCount > end) {
-      LLPC_ERRS("Invalid SPIR-V binary\n");
+    if (wordCount == 0 || wordCount > end - codePos || !isSupportedOpCode(opCode)) {
       result = Result::ErrorInvalidShader;
       break;
     }
@@ -79,7 +145,10 @@ Result ShaderModuleHelper::collectInfoFromSpirvBinary(const BinaryData *spvBinCo
     case OpCapability: {
       assert(wordCount == 2);
       auto capability = static_cast<Capability>(codePos[1]);
-      capabilities.insert(capability);
+      if (capability == CapabilityVariablePointersStorageBuffer)
+        useVarPtrStorageBuf = true;
+      else if (capability == CapabilityVariablePointers)
+        useVarPtr = true;
       break;
     }
     case OpDPdx:
@@ -98,19 +167,6 @@ Result ShaderModuleHelper::collectInfoFromSpirvBinary(const BinaryData *spvBinCo
       shaderModuleUsage->useHelpInvocation = true;
       break;
     }
-    case OpString:
-    case OpSource:
-    case OpSourceContinued:
-    case OpSourceExtension:
-    case OpName:
-    case OpMemberName:
-    case OpLine:
-    case OpNop:
-    case OpNoLine:
-    case OpModuleProcessed: {
-      *debugInfoSize += wordCount * sizeof(unsigned);
-      break;
-    }
     case OpSpecConstantTrue:
     case OpSpecConstantFalse:
     case OpSpecConstant:
@@ -135,70 +191,45 @@ Result ShaderModuleHelper::collectInfoFromSpirvBinary(const BinaryData *spvBinCo
       break;
     }
     }
+
+    if (trimSpvBin && isDebugInstruction(opCode)) {
+      // Skip the debug instruction in the trimmed binary, but hash it in the binary.
+      flushRun(codePos);
+      hasher.Update(reinterpret_cast<const uint8_t *>(codePos), wordCount * sizeof(unsigned));
+      runStart = codePos + wordCount;
+    } else if (static_cast<size_t>(codePos - runStart) >= ChunkWordCount)
+      flushRun(codePos);
+
     codePos += wordCount;
   }
 
-  if (capabilities.find(CapabilityVariablePointersStorageBuffer) != capabilities.end())
-    shaderModuleUsage->enableVarPtrStorageBuf = true;
+  if (result == Result::Success)
+    flushRun(end);
+  else {
+    // The binary is still hashed as a whole, as the hash identifies it in the dumps and the timer profile.
+    hasher.Update(reinterpret_cast<const uint8_t *>(runStart), (end - runStart) * sizeof(unsigned));
+  }
+  // The bytes after the last whole word are hashed in the binary, but are not part of the trimmed binary.
+  hasher.Update(reinterpret_cast<const uint8_t *>(end), spvBin->codeSize % sizeof(unsigned));
 
-  if (capabilities.find(CapabilityVariablePointers) != capabilities.end())
+  if (useVarPtrStorageBuf)
+    shaderModuleUsage->enableVarPtrStorageBuf = true;
+  if (useVarPtr)
     shaderModuleUsage->enableVarPtr = true;
 
-  return result;
-}
-
-// =====================================================================================================================
-// Removes all debug instructions for SPIR-V binary.
-//
-// @param spvBin : SPIR-V binay code
-// @param bufferSize : Output buffer size in bytes
-// @param [out] trimSpvBin : Trimmed SPIR-V binary code
-void ShaderModuleHelper::trimSpirvDebugInfo(const BinaryData *spvBin, unsigned bufferSize, void *trimSpvBin) {
-  assert(bufferSize > sizeof(SpirvHeader));
-
-  const unsigned *code = reinterpret_cast<const unsigned *>(spvBin->pCode);
-  const unsigned *end = code + spvBin->codeSize / sizeof(unsigned);
-  const unsigned *codePos = code + sizeof(SpirvHeader) / sizeof(unsigned);
-
-  unsigned *trimEnd = reinterpret_cast<unsigned *>(voidPtrInc(trimSpvBin, bufferSize));
-  (void(trimEnd)); // unused
-  unsigned *trimCodePos = reinterpret_cast<unsigned *>(voidPtrInc(trimSpvBin, sizeof(SpirvHeader)));
-
-  // Copy SPIR-V header
-  memcpy(trimSpvBin, code, sizeof(SpirvHeader));
-
-  // Copy SPIR-V instructions
-  while (codePos < end) {
-    unsigned opCode = (codePos[0] & OpCodeMask);
-    unsigned wordCount = (codePos[0] >> WordCountShift);
-    switch (opCode) {
-    case OpString:
-    case OpSource:
-    case OpSourceContinued:
-    case OpSourceExtension:
-    case OpName:
-    case OpMemberName:
-    case OpLine:
-    case OpNop:
-    case OpNoLine:
-    case OpModuleProcessed: {
-      // Skip debug instructions
-      break;
-    }
-    default: {
-      // Copy other instructions
-      assert(codePos + wordCount <= end);
-      assert(trimCodePos + wordCount <= trimEnd);
-      memcpy(trimCodePos, codePos, wordCount * sizeof(unsigned));
-      trimCodePos += wordCount;
-      break;
-    }
-    }
-
-    codePos += wordCount;
+  *hash = {};
+  hasher.Finalize(hash->bytes);
+  if (trimSpvBin) {
+    *trimSpvBinSize = static_cast<size_t>(reinterpret_cast<uint8_t *>(trimCodePos) -
+                                            reinterpret_cast<uint8_t *>(trimSpvBin));
+    *trimHash = {};
+    trimHasher.Finalize(trimHash->bytes);
+  } else {
+    *trimSpvBinSize = spvBin->codeSize;
+    *trimHash = *hash;
   }
 
-  assert(trimCodePos == trimEnd);
+  return result;
 }
 
 // =====================================================================================================================
@@ -297,45 +328,6 @@ unsigned ShaderModuleHelper::getStageMaskFromSpirvBinary(const BinaryData *spvBi
   return stageMask;
 }
 
-// =====================================================================================================================
-// Verifies if the SPIR-V binary is valid and is supported
-//
-// @param spvBin : SPIR-V binary
-Result ShaderModuleHelper::verifySpirvBinary(const BinaryData *spvBin) {
-  Result result = Result::Success;
-
-#define _SPIRV_OP(x, ...) Op##x,
-  static const std::set<Op> OpSet{{
-#include "SPIRVOpCodeEnum.h"
-  }};
-#undef _SPIRV_OP
-
-  const unsigned *code = reinterpret_cast<const unsigned *>(spvBin->pCode);
-  const unsigned *end = code + spvBin->codeSize / sizeof(unsigned);
-
-  // Skip SPIR-V header
-  const unsigned *codePos = code + sizeof(SpirvHeader) / sizeof(unsigned);
-
-  while (codePos < end) {
-    Op opCode = static_cast<Op>(codePos[0] & OpCodeMask);
-    unsigned wordCount = (codePos[0] >> WordCountShift);
-
-    if (wordCount == 0 || codePos + wordCount > end) {
-      result = Result::ErrorInvalidShader;
-      break;
-    }
-
-    if (OpSet.find(opCode) == OpSet.end()) {
-      result = Result::ErrorInvalidShader;
-      break;
-    }
-
-    codePos += wordCount;
-  }
-
-  return result;
-}
-
 // =====================================================================================================================
 // Checks whether input binary data is LLVM bitcode.
 //
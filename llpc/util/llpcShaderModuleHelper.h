@@ -31,6 +31,7 @@
 
 #pragma once
 #include "llpc.h"
+#include "vkgcMetroHash.h"
 #include <vector>
 
 namespace Llpc {
@@ -53,10 +54,9 @@ struct ShaderEntryName {
 // Represents LLPC shader module helper class
 class ShaderModuleHelper {
 public:
-  static Result collectInfoFromSpirvBinary(const BinaryData *spvBinCode, ShaderModuleUsage *shaderModuleUsage,
-                                           std::vector<ShaderEntryName> &shaderEntryNames, unsigned *debugInfoSize);
-
-  static void trimSpirvDebugInfo(const BinaryData *spvBin, unsigned bufferSize, void *trimSpvBin);
+  static Result scanSpirvBinary(const BinaryData *spvBin, ShaderModuleUsage *shaderModuleUsage,
+                                std::vector<ShaderEntryName> &shaderEntryNames, void *trimSpvBin,
+                                size_t *trimSpvBinSize, MetroHash::Hash *hash, MetroHash::Hash *trimHash);
 
   static Result optimizeSpirv(const BinaryData *spirvBinIn, BinaryData *spirvBinOut);
 
@@ -64,8 +64,6 @@ public:
 
   static unsigned getStageMaskFromSpirvBinary(const BinaryData *spvBin, const char *entryName);
 
-  static Result verifySpirvBinary(const BinaryData *spvBin);
-
   static bool isLlvmBitcode(const BinaryData *shaderBin);
 };
 
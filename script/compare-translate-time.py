@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+
+"""
+compare-translate-time.py -- Script to compare the SPIR-V translate time of two builds of amdllpc.
+
+Each input is compiled several times by each amdllpc with -enable-timer-profile, and the median wall time of the
+"LLPC Translate" phase, which covers decoding the SPIR-V module and SPIRVToLLVM, is reported for both builds together
+with the speedup. Arguments that are not recognized here are passed on to amdllpc.
+
+Sample use:
+  script/compare-translate-time.py --before old/bin/amdllpc --after new/bin/amdllpc --runs 20 \
+    llpc/test/shaderdb/fuzzer/GraphicsFuzz_TestControlFlowInFunction.spvasm \
+    -spvgen-dir=<spvgen dir> -gfxip=10.1
+"""
+
+import re
+import statistics
+import subprocess
+import sys
+from argparse import ArgumentParser
+
+# The wall time is the last time column of a row of an LLVM timer report, each time being followed by its percentage.
+timer_column = re.compile(r'(\d+\.\d+) \(\s*\d+\.\d+%\)')
+translate_row = re.compile(r'LLPC Translate 0x[0-9A-F]+\s*$')
+
+def get_translate_time(amdllpc, input_file, amdllpc_args):
+  result = subprocess.run([amdllpc, '-enable-timer-profile'] + amdllpc_args + [input_file],
+                          stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+  if result.returncode != 0:
+    print(result.stdout, file=sys.stderr)
+    print(f'{amdllpc} failed on {input_file}', file=sys.stderr)
+    exit(result.returncode)
+
+  # Each pipeline has its own translate timer, which covers all of its shaders. The times of all of the pipelines in
+  # the output are added up.
+  total = 0.0
+  found = False
+  for line in result.stdout.splitlines():
+    if translate_row.search(line):
+      times = timer_column.findall(line)
+      if times:
+        total += float(times[-1])
+        found = True
+  if not found:
+    print(f'No "LLPC Translate" timer in the output of {amdllpc} for {input_file}', file=sys.stderr)
+    exit(3)
+  return total
+
+def main():
+  parser = ArgumentParser()
+  parser.add_argument('inputs', nargs='+', help='Input files (.spvasm, .pipe or any other file amdllpc accepts)')
+  parser.add_argument('--before', required=True, help='amdllpc built without the change')
+  parser.add_argument('--after', required=True, help='amdllpc built with the change')
+  parser.add_argument('--runs', type=int, default=10, help='Number of runs of each amdllpc on each input')
+  args, amdllpc_args = parser.parse_known_args()
+
+  print(f'{"Input":<60} {"Before (ms)":>12} {"After (ms)":>12} {"Speedup":>8}')
+  for input_file in args.inputs:
+    # Alternate the builds, so that changes in the load of the machine affect both of them alike.
+    before_times = []
+    after_times = []
+    for _ in range(args.runs):
+      before_times.append(get_translate_time(args.before, input_file, amdllpc_args))
+      after_times.append(get_translate_time(args.after, input_file, amdllpc_args))
+
+    before = statistics.median(before_times) * 1000
+    after = statistics.median(after_times) * 1000
+    speedup = f'{before / after:.2f}x' if after > 0 else '-'
+    print(f'{input_file:<60} {before:>12.3f} {after:>12.3f} {speedup:>8}')
+
+if __name__ == '__main__':
+  main()